@@ -10,14 +10,35 @@
  */
 
 #include "./CrawlFileTree.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cctype>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 #include "./FileReader.hpp"
-#include "./HttpUtils.hpp"
+#include "./FileTreeWalk.hpp"
+#include "./IndexRuns.hpp"
+#include "./ThreadPool.hpp"
+#include "./Tokenizer.hpp"
 
 using std::nullopt;
 using std::optional;
 using std::string;
+using std::vector;
 
 namespace searchserver {
 
@@ -25,86 +46,901 @@ namespace searchserver {
 // Internal helper functions and constants
 //////////////////////////////////////////////////////////////////////////////
 
-static bool handle_dir(const string& dir_path, WordIndex& index);
+// Number of files the parallel crawl hands to a worker at a time
+static constexpr size_t kBatchSize = 64;
 
-// Read and parse the specified file, then inject it into the MemIndex.
-static void handle_file(const string& fpath, WordIndex& index);
+// Read and parse the specified file, then inject it into the MemIndex, unless
+// policy says to skip it.  Counts what happened to the file in stats.
+static void handle_file(const string& fpath,
+                        const FilePolicy& policy,
+                        WordIndex& index,
+                        CrawlStats* stats);
+
+// Returns the extension of the file at path, lowercased and without the dot,
+// or "" if it has none
+static string file_extension(const string& path);
+
+// Returns true if the first bytes of a file look like text
+static bool looks_like_text(const char* data, size_t size);
+
+// Returns the stamp of the file name in the directory dir_fd (or AT_FDCWD),
+// or nullopt if it can't be stat()ed
+static optional<FileStamp> stamp_file(int dir_fd, const char* name);
+
+// A directory walk: calls its first argument with every file to index, and
+// counts the directories it can't read in its second.  Returns false if the
+// walk fails.
+using FileWalk = std::function<bool(const std::function<void(WalkEntry&)>&,
+                                    size_t* unreadable)>;
+
+// Returns the walk of a full crawl of root_dir, which records the stamp of
+// every file it reports in opts.manifest
+static FileWalk crawl_walk(const string& root_dir, const CrawlOptions& opts);
+
+// Indexes every file reported by walk on opts.num_threads threads, following
+// opts.policy and adding to opts.stats.  Returns nullopt if the walk fails.
+//
+// If runs is not null, each thread spills its index to runs whenever it grows
+// past its share of opts.memory_budget, and once more at the end, so that the
+// index returned is empty.
+static optional<WordIndex> index_files(const FileWalk& walk,
+                                       const CrawlOptions& opts,
+                                       IndexRuns* runs = nullptr);
+
+// Spills index to runs and empties it if runs is not null and the index has
+// grown past budget bytes, counting the time it takes in stats
+static void spill_if_full(WordIndex* index,
+                          IndexRuns* runs,
+                          size_t budget,
+                          CrawlStats* stats);
+
+using Clock = std::chrono::steady_clock;
+
+// Returns the nanoseconds from since to now, and moves since to now
+static uint64_t lap(Clock::time_point* since);
+
+// The counters of one crawl thread that a ProgressSampler reads while the
+// crawl runs.  Only the thread that owns the matching CrawlStats writes them,
+// and each sits on a cache line of its own.
+struct alignas(64) ShardProgress {
+  std::atomic<uint64_t> files{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> new_words{0};
+
+  // copies the counts of stats
+  void publish(const CrawlStats& stats) {
+    files.store(stats.indexed, std::memory_order_relaxed);
+    bytes.store(stats.bytes, std::memory_order_relaxed);
+    new_words.store(stats.new_words, std::memory_order_relaxed);
+  }
+};
+
+// Samples the progress of a crawl every opts.progress_interval, on a thread
+// of its own, and passes each sample to opts.on_progress.  Does nothing if
+// nobody wants the samples.
+class ProgressSampler {
+ public:
+  ProgressSampler(const CrawlOptions& opts,
+                  const ShardProgress* shards,
+                  size_t num_shards);
+  ~ProgressSampler();
+
+  // Stops sampling, takes a last sample, and returns every sample taken
+  vector<CrawlProgress> finish();
+
+ private:
+  // sums the shards' counters
+  CrawlProgress sample() const;
+
+  // the sampling thread
+  void run();
+
+  const CrawlOptions& opts_;
+  const ShardProgress* shards_;
+  size_t num_shards_;
+  Clock::time_point start_;
+  std::mutex lock_;
+  std::condition_variable wake_;
+  bool done_ = false;
+  vector<CrawlProgress> samples_;
+  std::thread thread_;
+};
+
+// Brings index and manifest up to date with the files walk reports: files that
+// are new or whose stamp differs from the manifest are indexed (again), and
+// files in the manifest that in_scope() accepts but walk did not report are
+// removed.  Returns nullopt, leaving index and manifest untouched, if the walk
+// fails.
+static optional<CrawlChanges> apply_walk(
+    const FileWalk& walk,
+    const std::function<bool(const string&)>& in_scope,
+    WordIndex* index,
+    Manifest* manifest,
+    const CrawlOptions& opts);
+
+// Per-thread indexes (and stats) of a parallel crawl.  At most one batch runs
+// per pool thread, so a batch always finds an idle index to check out.
+struct CrawlShards {
+  const FilePolicy* policy;
+  // where an out-of-core crawl spills, and each index's share of the budget
+  IndexRuns* runs;
+  size_t budget;
+  std::mutex lock;
+  vector<WordIndex> indexes;
+  vector<CrawlStats> stats;
+  ShardProgress* progress;
+  vector<size_t> idle;
+};
+
+// ThreadPool task: indexes a batch of files into an idle shard
+static void handle_batch(CrawlShards* shards, const vector<string>& paths);
+
+// Merges the shards into shards->indexes[0] on pool, in pairs: each round
+// merges shard i + step into shard i, for every other step, so n shards take
+// log2(n) rounds of merges that run side by side instead of n - 1 in a row.
+// Documents keep the order of the shards they came from.  Empty shards are
+// dropped first.
+static void merge_shards(ThreadPool* pool, CrawlShards* shards);
+
+// Adds the counts in from to *to, if to isn't null
+static void add_stats(CrawlStats* to, const CrawlStats& from);
+
+// Adds a file that was indexed to stats->largest if it is one of the largest
+static void note_largest(CrawlStats* stats, uint64_t size, const string& path);
+
+// Returns s as a JSON string literal
+static string json_string(const string& s);
+
+// Lowercases ext and strips a leading dot, so ".TXT" and "txt" compare equal
+static string lowercase_extension(string ext);
+
+// Returns true if ext (from file_extension()) is one of exts
+static bool has_extension(const vector<string>& exts, const string& ext);
+
+// Control characters that text files commonly contain: backspace, tab, line
+// feed, vertical tab, form feed, carriage return and escape
+static constexpr auto kTextControl = [] {
+  std::array<uint8_t, 0x20> table{};
+  for (char c : {'\b', '\t', '\n', '\v', '\f', '\r', '\x1b'}) {
+    table[static_cast<unsigned char>(c)] = 1;
+  }
+  return table;
+}();
+
+// A sniffed file with more than one other control character in this many
+// bytes is taken to be binary
+static constexpr size_t kMaxControlRatio = 10;
+
+// First line of a manifest file
+static const char* const kManifestMagic = "searchserver-manifest 2";
 
 //////////////////////////////////////////////////////////////////////////////
 // Externally-exported functions
 //////////////////////////////////////////////////////////////////////////////
 
 optional<WordIndex> crawl_filetree(const string& root_dir) {
-  // TODO
-  // you probably want to use the helper functions
-  // -- implementation below --
-  if (!readdir(root_dir)) {
+  return crawl_filetree(root_dir, CrawlOptions{});
+}
+
+optional<WordIndex> crawl_filetree(const string& root_dir,
+                                   const CrawlOptions& opts) {
+  if (opts.manifest != nullptr) {
+    opts.manifest->clear();
+  }
+  return index_files(crawl_walk(root_dir, opts), opts);
+}
+
+bool crawl_to_file(const string& root_dir,
+                   const string& index_file,
+                   const CrawlOptions& opts) {
+  if (opts.manifest != nullptr) {
+    opts.manifest->clear();
+  }
+  IndexRuns runs(index_file);
+  if (!index_files(crawl_walk(root_dir, opts), opts, &runs)) {
+    return false;
+  }
+  return runs.merge(index_file);
+}
+
+optional<CrawlChanges> update_filetree(const string& root_dir,
+                                       WordIndex* index,
+                                       Manifest* manifest,
+                                       const CrawlOptions& opts) {
+  return apply_walk(
+      [&](const std::function<void(WalkEntry&)>& on_file,
+          size_t* unreadable) {
+        return walk_filetree(root_dir, on_file, unreadable);
+      },
+      [](const string&) { return true; }, index, manifest, opts);
+}
+
+CrawlChanges update_paths(const vector<string>& paths,
+                          WordIndex* index,
+                          Manifest* manifest,
+                          const CrawlOptions& opts) {
+  // A path that is gone is left out; so is a directory that can't be read
+  // (any more), so this walk never fails
+  vector<string> files;
+  vector<string> dirs;
+  for (auto& path : paths) {
+    struct stat st {};
+    if (stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      dirs.push_back(path);
+    } else if (S_ISREG(st.st_mode)) {
+      files.push_back(path);
+    }
+  }
+  auto walk = [&](const std::function<void(WalkEntry&)>& on_file,
+                  size_t* unreadable) {
+    for (auto& path : files) {
+      WalkEntry file{path, AT_FDCWD, nullptr};
+      file.name = file.path.c_str();
+      on_file(file);
+    }
+    for (auto& dir : dirs) {
+      walk_filetree(dir, on_file, unreadable);
+    }
+    return true;
+  };
+
+  // a manifest entry is covered if it is one of paths, or under one of them
+  std::unordered_set<string> scope(paths.begin(), paths.end());
+  auto in_scope = [&](const string& file) {
+    if (scope.count(file) != 0) {
+      return true;
+    }
+    for (size_t slash = file.rfind('/'); slash != string::npos && slash > 0;
+         slash = file.rfind('/', slash - 1)) {
+      if (scope.count(file.substr(0, slash)) != 0) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // a few files, the usual edit, are read on this thread: a pool would
+  // cost more to start and to merge than it saves
+  if (dirs.empty() && files.size() <= kBatchSize) {
+    CrawlOptions one_thread = opts;
+    one_thread.num_threads = 1;
+    return *apply_walk(walk, in_scope, index, manifest, one_thread);
+  }
+  return *apply_walk(walk, in_scope, index, manifest, opts);
+}
+
+optional<Manifest> read_manifest(const string& path,
+                                 const string& root_dir,
+                                 const FilePolicy& policy) {
+  std::ifstream in(path);
+  string line;
+  if (!std::getline(in, line) || line != kManifestMagic) {
     return nullopt;
   }
-  WordIndex index;
-  if (!handle_dir(root_dir, index)) {
+  if (!std::getline(in, line) || line != root_dir) {
     return nullopt;
   }
-  return index;
+  // a different policy may index different files out of the same tree
+  if (!std::getline(in, line) || line != policy.describe()) {
+    return nullopt;
+  }
+
+  // one "<size> <mtime_ns> <inode> <path>" line per file
+  Manifest manifest;
+  while (std::getline(in, line)) {
+    FileStamp stamp{};
+    const char* p = line.data();
+    const char* end = line.data() + line.size();
+    auto field = [&](auto* out) {
+      auto [next, ec] = std::from_chars(p, end, *out);
+      if (ec != std::errc() || next == end || *next != ' ')
+        return false;
+      p = next + 1;
+      return true;
+    };
+    if (!field(&stamp.size) || !field(&stamp.mtime_ns) ||
+        !field(&stamp.inode)) {
+      return nullopt;
+    }
+    manifest[string(p, end)] = stamp;
+  }
+  if (in.bad()) {
+    return nullopt;
+  }
+  return manifest;
+}
+
+bool write_manifest(const string& path,
+                    const string& root_dir,
+                    const FilePolicy& policy,
+                    const Manifest& manifest) {
+  string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << kManifestMagic << "\n"
+        << root_dir << "\n"
+        << policy.describe() << "\n";
+    for (auto& [file, stamp] : manifest) {
+      // such a file just looks new to every update, which is still correct
+      if (file.find('\n') != string::npos)
+        continue;
+      out << stamp.size << ' ' << stamp.mtime_ns << ' ' << stamp.inode << ' '
+          << file << '\n';
+    }
+    out.flush();
+    if (!out) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 // Internal helper functions
 //////////////////////////////////////////////////////////////////////////////
 
-static bool handle_dir(const string& dir_path, WordIndex& index) {
-  // Recursively descend into the passed-in directory, looking for files and
-  // subdirectories.  Any encountered files are processed via handle_file(); any
-  // subdirectories are recusively handled by handle_dir().
+string FilePolicy::describe() const {
+  // normalized and sorted, so that equal policies are described the same
+  auto list = [](const vector<string>& exts) {
+    vector<string> norm;
+    for (auto& ext : exts) {
+      norm.push_back(lowercase_extension(ext));
+    }
+    std::sort(norm.begin(), norm.end());
+    norm.erase(std::unique(norm.begin(), norm.end()), norm.end());
+    string joined;
+    for (auto& ext : norm) {
+      joined += (joined.empty() ? "" : ",") + ext;
+    }
+    return joined;
+  };
+  return "max-size=" + std::to_string(max_size) +
+         " sniff=" + (sniff ? "1" : "0") +
+         " include=" + list(include_extensions) +
+         " exclude=" + list(exclude_extensions);
+}
 
-  // TODO
-  // you may find the readdir function in HttpUtils helpful
-  auto maybe_entries = readdir(dir_path);
-  if (!maybe_entries) {
-    return false;
+static void add_stats(CrawlStats* to, const CrawlStats& from) {
+  if (to == nullptr)
+    return;
+  to->indexed += from.indexed;
+  to->skipped_extension += from.skipped_extension;
+  to->skipped_size += from.skipped_size;
+  to->skipped_binary += from.skipped_binary;
+  to->unreadable += from.unreadable;
+  to->bytes += from.bytes;
+  to->tokens += from.tokens;
+  to->new_words += from.new_words;
+  to->elapsed_ns += from.elapsed_ns;
+  to->walk_ns += from.walk_ns;
+  to->read_ns += from.read_ns;
+  to->tokenize_ns += from.tokenize_ns;
+  to->record_ns += from.record_ns;
+  to->spill_ns += from.spill_ns;
+  for (auto& [size, path] : from.largest) {
+    note_largest(to, size, path);
   }
-  for (auto& e : *maybe_entries) {
-    if (e.name == "." || e.name == "..") {
-      continue;
+  to->samples.insert(to->samples.end(), from.samples.begin(),
+                     from.samples.end());
+}
+
+static void note_largest(CrawlStats* stats, uint64_t size, const string& path) {
+  auto& largest = stats->largest;
+  if (largest.size() == kLargestFiles && largest.back().first >= size) {
+    return;
+  }
+  auto it = std::find_if(largest.begin(), largest.end(),
+                         [size](auto& file) { return file.first < size; });
+  largest.emplace(it, size, path);
+  if (largest.size() > kLargestFiles) {
+    largest.pop_back();
+  }
+}
+
+string CrawlStats::to_json() const {
+  auto seconds = [](uint64_t ns) { return ns / 1e9; };
+  double elapsed = seconds(elapsed_ns);
+  auto per_second = [elapsed](uint64_t n) {
+    return elapsed > 0 ? n / elapsed : 0.0;
+  };
+
+  std::ostringstream out;
+  out << "{\"elapsed_s\": " << elapsed << ", \"files\": {\"indexed\": "
+      << indexed << ", \"skipped_extension\": " << skipped_extension
+      << ", \"skipped_size\": " << skipped_size
+      << ", \"skipped_binary\": " << skipped_binary
+      << ", \"unreadable\": " << unreadable << "}, \"bytes\": " << bytes
+      << ", \"tokens\": " << tokens << ", \"new_words\": " << new_words
+      << ", \"files_per_s\": " << per_second(indexed)
+      << ", \"bytes_per_s\": " << per_second(bytes)
+      << ", \"phases_s\": {\"walk\": " << seconds(walk_ns)
+      << ", \"read\": " << seconds(read_ns)
+      << ", \"tokenize\": " << seconds(tokenize_ns)
+      << ", \"record\": " << seconds(record_ns)
+      << ", \"spill\": " << seconds(spill_ns) << "}, \"largest_files\": [";
+  for (size_t i = 0; i < largest.size(); i++) {
+    out << (i == 0 ? "" : ", ") << "{\"path\": "
+        << json_string(largest[i].second)
+        << ", \"bytes\": " << largest[i].first << "}";
+  }
+  out << "], \"samples\": [";
+  for (size_t i = 0; i < samples.size(); i++) {
+    out << (i == 0 ? "" : ", ") << "{\"elapsed_s\": " << samples[i].elapsed_s
+        << ", \"files\": " << samples[i].files
+        << ", \"bytes\": " << samples[i].bytes
+        << ", \"new_words\": " << samples[i].new_words << "}";
+  }
+  out << "]}";
+  return out.str();
+}
+
+static string json_string(const string& s) {
+  // paths are bytes, not necessarily UTF-8; those bytes are passed through
+  string out = "\"";
+  for (char c : s) {
+    auto u = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (u < 0x20) {
+      char esc[8];
+      std::snprintf(esc, sizeof(esc), "\\u%04x", u);
+      out += esc;
+    } else {
+      out += c;
     }
-    string full = dir_path + "/" + e.name;
-    if (e.is_dir) {
-      if (!handle_dir(full, index)) {
-        return false;
-      }
+  }
+  return out + "\"";
+}
+
+static string lowercase_extension(string ext) {
+  if (!ext.empty() && ext[0] == '.') {
+    ext.erase(0, 1);
+  }
+  for (auto& c : ext) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return ext;
+}
+
+static bool has_extension(const vector<string>& exts, const string& ext) {
+  for (auto& candidate : exts) {
+    if (lowercase_extension(candidate) == ext)
+      return true;
+  }
+  return false;
+}
+
+static optional<FileStamp> stamp_file(int dir_fd, const char* name) {
+  struct stat st {};
+  if (fstatat(dir_fd, name, &st, 0) != 0) {
+    return nullopt;
+  }
+  return FileStamp{static_cast<uint64_t>(st.st_size),
+                   static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                       st.st_mtim.tv_nsec,
+                   static_cast<uint64_t>(st.st_ino)};
+}
+
+static optional<CrawlChanges> apply_walk(
+    const FileWalk& walk,
+    const std::function<bool(const string&)>& in_scope,
+    WordIndex* index,
+    Manifest* manifest,
+    const CrawlOptions& opts) {
+  // Index only new and changed files.  Changed ones also have their old
+  // postings removed; so do new ones, which is a no-op unless the index
+  // somehow has them without the manifest knowing.
+  CrawlChanges changes;
+  Manifest seen;
+  vector<string> stale;
+  auto delta = index_files(
+      [&](const std::function<void(WalkEntry&)>& on_file,
+          size_t* unreadable) {
+        return walk(
+            [&](WalkEntry& file) {
+              const string& path = file.path;
+              auto stamp = stamp_file(file.dir_fd, file.name);
+              if (!stamp)
+                return;
+              // a walk may report a file twice; index it once
+              if (!seen.emplace(path, *stamp).second)
+                return;
+              auto it = manifest->find(path);
+              if (it != manifest->end() && it->second == *stamp) {
+                changes.unchanged++;
+                return;
+              }
+              if (it == manifest->end()) {
+                changes.added++;
+              } else {
+                changes.modified++;
+              }
+              stale.push_back(path);
+              on_file(file);
+            },
+            unreadable);
+      },
+      opts);
+  if (!delta) {
+    return nullopt;
+  }
+
+  // files that are gone
+  for (auto it = manifest->begin(); it != manifest->end();) {
+    if (seen.find(it->first) == seen.end() && in_scope(it->first)) {
+      stale.push_back(it->first);
+      changes.removed++;
+      it = manifest->erase(it);
     } else {
-      handle_file(full, index);
+      ++it;
     }
   }
-  return true;
+  for (auto& [path, stamp] : seen) {
+    (*manifest)[path] = stamp;
+  }
+
+  index->remove_documents(stale);
+  index->merge(std::move(*delta));
+  return changes;
 }
 
-static void handle_file(const string& fpath, WordIndex& index) {
-  // TODO: implement
+static FileWalk crawl_walk(const string& root_dir, const CrawlOptions& opts) {
+  return [&root_dir, &opts](const std::function<void(WalkEntry&)>& on_file,
+                            size_t* unreadable) {
+    return walk_filetree(
+        root_dir,
+        [&](WalkEntry& file) {
+          if (opts.manifest != nullptr) {
+            auto stamp = stamp_file(file.dir_fd, file.name);
+            if (!stamp)
+              return;
+            (*opts.manifest)[file.path] = *stamp;
+          }
+          on_file(file);
+        },
+        unreadable);
+  };
+}
 
-  // Read the contents of the specified file into a string
-  auto maybe_text = read_file(fpath);
-  if (!maybe_text) {
+static optional<WordIndex> index_files(const FileWalk& walk,
+                                       const CrawlOptions& opts,
+                                       IndexRuns* runs) {
+  auto start = Clock::now();
+  size_t num_threads = std::max<size_t>(opts.num_threads, 1);
+  size_t budget = opts.memory_budget / num_threads;
+  auto progress = std::make_unique<ShardProgress[]>(num_threads);
+  ProgressSampler sampler(opts, progress.get(), num_threads);
+
+  // the walk's own time is what the walk takes minus what its callbacks do
+  CrawlStats stats;
+  uint64_t callback_ns = 0;
+  auto walk_start = Clock::now();
+
+  WordIndex index;
+  if (num_threads == 1) {
+    if (!walk(
+            [&](WalkEntry& file) {
+              auto clock = Clock::now();
+              handle_file(file.path, opts.policy, index, &stats);
+              spill_if_full(&index, runs, budget, &stats);
+              progress[0].publish(stats);
+              callback_ns += lap(&clock);
+            },
+            &stats.unreadable)) {
+      return nullopt;
+    }
+    stats.walk_ns += lap(&walk_start) - callback_ns;
+    spill_if_full(&index, runs, 0, &stats);
+  } else {
+    // The walk runs on this thread and feeds batches of files to the pool,
+    // so directory traversal overlaps with reading and tokenizing.
+    CrawlShards shards;
+    shards.policy = &opts.policy;
+    shards.runs = runs;
+    shards.budget = budget;
+    shards.indexes.resize(num_threads);
+    shards.stats.resize(num_threads);
+    shards.progress = progress.get();
+    for (size_t i = 0; i < num_threads; i++) {
+      shards.idle.push_back(i);
+    }
+    ThreadPool pool(num_threads);
+    WaitGroup batches;
+    vector<string> paths;
+    auto send_batch = [&] {
+      batches.add();
+      pool.dispatch([&shards, &batches, batch = std::move(paths)] {
+        handle_batch(&shards, batch);
+        batches.done();
+      });
+      paths.clear();
+    };
+    walk_start = Clock::now();
+    bool ok = walk(
+        [&](WalkEntry& file) {
+          auto clock = Clock::now();
+          paths.push_back(std::move(file.path));
+          if (paths.size() == kBatchSize) {
+            send_batch();
+          }
+          callback_ns += lap(&clock);
+        },
+        &stats.unreadable);
+    stats.walk_ns += lap(&walk_start) - callback_ns;
+    send_batch();
+    pool.wait(&batches);
+    if (!ok) {
+      return nullopt;
+    }
+
+    // an out-of-core crawl spills what each shard has left, side by side;
+    // otherwise the shards are merged
+    if (runs != nullptr) {
+      pool.parallel_for(0, num_threads, 1, [&](size_t i) {
+        spill_if_full(&shards.indexes[i], runs, 0, &shards.stats[i]);
+      });
+    }
+    merge_shards(&pool, &shards);
+    index = std::move(shards.indexes[0]);
+    for (size_t i = 0; i < num_threads; i++) {
+      add_stats(&stats, shards.stats[i]);
+    }
+  }
+
+  stats.samples = sampler.finish();
+  stats.elapsed_ns = lap(&start);
+  add_stats(opts.stats, stats);
+  return index;
+}
+
+static void spill_if_full(WordIndex* index,
+                          IndexRuns* runs,
+                          size_t budget,
+                          CrawlStats* stats) {
+  if (runs == nullptr || index->memory_usage() <= budget) {
     return;
   }
-  string content = *maybe_text;
+  // a failed spill is reported by IndexRuns::merge()
+  auto clock = Clock::now();
+  runs->spill(*index);
+  *index = WordIndex();
+  stats->spill_ns += lap(&clock);
+}
 
-  // Search the string for all tokens, by splitting on " \r\t\v\n,.:;?!"
-  // A delimiter marks the end of a token and is not considered a valid part of
-  // the token
-  auto tokens = split(content, " \r\t\v\n,.:;?!");
+static uint64_t lap(Clock::time_point* since) {
+  auto now = Clock::now();
+  auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - *since);
+  *since = now;
+  return ns.count();
+}
 
-  // Record each non empty token as a word into the Wordindex specified by index
-  // Your implementation should also be case in-sensitive and record every word
-  // in all lower-case
-  for (auto& w : tokens) {
-    if (w.empty()) {
-      continue;
+ProgressSampler::ProgressSampler(const CrawlOptions& opts,
+                                 const ShardProgress* shards,
+                                 size_t num_shards)
+    : opts_(opts),
+      shards_(shards),
+      num_shards_(num_shards),
+      start_(Clock::now()) {
+  if (opts.stats != nullptr || opts.on_progress) {
+    thread_ = std::thread([this] { run(); });
+  }
+}
+
+ProgressSampler::~ProgressSampler() {
+  finish();
+}
+
+vector<CrawlProgress> ProgressSampler::finish() {
+  if (!thread_.joinable()) {
+    return std::move(samples_);
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    done_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+
+  // the last sample is of the finished crawl
+  samples_.push_back(sample());
+  if (opts_.on_progress) {
+    opts_.on_progress(samples_.back());
+  }
+  return std::move(samples_);
+}
+
+CrawlProgress ProgressSampler::sample() const {
+  CrawlProgress progress;
+  progress.elapsed_s =
+      std::chrono::duration<double>(Clock::now() - start_).count();
+  for (size_t i = 0; i < num_shards_; i++) {
+    progress.files += shards_[i].files.load(std::memory_order_relaxed);
+    progress.bytes += shards_[i].bytes.load(std::memory_order_relaxed);
+    progress.new_words +=
+        shards_[i].new_words.load(std::memory_order_relaxed);
+  }
+  return progress;
+}
+
+void ProgressSampler::run() {
+  std::unique_lock<std::mutex> guard(lock_);
+  while (!wake_.wait_for(guard, opts_.progress_interval,
+                         [this] { return done_; })) {
+    samples_.push_back(sample());
+    if (opts_.on_progress) {
+      opts_.on_progress(samples_.back());
+    }
+  }
+}
+
+static void handle_batch(CrawlShards* shards, const vector<string>& paths) {
+  size_t shard = 0;
+  {
+    std::lock_guard<std::mutex> guard(shards->lock);
+    shard = shards->idle.back();
+    shards->idle.pop_back();
+  }
+  CrawlStats* stats = &shards->stats[shard];
+  for (auto& path : paths) {
+    handle_file(path, *shards->policy, shards->indexes[shard], stats);
+    spill_if_full(&shards->indexes[shard], shards->runs, shards->budget,
+                  stats);
+    shards->progress[shard].publish(*stats);
+  }
+  std::lock_guard<std::mutex> guard(shards->lock);
+  shards->idle.push_back(shard);
+}
+
+static void merge_shards(ThreadPool* pool, CrawlShards* shards) {
+  // shards that were never handed a file have nothing to merge, and a crawl
+  // smaller than a batch or two only fills one
+  vector<WordIndex>& indexes = shards->indexes;
+  indexes.erase(std::remove_if(indexes.begin() + 1, indexes.end(),
+                               [](const WordIndex& index) {
+                                 return index.num_docs() == 0;
+                               }),
+                indexes.end());
+  size_t n = indexes.size();
+  for (size_t step = 1; step < n; step *= 2) {
+    // the pairs of this round: shard k * 2 * step takes in the one step on
+    size_t pairs = (n - step + 2 * step - 1) / (2 * step);
+    pool->parallel_for(0, pairs, 1, [&](size_t k) {
+      size_t i = k * 2 * step;
+      indexes[i].merge(std::move(indexes[i + step]));
+    });
+  }
+}
+
+static void handle_file(const string& fpath,
+                        const FilePolicy& policy,
+                        WordIndex& index,
+                        CrawlStats* stats) {
+  // The cheap checks come first: the name, then the size once the file is
+  // open, then the first bytes once they are read
+  if (!policy.include_extensions.empty() ||
+      !policy.exclude_extensions.empty()) {
+    string ext = file_extension(fpath);
+    if ((!policy.include_extensions.empty() &&
+         !has_extension(policy.include_extensions, ext)) ||
+        has_extension(policy.exclude_extensions, ext)) {
+      stats->skipped_extension++;
+      return;
+    }
+  }
+
+  // Read the file a chunk at a time, so that memory use doesn't grow with
+  // the size of the file
+  ChunkedFileReader file(policy.read_chunk_size);
+  auto clock = Clock::now();
+  if (!file.open(fpath)) {
+    stats->unreadable++;
+    return;
+  }
+  if (policy.max_size != 0 && file.file_size() > policy.max_size) {
+    stats->skipped_size++;
+    return;
+  }
+  bool more = file.next();
+  stats->read_ns += lap(&clock);
+  if (!more && file.error()) {
+    stats->unreadable++;
+    return;
+  }
+  if (policy.sniff &&
+      !looks_like_text(file.data(), std::min(file.size(), kSniffSize))) {
+    stats->skipped_binary++;
+    return;
+  }
+
+  // Split each chunk into words on " \r\t\v\n,.:;?!", lowercasing them, and
+  // record each one.  The words are views into the chunk, so apart from the
+  // first occurance of a word in the index, nothing here allocates.  A read
+  // error part way through leaves the words read so far in the index.
+  //
+  // The chunk is split completely before its words are recorded, so that the
+  // two phases can be timed with a few clock reads per chunk.
+  thread_local vector<std::string_view> words;
+  stats->indexed++;
+  stats->bytes += file.file_size();
+  note_largest(stats, file.file_size(), fpath);
+  size_t words_before = index.num_words();
+  DocId doc = index.add_document(fpath);
+  // set while going through a word longer than the buffer, which is skipped
+  // rather than grown into (minified code, base64, binary files)
+  bool skipping = false;
+  do {
+    size_t keep = 0;
+    bool in_long_word = skipping;
+    skipping = false;
+    const char* chunk_end = file.data() + file.size();
+    Tokenizer tokens(file.data(), file.size());
+    std::string_view word;
+    words.clear();
+    while (tokens.next(&word)) {
+      bool runs_on = !file.at_eof() && word.data() + word.size() == chunk_end;
+      if (in_long_word && word.data() == file.data()) {
+        // the rest of the long word
+        skipping = runs_on;
+        continue;
+      }
+      // a word that runs up to the end of the chunk may go on in the next
+      // one, so it is carried over and looked at again, unless it already
+      // fills the buffer
+      if (runs_on) {
+        if (word.size() < file.capacity()) {
+          keep = word.size();
+        } else {
+          skipping = true;
+        }
+        break;
+      }
+      words.push_back(word);
+    }
+    stats->tokenize_ns += lap(&clock);
+
+    for (auto w : words) {
+      index.record(w, doc);
+    }
+    stats->tokens += words.size();
+    stats->record_ns += lap(&clock);
+
+    more = file.next(keep);
+    stats->read_ns += lap(&clock);
+  } while (more);
+  stats->new_words += index.num_words() - words_before;
+}
+
+static string file_extension(const string& path) {
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  // a leading dot (".bashrc") starts a name, not an extension
+  if (dot == string::npos || (slash != string::npos && dot <= slash + 1) ||
+      dot == 0) {
+    return "";
+  }
+  return lowercase_extension(path.substr(dot + 1));
+}
+
+static bool looks_like_text(const char* data, size_t size) {
+  // like git and grep: a NUL byte means binary.  Otherwise allow for a few
+  // stray control characters, but not for mostly those.
+  if (std::memchr(data, '\0', size) != nullptr) {
+    return false;
+  }
+  size_t control = 0;
+  for (size_t i = 0; i < size; i++) {
+    auto c = static_cast<unsigned char>(data[i]);
+    if ((c < 0x20 && kTextControl[c] == 0) || c == 0x7f) {
+      control++;
     }
-    std::transform(w.begin(), w.end(), w.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-    index.record(w, fpath);
   }
+  return control * kMaxControlRatio <= size;
 }
 
 }  // namespace searchserver
@@ -12,10 +12,17 @@
 #ifndef CRAWLFILETREE_HPP_
 #define CRAWLFILETREE_HPP_
 
+#include "./FileReader.hpp"
 #include "./WordIndex.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace searchserver {
 
@@ -34,6 +41,216 @@ namespace searchserver {
 // - Returns nullopt on failure to scan the directory, the WordIndex on success.
 std::optional<WordIndex> crawl_filetree(const std::string& root_dir);
 
+// What a file looked like when it was indexed.  A file whose stamp no longer
+// matches has been modified (or replaced) since, and must be indexed again.
+struct FileStamp {
+  uint64_t size;
+  int64_t mtime_ns;
+  uint64_t inode;
+
+  bool operator==(const FileStamp& other) const = default;
+};
+
+// The stamp of every file a crawl indexed, by path
+using Manifest = std::unordered_map<std::string, FileStamp>;
+
+// Which files a crawl indexes.  Files that fail a check are skipped before
+// they are read, or after only their first few KiB have been.
+struct FilePolicy {
+  // files bigger than this many bytes are skipped; 0 for no limit
+  uint64_t max_size = 0;
+  // if not empty, only files with one of these extensions are indexed.
+  // Extensions are matched without the dot and ignoring case.
+  std::vector<std::string> include_extensions;
+  // files with one of these extensions are skipped
+  std::vector<std::string> exclude_extensions;
+  // skip files that don't look like text: files with a NUL byte, or with more
+  // than a few control characters, in their first kSniffSize bytes
+  bool sniff = true;
+  // Size of the buffer files are read through.  A word at least this long
+  // can't be carried from one chunk to the next, and is skipped.
+  size_t read_chunk_size = ChunkedFileReader::kDefaultChunkSize;
+
+  // a one line description of the policy; two crawls with the same
+  // description index the same files
+  std::string describe() const;
+};
+
+// Number of bytes at the start of a file that FilePolicy::sniff looks at
+static constexpr size_t kSniffSize = 8192;
+
+// How far a running crawl has got
+struct CrawlProgress {
+  // seconds since the crawl started
+  double elapsed_s = 0;
+  // files indexed so far, and their total size in bytes
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  // words that were new to the index of the crawl thread that recorded them.
+  // A word first seen by several threads counts once for each, so with more
+  // than one thread this is an upper bound on the vocabulary.
+  uint64_t new_words = 0;
+};
+
+// Number of files CrawlStats::largest keeps
+static constexpr size_t kLargestFiles = 10;
+
+// What a crawl did with the files it found, and where it spent its time.
+// Every counter is kept per crawl thread and only summed once the crawl is
+// done, so the bookkeeping is a few clock reads per file and per chunk.
+struct CrawlStats {
+  size_t indexed = 0;
+  size_t skipped_extension = 0;
+  size_t skipped_size = 0;
+  size_t skipped_binary = 0;
+  // files, and directories, that couldn't be opened or read
+  size_t unreadable = 0;
+
+  // total size of the files indexed
+  uint64_t bytes = 0;
+  // words recorded, and how many of them were new (see CrawlProgress)
+  uint64_t tokens = 0;
+  uint64_t new_words = 0;
+
+  // wall clock time of the whole crawl
+  uint64_t elapsed_ns = 0;
+  // time spent in each phase, summed over the crawl threads: listing
+  // directories, reading files, splitting them into lowercased words,
+  // recording the words in the index, and spilling it (crawl_to_file() only)
+  uint64_t walk_ns = 0;
+  uint64_t read_ns = 0;
+  uint64_t tokenize_ns = 0;
+  uint64_t record_ns = 0;
+  uint64_t spill_ns = 0;
+
+  // the kLargestFiles largest files indexed as (size, path), largest first
+  std::vector<std::pair<uint64_t, std::string>> largest;
+
+  // the progress of the crawl about every CrawlOptions::progress_interval,
+  // and when it finished: how throughput and the vocabulary grew over time
+  std::vector<CrawlProgress> samples;
+
+  // the stats as a JSON object, for tools to read
+  std::string to_json() const;
+};
+
+// Tuning knobs for crawl_filetree()
+struct CrawlOptions {
+  // Number of threads that read and index files.  With more than one, the
+  // directory walk hands batches of files to a ThreadPool whose workers each
+  // fill their own WordIndex, and those are merged once the crawl is done.
+  size_t num_threads = 1;
+
+  // If not null, crawl_filetree() fills it in with the stamp of every file it
+  // indexes, for a later update_filetree().  Files the policy skips are in
+  // it too, so an update doesn't look at them again until they change.
+  Manifest* manifest = nullptr;
+
+  // which files to index
+  FilePolicy policy;
+
+  // if not null, crawl_filetree() and update_filetree() add what they did
+  // with each file they read to it
+  CrawlStats* stats = nullptr;
+
+  // Bytes of memory (as estimated by WordIndex::memory_usage()) that
+  // crawl_to_file() lets the indexes it fills grow to, split evenly between
+  // the crawl threads
+  size_t memory_budget = 0;
+
+  // If set, called with the progress of the crawl about every
+  // progress_interval, from a thread of its own, while crawl_filetree(),
+  // crawl_to_file() or update_filetree() run.  The same samples end up in
+  // stats->samples.
+  std::function<void(const CrawlProgress&)> on_progress;
+  std::chrono::milliseconds progress_interval{1000};
+};
+
+// Same as above, but crawls as configured by opts.
+std::optional<WordIndex> crawl_filetree(const std::string& root_dir,
+                                        const CrawlOptions& opts);
+
+// Crawls root_dir like crawl_filetree(), but writes the index straight to an
+// index file instead of returning it, holding at most opts.memory_budget
+// bytes of it in memory.  Whenever a crawl thread's index reaches its share
+// of the budget it is spilled to disk as a sorted run next to index_file, and
+// once the crawl is done the runs are merged into index_file (see
+// IndexRuns.hpp).  The file is the same as freezing and writing the index
+// crawl_filetree() returns.
+//
+// Arguments:
+// - root_dir: the directory to crawl
+// - index_file: where to write the index, replacing it atomically
+// - opts: how to crawl; a memory_budget of 0 spills after every file
+//
+// Returns: false if the directory could not be scanned or on any I/O error
+bool crawl_to_file(const std::string& root_dir,
+                   const std::string& index_file,
+                   const CrawlOptions& opts);
+
+// What update_filetree() found had changed
+struct CrawlChanges {
+  size_t added = 0;
+  size_t modified = 0;
+  size_t removed = 0;
+  size_t unchanged = 0;
+};
+
+// Brings an index up to date with the files under root_dir, only reading the
+// files that changed since the crawl recorded in manifest.
+//
+// Files that are new or whose stamp differs from the manifest are indexed
+// (again), and files that are in the manifest but no longer exist are removed
+// from the index.
+//
+// Arguments:
+// - root_dir: the directory that was crawled to build index
+// - index: the index to update
+// - manifest: the stamps of the files in index, updated to the new state
+// - opts: how to crawl; opts.manifest is not used
+//
+// Returns:
+// - what changed, or nullopt if the directory could not be scanned, in which
+//   case index and manifest are left untouched.
+std::optional<CrawlChanges> update_filetree(const std::string& root_dir,
+                                            WordIndex* index,
+                                            Manifest* manifest,
+                                            const CrawlOptions& opts);
+
+// Same as update_filetree(), but only looks at the given paths instead of
+// walking the whole crawl root.  Used to apply the changes a file watcher
+// reports.
+//
+// Arguments:
+// - paths: files and directories under the crawled root, as paths that start
+//   with the root_dir the index was crawled from.  A directory is walked, and
+//   a path that no longer exists removes every file at or under it.
+// - index, manifest, opts: as for update_filetree()
+//
+// Returns: what changed.  Files outside of paths count as neither changed nor
+// unchanged.
+CrawlChanges update_paths(const std::vector<std::string>& paths,
+                          WordIndex* index,
+                          Manifest* manifest,
+                          const CrawlOptions& opts);
+
+// Reads a manifest written by write_manifest().
+//
+// Returns: the manifest, or nullopt if path can't be read or is not a
+// manifest of a crawl of root_dir with the same policy.
+std::optional<Manifest> read_manifest(const std::string& path,
+                                      const std::string& root_dir,
+                                      const FilePolicy& policy);
+
+// Writes the manifest of a crawl of root_dir with the given policy to path,
+// replacing it atomically.
+//
+// Returns: false on any I/O error.
+bool write_manifest(const std::string& path,
+                    const std::string& root_dir,
+                    const FilePolicy& policy,
+                    const Manifest& manifest);
+
 }  // namespace searchserver
 
 #endif  // CRAWLFILETREE_HPP_
@@ -0,0 +1,297 @@
+#include "./EventLoop.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <utility>
+
+namespace searchserver {
+
+// Most events handled per epoll_wait()
+static constexpr int kMaxEvents = 256;
+
+// How long accepting pauses when the process runs out of file descriptors,
+// unless a connection closes first
+static constexpr std::chrono::milliseconds kAcceptBackoff{100};
+
+struct EventLoop::Connection {
+  explicit Connection(HttpSocket socket) : sock(std::move(socket)) {}
+
+  HttpSocket sock;
+  // the request in the pool, parsed in place; reused for every request
+  HttpRequest request;
+  // its response, filled in by the worker that handles it
+  Response response;
+  // when the request was handed to the pool
+  std::chrono::steady_clock::time_point queued_at;
+  // a request of this connection is in the pool; the connection stays open
+  // (so its fd isn't reused) until the job comes back
+  bool busy = false;
+  // close once the queued responses are written
+  bool closing = false;
+  // the client won't send anything more: close once the requests it did send
+  // are answered
+  bool eof = false;
+  // the connection failed: close as soon as no job refers to it
+  bool failed = false;
+  // reading stopped with the request buffer full: read on once the requests
+  // in it have been answered
+  bool full = false;
+};
+
+EventLoop::EventLoop(ServerSocket* server,
+                     ThreadPool* pool,
+                     Handler handler,
+                     Admission admission)
+    : server_(server),
+      pool_(pool),
+      handler_(std::move(handler)),
+      admission_(std::move(admission)) {}
+
+EventLoop::Response EventLoop::overloaded(const HttpRequest& request) {
+  Response response;
+  response.add_constant(HttpResponse::kUnavailable);
+  response.set_close(request.wants_close());
+  return response;
+}
+
+EventLoop::~EventLoop() {
+  connections_.clear();
+  if (epoll_fd_ != -1)
+    close(epoll_fd_);
+  if (wake_fd_ != -1)
+    close(wake_fd_);
+}
+
+bool EventLoop::run() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ == -1 || wake_fd_ == -1 || !server_->set_nonblocking()) {
+    return false;
+  }
+
+  // The listening socket is level triggered: a client left waiting is
+  // reported again by the next epoll_wait(), unless accepting is paused.
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = server_->fd();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_->fd(), &ev) != 0) {
+    return false;
+  }
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = wake_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) != 0) {
+    return false;
+  }
+
+  std::array<epoll_event, kMaxEvents> events{};
+  while (true) {
+    int timeout = -1;
+    if (!accepting_) {
+      auto left = std::chrono::ceil<std::chrono::milliseconds>(
+          accept_paused_at_ + kAcceptBackoff -
+          std::chrono::steady_clock::now());
+      timeout = static_cast<int>(std::max<int64_t>(left.count(), 0));
+    }
+    int n = epoll_wait(epoll_fd_, events.data(), kMaxEvents, timeout);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == server_->fd()) {
+        accept_clients();
+      } else if (fd == wake_fd_) {
+        finish_jobs();
+      } else {
+        auto it = connections_.find(fd);
+        if (it != connections_.end()) {
+          handle_events(it->second.get(), events[i].events);
+        }
+      }
+    }
+    if (!accepting_ && std::chrono::steady_clock::now() >=
+                           accept_paused_at_ + kAcceptBackoff) {
+      watch_listener(true);
+    }
+  }
+}
+
+void EventLoop::run_job(Connection* conn) {
+  auto waited = std::chrono::steady_clock::now() - conn->queued_at;
+  if (admission_.deadline.count() > 0 && waited > admission_.deadline) {
+    // the client has waited long enough; don't make it wait for the work too
+    conn->response = overloaded(conn->request);
+  } else {
+    conn->response = handler_(conn->request);
+  }
+  // the file goes out from memory, as one more piece of the response
+  conn->response.inline_file();
+  {
+    std::lock_guard<std::mutex> guard(done_lock_);
+    done_.push_back(conn);
+  }
+  uint64_t one = 1;
+  while (write(wake_fd_, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+}
+
+void EventLoop::accept_clients() {
+  while (true) {
+    auto client = server_->accept_client(true);
+    if (!client) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // no one else is waiting
+        return;
+      }
+      if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) {
+        // that client gave up; the next may be waiting still
+        continue;
+      }
+      // Out of file descriptors (or memory).  The client stays queued, and
+      // the level-triggered listener would report it again right away, so
+      // stop watching it until a connection closes, or for kAcceptBackoff.
+      watch_listener(false);
+      return;
+    }
+
+    // Edge triggered: the connection is only reported again once something
+    // new happens, so every event is handled until read() or write() would
+    // block.  Writability is watched from the start, so there's never an
+    // epoll_ctl() per response.
+    int fd = client->fd();
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+      continue;
+    connections_[fd] = std::make_unique<Connection>(std::move(*client));
+  }
+}
+
+void EventLoop::watch_listener(bool accepting) {
+  epoll_event ev{};
+  ev.events = accepting ? EPOLLIN : 0;
+  ev.data.fd = server_->fd();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, server_->fd(), &ev) != 0) {
+    return;
+  }
+  accepting_ = accepting;
+  if (!accepting) {
+    accept_paused_at_ = std::chrono::steady_clock::now();
+  }
+}
+
+void EventLoop::handle_events(Connection* conn, unsigned events) {
+  if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0) {
+    read_input(conn);
+  }
+  advance(conn);
+}
+
+void EventLoop::read_input(Connection* conn) {
+  conn->full = false;
+  switch (conn->sock.read_available()) {
+    case HttpSocket::ReadStatus::kAgain:
+      break;
+    case HttpSocket::ReadStatus::kEof:
+      conn->eof = true;
+      break;
+    case HttpSocket::ReadStatus::kFull:
+      // the rest stays in the socket, where no new edge will report it
+      conn->full = true;
+      break;
+    case HttpSocket::ReadStatus::kError:
+      conn->failed = true;
+      break;
+  }
+}
+
+void EventLoop::finish_jobs() {
+  // reset the eventfd before looking at the jobs, so that a job posted after
+  // this read wakes the loop up again
+  uint64_t count = 0;
+  while (read(wake_fd_, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+  std::vector<Connection*> done;
+  {
+    std::lock_guard<std::mutex> guard(done_lock_);
+    done.swap(done_);
+  }
+
+  // a busy connection is never closed, so each of these is still open
+  for (Connection* conn : done) {
+    conn->busy = false;
+    conn->closing = conn->response.close();
+    conn->sock.queue_response(std::move(conn->response));
+    advance(conn);
+  }
+}
+
+bool EventLoop::dispatch_request(Connection* conn) {
+  auto priority = admission_.priority ? admission_.priority(conn->request)
+                                      : ThreadPool::Priority::kNormal;
+  // the request and its response stay in the connection, untouched by the
+  // loop until the job is back, so the task is two pointers and nothing is
+  // allocated for it
+  conn->queued_at = std::chrono::steady_clock::now();
+  if (pool_->try_dispatch([this, conn] { run_job(conn); }, priority)) {
+    conn->busy = true;
+    return true;
+  }
+  Response response = overloaded(conn->request);
+  conn->closing = response.close();
+  conn->sock.queue_response(std::move(response));
+  return false;
+}
+
+void EventLoop::advance(Connection* conn) {
+  if (conn->busy) {
+    return;
+  }
+  // a request turned away gets its answer, and the loop moves on to the next
+  while (true) {
+    if (!conn->failed && conn->sock.has_output() && !conn->sock.flush()) {
+      conn->failed = true;
+    }
+    if (!conn->failed && conn->sock.has_output()) {
+      // the rest goes out on the next EPOLLOUT
+      return;
+    }
+    if (conn->failed || conn->closing) {
+      break;
+    }
+    auto status = conn->sock.buffered_request(&conn->request);
+    if (status == HttpRequestParser::Status::kComplete) {
+      if (dispatch_request(conn)) {
+        return;
+      }
+      continue;
+    }
+    if (status == HttpRequestParser::Status::kIncomplete && conn->full) {
+      // the buffered requests are answered: read what was left unread
+      read_input(conn);
+      continue;
+    }
+    if (status == HttpRequestParser::Status::kIncomplete && !conn->eof) {
+      // wait for the rest of the next request
+      return;
+    }
+    // the client is done, or sent something that isn't a request
+    break;
+  }
+  // closing the socket also takes it out of the epoll set
+  connections_.erase(conn->sock.fd());
+  if (!accepting_) {
+    // that freed a file descriptor for the next client
+    watch_listener(true);
+  }
+}
+
+}  // namespace searchserver
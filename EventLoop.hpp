@@ -0,0 +1,133 @@
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./HttpRequest.hpp"
+#include "./HttpResponse.hpp"
+#include "./HttpSocket.hpp"
+#include "./ServerSocket.hpp"
+#include "./ThreadPool.hpp"
+
+namespace searchserver {
+
+// How an event loop admits requests to its ThreadPool.  A request the pool
+// has no room for (see ThreadPool::try_dispatch()), or one that waited in it
+// past the deadline, is answered with 503 Service Unavailable right away, so
+// that under overload clients hear back quickly instead of queueing without
+// bound.
+struct Admission {
+  // which lane of the pool a request queues in; all go in the normal lane if
+  // this is unset
+  std::function<ThreadPool::Priority(const HttpRequest& request)> priority;
+  // longest a request may wait for a worker; zero for no limit
+  std::chrono::milliseconds deadline{0};
+};
+
+// Serves HTTP connections from one thread with an edge-triggered epoll loop.
+//
+// The loop owns every socket, all of them non-blocking: the listening socket,
+// which it drains of new clients whenever it is readable, and each client
+// connection, whose bytes it reads as they arrive and parses into requests as
+// soon as a header is complete.  Only a complete request is handed to the
+// ThreadPool, where the handler does the actual work (a query, a file read);
+// the worker posts the response back through an eventfd, and the loop writes
+// it out as fast as the client takes it.  An idle keep-alive connection costs
+// a buffer and an epoll registration rather than a blocked worker, so a few
+// workers serve any number of them.
+//
+// Each connection has at most one request in the pool at a time: pipelined
+// requests wait in its read buffer and are answered in order.
+class EventLoop {
+ public:
+  // A response, and whether to close the connection once it is sent
+  using Response = HttpResponse;
+
+  // Produces the response to one request.  Runs on a pool thread.
+  using Handler = std::function<Response(const HttpRequest& request)>;
+
+  // Arguments:
+  //  - server: the listening socket to accept clients from
+  //  - pool: where requests are handled
+  //  - handler: what handles them
+  //  - admission: when to turn requests away instead
+  EventLoop(ServerSocket* server,
+            ThreadPool* pool,
+            Handler handler,
+            Admission admission = {});
+
+  // Returns: the response that turns request away when the server is
+  // overloaded
+  static Response overloaded(const HttpRequest& request);
+
+  // Closes every connection.  Must not run while requests are in the pool.
+  ~EventLoop();
+
+  // Runs the loop on the calling thread.
+  //
+  // Returns: false if the loop can't be set up or epoll fails
+  bool run();
+
+  // not copyable or movable: pool tasks point back at the loop
+  EventLoop(const EventLoop& other) = delete;
+  EventLoop& operator=(const EventLoop& other) = delete;
+
+ private:
+  // a client connection and where it is in its request / response cycle
+  struct Connection;
+
+  // ThreadPool task: runs the handler on conn's request and posts the
+  // connection back
+  void run_job(Connection* conn);
+
+  // Hands conn's request to the pool.  Returns: false, with an overloaded()
+  // response queued on conn instead, if the pool has no room for it
+  bool dispatch_request(Connection* conn);
+
+  // accepts every waiting client
+  void accept_clients();
+
+  // starts or stops watching the listening socket for clients
+  void watch_listener(bool accepting);
+
+  // handles epoll events on a client connection
+  void handle_events(Connection* conn, unsigned events);
+
+  // reads what conn's client sent into its request buffer
+  void read_input(Connection* conn);
+
+  // queues the responses of finished jobs on their connections
+  void finish_jobs();
+
+  // moves conn along: writes queued output, hands the next buffered request
+  // to the pool once the previous response is out, and closes the connection
+  // when it is done with
+  void advance(Connection* conn);
+
+  ServerSocket* server_;
+  ThreadPool* pool_;
+  Handler handler_;
+  Admission admission_;
+  int epoll_fd_ = -1;
+  // written by workers to wake the loop up when jobs finish
+  int wake_fd_ = -1;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+  // false while accepting is paused for want of file descriptors, and since
+  // when
+  bool accepting_ = true;
+  std::chrono::steady_clock::time_point accept_paused_at_;
+
+  // connections whose jobs finished, handed from the workers to the loop
+  std::mutex done_lock_;
+  std::vector<Connection*> done_;
+};
+
+}  // namespace searchserver
+
+#endif  // EVENT_LOOP_H_
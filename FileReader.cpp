@@ -1,17 +1,126 @@
 #include "FileReader.hpp"
-#include <fstream>
-#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 namespace searchserver {
 
+// Reads up to n bytes from fd into buf, retrying on EINTR.  Returns the
+// number of bytes read (0 at the end of the file), or -1 on error.
+static ssize_t read_some(int fd, char* buf, size_t n) {
+  while (true) {
+    ssize_t got = read(fd, buf, n);
+    if (got >= 0 || errno != EINTR) {
+      return got;
+    }
+  }
+}
+
 std::optional<std::string> read_file(const std::string& path) {
-  std::ifstream ifs(path, std::ios::binary);
-  if (!ifs) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
     return std::nullopt;
   }
-  std::ostringstream oss;
-  oss << ifs.rdbuf();
-  return oss.str();
+
+  // read straight into the string that is returned, sized from fstat(); the
+  // file may still grow or shrink while it is read
+  struct stat st {};
+  std::string contents;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    contents.resize(static_cast<size_t>(st.st_size));
+  }
+  size_t filled = 0;
+  while (true) {
+    if (filled == contents.size()) {
+      contents.resize(std::max<size_t>(4096, contents.size() * 2));
+    }
+    ssize_t got =
+        read_some(fd, contents.data() + filled, contents.size() - filled);
+    if (got < 0) {
+      close(fd);
+      return std::nullopt;
+    }
+    if (got == 0) {
+      break;
+    }
+    filled += static_cast<size_t>(got);
+  }
+  close(fd);
+  contents.resize(filled);
+  return contents;
+}
+
+bool read_at(int fd, char* buf, size_t n, uint64_t offset) {
+  size_t done = 0;
+  while (done < n) {
+    ssize_t got = pread(fd, buf + done, n - done,
+                        static_cast<off_t>(offset + done));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(got);
+  }
+  return true;
+}
+
+ChunkedFileReader::ChunkedFileReader(size_t chunk_size)
+    : chunk_size_(std::max<size_t>(chunk_size, 1)) {}
+
+ChunkedFileReader::~ChunkedFileReader() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool ChunkedFileReader::open(const std::string& path) {
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  // a file smaller than a chunk gets a buffer that holds all of it, plus a
+  // byte so that the read that hits the end doesn't have to grow it
+  struct stat st {};
+  capacity_ = chunk_size_;
+  if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode)) {
+    file_size_ = static_cast<uint64_t>(st.st_size);
+    capacity_ = std::min(capacity_, static_cast<size_t>(st.st_size) + 1);
+  }
+  buffer_.reset(new char[capacity_]);
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  return true;
+}
+
+bool ChunkedFileReader::next(size_t keep) {
+  keep = std::min(keep, size_);
+  if (keep == capacity_) {
+    // there would be no room left to read into
+    keep = 0;
+  }
+  if (fd_ < 0 || error_ || (eof_ && keep == 0)) {
+    return false;
+  }
+  if (keep > 0) {
+    std::memmove(buffer_.get(), buffer_.get() + size_ - keep, keep);
+  }
+
+  ssize_t got = read_some(fd_, buffer_.get() + keep, capacity_ - keep);
+  if (got < 0) {
+    error_ = true;
+    size_ = 0;
+    return false;
+  }
+  eof_ = got == 0;
+  size_ = keep + static_cast<size_t>(got);
+  return size_ > 0;
 }
 
 }  // namespace searchserver
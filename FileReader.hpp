@@ -1,6 +1,9 @@
 #ifndef SEARCHSERVER_FILEREADER_HPP
 #define SEARCHSERVER_FILEREADER_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <optional>
 
@@ -16,6 +19,97 @@ namespace searchserver {
  */
 std::optional<std::string> read_file(const std::string& path);
 
+/**
+ * @brief Reads exactly @p n bytes of an open file, starting at @p offset.
+ *
+ * Uses pread(), so the file offset of @p fd is left alone.
+ *
+ * @return  false on error, or if the file ends before @p n bytes.
+ */
+bool read_at(int fd, char* buf, size_t n, uint64_t offset);
+
+/**
+ * @brief Reads a file front to back through a buffer of bounded size.
+ *
+ * Memory use doesn't depend on the size of the file: each chunk is read into
+ * the same buffer, overwriting the previous one.  A caller that splits chunks
+ * into records can carry an incomplete record at the end of a chunk over to
+ * the next one, see next().
+ */
+class ChunkedFileReader {
+ public:
+  // Default size of the buffer, which is also the most read at once
+  static constexpr size_t kDefaultChunkSize = 1 << 20;
+
+  /**
+   * @param chunk_size  Size of the buffer.  Smaller files get a buffer that
+   *                    fits them instead.
+   */
+  explicit ChunkedFileReader(size_t chunk_size = kDefaultChunkSize);
+
+  ~ChunkedFileReader();
+
+  /**
+   * @brief Opens the file at @p path; false if it can't be opened.
+   */
+  bool open(const std::string& path);
+
+  /**
+   * @brief Reads the next chunk of the file into the buffer.
+   *
+   * The last @p keep bytes of the current chunk are moved to the front of the
+   * buffer first, and the new data is read after them.  The buffer never
+   * grows: a record as big as the whole buffer can't be carried over, and is
+   * dropped instead.
+   *
+   * @param keep  How many bytes at the end of the current chunk to carry over,
+   *              less than capacity().
+   * @return      false once the file is exhausted and nothing was kept, or on
+   *              a read error; error() tells the two apart.
+   */
+  bool next(size_t keep = 0);
+
+  /**
+   * @brief The size of the file when it was opened.
+   */
+  uint64_t file_size() const { return file_size_; }
+
+  /**
+   * @brief The current chunk, which the caller may modify in place.
+   */
+  char* data() { return buffer_.get(); }
+  size_t size() const { return size_; }
+
+  /**
+   * @brief The size of the buffer, the most a chunk can hold.
+   */
+  size_t capacity() const { return capacity_; }
+
+  /**
+   * @brief True if the current chunk ends at the end of the file.
+   */
+  bool at_eof() const { return eof_; }
+
+  /**
+   * @brief True if next() stopped because of a read error.
+   */
+  bool error() const { return error_; }
+
+  // disallow copy, the reader owns a file descriptor
+  ChunkedFileReader(const ChunkedFileReader& other) = delete;
+  ChunkedFileReader& operator=(const ChunkedFileReader& other) = delete;
+
+ private:
+  size_t chunk_size_;
+  int fd_ = -1;
+  uint64_t file_size_ = 0;
+  std::unique_ptr<char[]> buffer_;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  bool eof_ = false;
+  bool error_ = false;
+};
+
 }  // namespace searchserver
 
 #endif  // SEARCHSERVER_FILEREADER_HPP
@@ -0,0 +1,123 @@
+#include "./FileTreeWalk.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace searchserver {
+
+// Size of the buffer directories are read into; each getdents64() call
+// returns as many entries as fit
+static constexpr size_t kDirBufferSize = 64 * 1024;
+
+// State shared by every level of one walk
+struct Walk {
+  const std::function<void(WalkEntry&)>& on_file;
+  // the path of the directory being read
+  std::string path;
+  // getdents64() buffer, only used while listing one directory at a time
+  std::vector<char> buffer;
+  // (st_dev, st_ino) of every directory entered so far
+  std::set<std::pair<dev_t, ino_t>> visited;
+  // directories that couldn't be opened or listed
+  size_t unreadable = 0;
+};
+
+// Returns true if the directory open as fd hasn't been entered yet, and
+// marks it entered
+static bool first_visit(int fd, Walk* walk) {
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  return walk->visited.emplace(st.st_dev, st.st_ino).second;
+}
+
+// Lists the directory open as dir_fd (whose path is walk->path), reporting
+// its files, then walks its subdirectories.  Closes dir_fd.
+static void walk_dir(int dir_fd, Walk* walk) {
+  std::vector<std::string> subdirs;
+  while (true) {
+    ssize_t len = getdents64(dir_fd, walk->buffer.data(), walk->buffer.size());
+    if (len == 0) {
+      break;
+    }
+    if (len < 0) {
+      // what was listed so far is still walked
+      walk->unreadable++;
+      break;
+    }
+    for (ssize_t off = 0; off < len;) {
+      auto* ent = reinterpret_cast<struct dirent64*>(walk->buffer.data() + off);
+      off += ent->d_reclen;
+      const char* name = ent->d_name;
+      if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+        continue;
+      }
+
+      unsigned char type = ent->d_type;
+      if (type == DT_LNK || type == DT_UNKNOWN) {
+        // the type of what the link points to, or one d_type didn't give
+        struct stat st {};
+        if (fstatat(dir_fd, name, &st, 0) != 0) {
+          continue;
+        }
+        type = S_ISREG(st.st_mode) ? DT_REG
+               : S_ISDIR(st.st_mode) ? DT_DIR
+                                     : DT_UNKNOWN;
+      }
+      if (type == DT_DIR) {
+        subdirs.emplace_back(name);
+      } else if (type == DT_REG) {
+        WalkEntry entry{walk->path, dir_fd, name};
+        entry.path += '/';
+        entry.path += name;
+        walk->on_file(entry);
+      }
+    }
+  }
+
+  // subdirectories go after the listing is done, so every level can share
+  // one buffer
+  size_t path_len = walk->path.size();
+  for (auto& name : subdirs) {
+    int fd = openat(dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      walk->unreadable++;
+      continue;
+    }
+    if (!first_visit(fd, walk)) {
+      close(fd);
+      continue;
+    }
+    walk->path += '/';
+    walk->path += name;
+    walk_dir(fd, walk);
+    walk->path.resize(path_len);
+  }
+  close(dir_fd);
+}
+
+bool walk_filetree(const std::string& root_dir,
+                   const std::function<void(WalkEntry&)>& on_file,
+                   size_t* unreadable) {
+  int fd = open(root_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  Walk walk{on_file, root_dir, std::vector<char>(kDirBufferSize)};
+  first_visit(fd, &walk);
+  walk_dir(fd, &walk);
+  if (unreadable != nullptr) {
+    *unreadable += walk.unreadable;
+  }
+  return true;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,48 @@
+#ifndef FILE_TREE_WALK_HPP_
+#define FILE_TREE_WALK_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace searchserver {
+
+// A regular file found by walk_filetree()
+struct WalkEntry {
+  // root_dir, then the names of the directories on the way and of the file,
+  // separated by '/'.  The callback may move it out.
+  std::string path;
+  // the directory the file is in, open while the callback runs, and the name
+  // of the file in it: fstatat(dir_fd, name, ...) looks at the file without
+  // resolving path from the top again
+  int dir_fd;
+  const char* name;
+};
+
+// Walks the directory tree under root_dir, calling on_file for every regular
+// file in it (following symbolic links, like stat() does).  Every directory is
+// entered once, however many links lead to it, so a link back up the tree
+// doesn't send the walk round in circles.
+//
+// Directories are read with getdents64() into a large buffer, many entries
+// per system call, and opened relative to their parent with openat().  An
+// entry's type comes from its d_type, so only symbolic links and entries on
+// file systems that don't fill d_type in have to be stat()ed.  One path
+// buffer is extended and truncated as the walk goes up and down the tree, so
+// the only string built per file is the path handed to on_file.
+//
+// Files are reported in the order the file system lists them, each directory
+// before its subdirectories.  on_file runs on the calling thread; the
+// parallel crawl passes the paths on to its workers from there.
+//
+// A directory under root_dir that can't be opened or listed is skipped, and
+// counted in *unreadable if unreadable isn't null.
+//
+// Returns: false if root_dir itself can't be read
+bool walk_filetree(const std::string& root_dir,
+                   const std::function<void(WalkEntry&)>& on_file,
+                   size_t* unreadable = nullptr);
+
+}  // namespace searchserver
+
+#endif  // FILE_TREE_WALK_HPP_
@@ -0,0 +1,564 @@
+#include "./FrozenWordIndex.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "./WordIndex.hpp"
+
+namespace searchserver {
+
+// Index file format.
+//
+// The file is the in-memory image of a FrozenWordIndex: this header followed
+// by the sections it points to.  All integers are in host byte order
+// (byte_order lets open() reject a file written on a machine of the other
+// endianness), offsets are from the start of the file and every section
+// starts on an 8 byte boundary, so each array can be used in place.
+//
+// Bump kVersion whenever the layout changes.
+struct FrozenWordIndex::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t file_size;
+  uint64_t num_words;
+  uint64_t num_docs;
+  uint64_t num_postings;
+  uint64_t blocks_size;
+  uint64_t word_offsets;     // num_words + 1 uint64_t
+  uint64_t word_arena;       // word_offsets[num_words] chars
+  uint64_t posting_offsets;  // num_words + 1 uint64_t
+  uint64_t list_offsets;     // num_words + 1 uint64_t
+  uint64_t blocks;           // blocks_size + kBlockPadding bytes
+  uint64_t name_offsets;     // num_docs + 1 uint64_t
+  uint64_t name_arena;       // name_offsets[num_docs] chars
+};
+
+static constexpr char kMagic[8] = {'S', 'S', 'I', 'N', 'D', 'E', 'X', '\0'};
+static constexpr uint32_t kVersion = 3;
+static constexpr uint32_t kByteOrder = 0x01020304;
+
+// rounds n up to the next multiple of 8
+static uint64_t align8(uint64_t n) {
+  return (n + 7) & ~uint64_t{7};
+}
+
+// writes size bytes to fd, retrying short writes; returns false on error
+static bool write_all(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t res = ::write(fd, p, size);
+    if (res == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += res;
+    size -= res;
+  }
+  return true;
+}
+
+// fsyncs and closes fd, which was opened on tmp, then renames tmp to path if
+// everything written to it so far succeeded; otherwise removes tmp
+static bool commit_file(int fd,
+                        bool ok,
+                        const string& tmp,
+                        const string& path) {
+  ok = ok && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+FrozenWordIndex::FrozenWordIndex() = default;
+
+FrozenWordIndex::FrozenWordIndex(const WordIndex& index) {
+  // renumber (not removed) documents in name order, new_id[old DocId] = new
+  // DocId
+  vector<DocId> by_name;
+  by_name.reserve(index.num_docs());
+  for (size_t i = 0; i < index.docs_.size(); i++) {
+    if (index.docs_[i].live) {
+      by_name.push_back(static_cast<DocId>(i));
+    }
+  }
+  std::sort(by_name.begin(), by_name.end(), [&](DocId a, DocId b) {
+    return index.docs_[a].name < index.docs_[b].name;
+  });
+  vector<DocId> new_id(index.docs_.size());
+  uint64_t name_bytes = 0;
+  for (size_t i = 0; i < by_name.size(); i++) {
+    new_id[by_name[i]] = static_cast<DocId>(i);
+    name_bytes += index.docs_[by_name[i]].name.size();
+  }
+
+  // sort the vocabulary
+  vector<const std::pair<const string, PostingList>*> words;
+  words.reserve(index.index_.size());
+  uint64_t word_bytes = 0;
+  uint64_t total_postings = 0;
+  for (auto& entry : index.index_) {
+    words.push_back(&entry);
+    word_bytes += entry.first.size();
+    total_postings += entry.second.size();
+  }
+  std::sort(words.begin(), words.end(),
+            [](auto* a, auto* b) { return a->first < b->first; });
+
+  // compress the (renumbered, re-sorted) posting lists first, since their
+  // size is only known once they are encoded
+  vector<uint64_t> list_offsets{0};
+  vector<uint8_t> blocks;
+  list_offsets.reserve(words.size() + 1);
+  vector<std::pair<DocId, uint32_t>> list;
+  vector<DocId> docs;
+  vector<uint32_t> counts;
+  for (auto* entry : words) {
+    PostingView view = entry->second.view();
+    list.clear();
+    for (size_t i = 0; i < view.size; i++) {
+      list.emplace_back(new_id[view.docs[i]], view.counts[i]);
+    }
+    std::sort(list.begin(), list.end());
+    docs.clear();
+    counts.clear();
+    for (auto& [doc, count] : list) {
+      docs.push_back(doc);
+      counts.push_back(count);
+    }
+
+    encode_list(docs.data(), counts.data(), docs.size(), &blocks);
+    list_offsets.push_back(blocks.size());
+  }
+
+  // lay the sections out one after the other
+  Header h{};
+  h.num_words = words.size();
+  h.num_docs = by_name.size();
+  h.num_postings = total_postings;
+  h.blocks_size = blocks.size();
+  lay_out(&h, word_bytes, name_bytes);
+
+  // and fill them in, directly in the final image (which starts zeroed, so
+  // the block padding is already in place)
+  auto image = std::make_shared<uint64_t[]>(h.file_size / sizeof(uint64_t));
+  char* base = reinterpret_cast<char*>(image.get());
+  std::memcpy(base, &h, sizeof(h));
+
+  auto* name_offsets = reinterpret_cast<uint64_t*>(base + h.name_offsets);
+  char* name_arena = base + h.name_arena;
+  name_offsets[0] = 0;
+  for (size_t i = 0; i < by_name.size(); i++) {
+    const string& name = index.docs_[by_name[i]].name;
+    std::memcpy(name_arena + name_offsets[i], name.data(), name.size());
+    name_offsets[i + 1] = name_offsets[i] + name.size();
+  }
+
+  auto* word_offsets = reinterpret_cast<uint64_t*>(base + h.word_offsets);
+  char* word_arena = base + h.word_arena;
+  auto* posting_offsets = reinterpret_cast<uint64_t*>(base + h.posting_offsets);
+  word_offsets[0] = 0;
+  posting_offsets[0] = 0;
+  for (size_t w = 0; w < words.size(); w++) {
+    const string& word = words[w]->first;
+    std::memcpy(word_arena + word_offsets[w], word.data(), word.size());
+    word_offsets[w + 1] = word_offsets[w] + word.size();
+    posting_offsets[w + 1] = posting_offsets[w] + words[w]->second.size();
+  }
+
+  std::memcpy(base + h.list_offsets, list_offsets.data(),
+              list_offsets.size() * sizeof(uint64_t));
+  std::memcpy(base + h.blocks, blocks.data(), blocks.size());
+
+  attach(std::move(image), h.file_size);
+}
+
+std::optional<FrozenWordIndex> FrozenWordIndex::open(const string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return std::nullopt;
+  }
+  size_t size = st.st_size;
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive on its own
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return std::nullopt;
+  }
+  // lookups jump around the file, readahead would only page in unused data
+  madvise(addr, size, MADV_RANDOM);
+
+  std::shared_ptr<const void> storage(addr, [size](const void* p) {
+    munmap(const_cast<void*>(p), size);
+  });
+  FrozenWordIndex index;
+  if (!index.attach(std::move(storage), size)) {
+    return std::nullopt;
+  }
+  return index;
+}
+
+bool FrozenWordIndex::write(const string& path) const {
+  if (!storage_) {
+    // default constructed: write a real (empty) image instead
+    return FrozenWordIndex(WordIndex()).write(path);
+  }
+
+  string tmp = path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  return commit_file(fd, write_all(fd, storage_.get(), size_), tmp, path);
+}
+
+WordIndex FrozenWordIndex::thaw() const {
+  WordIndex index;
+  for (size_t d = 0; d < num_docs_; d++) {
+    index.add_document(string(doc_name(static_cast<DocId>(d))));
+  }
+
+  vector<DocId> docs;
+  vector<uint32_t> counts;
+  for (size_t w = 0; w < num_words_; w++) {
+    auto list = view_at(w);
+    if (!list)
+      continue;
+    if (!list->decode(&docs, &counts))
+      continue;
+    PostingList& postings = index.index_[string(word_at(w))];
+    for (size_t i = 0; i < docs.size(); i++) {
+      if (docs[i] >= num_docs_)
+        continue;
+      postings.add(docs[i], counts[i]);
+      // every occurance of every word is a posting, so this adds back up to
+      // the document's word count
+      index.docs_[docs[i]].num_words += counts[i];
+    }
+  }
+  return index;
+}
+
+void FrozenWordIndex::lay_out(Header* h,
+                              uint64_t word_bytes,
+                              uint64_t name_bytes) {
+  std::memcpy(h->magic, kMagic, sizeof(kMagic));
+  h->version = kVersion;
+  h->byte_order = kByteOrder;
+  uint64_t cursor = align8(sizeof(Header));
+  auto section = [&cursor](uint64_t bytes) {
+    uint64_t start = cursor;
+    cursor = align8(cursor + bytes);
+    return start;
+  };
+  h->word_offsets = section((h->num_words + 1) * sizeof(uint64_t));
+  h->word_arena = section(word_bytes);
+  h->posting_offsets = section((h->num_words + 1) * sizeof(uint64_t));
+  h->list_offsets = section((h->num_words + 1) * sizeof(uint64_t));
+  h->blocks = section(h->blocks_size + kBlockPadding);
+  h->name_offsets = section((h->num_docs + 1) * sizeof(uint64_t));
+  h->name_arena = section(name_bytes);
+  h->file_size = cursor;
+}
+
+bool FrozenWordIndex::attach(std::shared_ptr<const void> storage, size_t size) {
+  const char* base = static_cast<const char*>(storage.get());
+  Header h{};
+  if (size < sizeof(h)) {
+    return false;
+  }
+  std::memcpy(&h, base, sizeof(h));
+  if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 ||
+      h.version != kVersion || h.byte_order != kByteOrder ||
+      h.file_size != size) {
+    return false;
+  }
+
+  // every section has to be aligned and lie inside the image.  The contents
+  // of the offset arrays are only checked when they are used, so that opening
+  // an index does not read the whole file.
+  auto fits = [size](uint64_t start, uint64_t count, uint64_t elem_size) {
+    return start % 8 == 0 && start <= size &&
+           count <= (size - start) / elem_size;
+  };
+  if (h.num_words == UINT64_MAX || h.num_docs == UINT64_MAX ||
+      !fits(h.word_offsets, h.num_words + 1, sizeof(uint64_t)) ||
+      !fits(h.posting_offsets, h.num_words + 1, sizeof(uint64_t)) ||
+      !fits(h.list_offsets, h.num_words + 1, sizeof(uint64_t)) ||
+      h.blocks_size > UINT64_MAX - kBlockPadding ||
+      !fits(h.blocks, h.blocks_size + kBlockPadding, 1) ||
+      !fits(h.name_offsets, h.num_docs + 1, sizeof(uint64_t))) {
+    return false;
+  }
+  word_offsets_ = reinterpret_cast<const uint64_t*>(base + h.word_offsets);
+  name_offsets_ = reinterpret_cast<const uint64_t*>(base + h.name_offsets);
+  word_arena_size_ = word_offsets_[h.num_words];
+  name_arena_size_ = name_offsets_[h.num_docs];
+  if (!fits(h.word_arena, word_arena_size_, 1) ||
+      !fits(h.name_arena, name_arena_size_, 1)) {
+    return false;
+  }
+
+  word_arena_ = base + h.word_arena;
+  posting_offsets_ =
+      reinterpret_cast<const uint64_t*>(base + h.posting_offsets);
+  list_offsets_ = reinterpret_cast<const uint64_t*>(base + h.list_offsets);
+  blocks_ = reinterpret_cast<const uint8_t*>(base + h.blocks);
+  name_arena_ = base + h.name_arena;
+  num_words_ = h.num_words;
+  num_docs_ = h.num_docs;
+  num_postings_ = h.num_postings;
+  blocks_size_ = h.blocks_size;
+  size_ = size;
+  storage_ = std::move(storage);
+  return true;
+}
+
+size_t FrozenWordIndex::num_words() const {
+  return num_words_;
+}
+
+size_t FrozenWordIndex::num_docs() const {
+  return num_docs_;
+}
+
+size_t FrozenWordIndex::num_postings() const {
+  return num_postings_;
+}
+
+size_t FrozenWordIndex::posting_bytes() const {
+  return blocks_size_;
+}
+
+std::string_view FrozenWordIndex::doc_name(DocId doc) const {
+  if (doc >= num_docs_) {
+    return {};
+  }
+  uint64_t first = name_offsets_[doc];
+  uint64_t last = name_offsets_[doc + 1];
+  if (first > last || last > name_arena_size_) {
+    return {};
+  }
+  return {name_arena_ + first, last - first};
+}
+
+std::string_view FrozenWordIndex::word_at(size_t i) const {
+  uint64_t first = word_offsets_[i];
+  uint64_t last = word_offsets_[i + 1];
+  if (first > last || last > word_arena_size_) {
+    return {};
+  }
+  return {word_arena_ + first, last - first};
+}
+
+std::optional<CompressedPostingView> FrozenWordIndex::find(
+    std::string_view word) const {
+  // binary search over the sorted vocabulary
+  size_t lo = 0;
+  size_t hi = num_words_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (word_at(mid) < word) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == num_words_ || word_at(lo) != word) {
+    return std::nullopt;
+  }
+  return view_at(lo);
+}
+
+std::optional<CompressedPostingView> FrozenWordIndex::view_at(
+    size_t w) const {
+  // the word's entry must describe a range of the block section; each block
+  // is checked against that range before it is decoded (see
+  // CompressedPostingView::block_fits()), so that a lookup still only reads
+  // the blocks it needs
+  uint64_t size = posting_offsets_[w + 1] - posting_offsets_[w];
+  uint64_t first = list_offsets_[w];
+  uint64_t last = list_offsets_[w + 1];
+  if (first > last || last > blocks_size_ || size > num_postings_) {
+    return std::nullopt;
+  }
+  return view_list(blocks_ + first, last - first, size);
+}
+
+vector<Result> FrozenWordIndex::make_results(vector<Hit> hits,
+                                             size_t k,
+                                             size_t offset) const {
+  // order by descending count, then ascending doc name.  DocIds are in name
+  // order, so the tie break never has to look at the names.
+  select_window(&hits, offset, k, [](auto& a, auto& b) {
+    if (a.rank != b.rank)
+      return a.rank > b.rank;
+    return a.doc < b.doc;
+  });
+
+  vector<Result> results;
+  results.reserve(hits.size());
+  for (auto& hit : hits) {
+    results.emplace_back(string(doc_name(hit.doc)), hit.rank);
+  }
+  return results;
+}
+
+vector<Result> FrozenWordIndex::lookup_word(const string& word,
+                                            size_t k,
+                                            size_t offset) const {
+  auto list = find(word);
+  if (!list)
+    return {};
+
+  return make_results(intersect_compressed({*list}), k, offset);
+}
+
+vector<Result> FrozenWordIndex::lookup_query(const vector<string>& query,
+                                             size_t k,
+                                             size_t offset) const {
+  if (query.empty())
+    return {};
+
+  vector<CompressedPostingView> lists;
+  lists.reserve(query.size());
+  for (auto& word : query) {
+    auto list = find(word);
+    if (!list)
+      return {};
+    lists.push_back(*list);
+  }
+
+  return make_results(intersect_compressed(std::move(lists)), k, offset);
+}
+
+FrozenWordIndex::Writer::Writer(const string& path) : path_(path) {
+  for (int s = 0; s < kNumSections; s++) {
+    sections_[s].open(scratch_file(s), std::ios::binary | std::ios::trunc);
+  }
+  // the offset arrays start with the offset of the first entry
+  uint64_t zero = 0;
+  append(kWordOffsets, &zero, sizeof(zero));
+  append(kPostingOffsets, &zero, sizeof(zero));
+  append(kListOffsets, &zero, sizeof(zero));
+  append(kNameOffsets, &zero, sizeof(zero));
+}
+
+FrozenWordIndex::Writer::~Writer() {
+  for (int s = 0; s < kNumSections; s++) {
+    sections_[s].close();
+    unlink(scratch_file(s).c_str());
+  }
+}
+
+void FrozenWordIndex::Writer::add_document(std::string_view name) {
+  append(kNameArena, name.data(), name.size());
+  name_bytes_ += name.size();
+  num_docs_++;
+  append(kNameOffsets, &name_bytes_, sizeof(name_bytes_));
+}
+
+void FrozenWordIndex::Writer::add_word(std::string_view word,
+                                       const DocId* docs,
+                                       const uint32_t* counts,
+                                       size_t n) {
+  append(kWordArena, word.data(), word.size());
+  word_bytes_ += word.size();
+  num_words_++;
+  append(kWordOffsets, &word_bytes_, sizeof(word_bytes_));
+
+  blocks_.clear();
+  encode_list(docs, counts, n, &blocks_);
+  append(kBlocks, blocks_.data(), blocks_.size());
+  blocks_size_ += blocks_.size();
+  num_postings_ += n;
+  append(kPostingOffsets, &num_postings_, sizeof(num_postings_));
+  append(kListOffsets, &blocks_size_, sizeof(blocks_size_));
+}
+
+bool FrozenWordIndex::Writer::finish() {
+  Header h{};
+  h.num_words = num_words_;
+  h.num_docs = num_docs_;
+  h.num_postings = num_postings_;
+  h.blocks_size = blocks_size_;
+  lay_out(&h, word_bytes_, name_bytes_);
+  const uint64_t starts[kNumSections] = {
+      h.word_offsets, h.word_arena, h.posting_offsets, h.list_offsets,
+      h.blocks, h.name_offsets, h.name_arena};
+
+  for (auto& section : sections_) {
+    section.close();
+    if (section.fail())
+      return false;
+  }
+
+  string tmp = path_ + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  // copy each section into place, zero filling the gaps between them
+  vector<char> buf(1 << 20);
+  uint64_t cursor = 0;
+  auto pad_to = [&](uint64_t offset) {
+    std::fill(buf.begin(), buf.end(), 0);
+    while (cursor < offset) {
+      size_t n = std::min<uint64_t>(buf.size(), offset - cursor);
+      if (!write_all(fd, buf.data(), n))
+        return false;
+      cursor += n;
+    }
+    return true;
+  };
+  bool ok = write_all(fd, &h, sizeof(h));
+  cursor = sizeof(h);
+  for (int s = 0; s < kNumSections && ok; s++) {
+    ok = pad_to(starts[s]) && cursor == starts[s];
+    int in = ::open(scratch_file(s).c_str(), O_RDONLY | O_CLOEXEC);
+    ok = ok && in >= 0;
+    while (ok) {
+      ssize_t res = ::read(in, buf.data(), buf.size());
+      if (res == -1 && errno == EINTR)
+        continue;
+      if (res <= 0) {
+        ok = res == 0;
+        break;
+      }
+      ok = write_all(fd, buf.data(), res);
+      cursor += res;
+    }
+    if (in >= 0)
+      close(in);
+  }
+  ok = ok && pad_to(h.file_size) && cursor == h.file_size;
+  return commit_file(fd, ok, tmp, path_);
+}
+
+void FrozenWordIndex::Writer::append(Section section,
+                                     const void* data,
+                                     size_t size) {
+  sections_[section].write(static_cast<const char*>(data), size);
+}
+
+string FrozenWordIndex::Writer::scratch_file(int section) const {
+  return path_ + ".s" + std::to_string(section);
+}
+
+}  // namespace searchserver
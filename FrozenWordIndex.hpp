@@ -0,0 +1,258 @@
+#ifndef FROZEN_WORD_INDEX_H_
+#define FROZEN_WORD_INDEX_H_
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./PostingCodec.hpp"
+#include "./PostingList.hpp"
+#include "./Result.hpp"
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+class WordIndex;
+
+// A FrozenWordIndex is a read-only copy of a WordIndex laid out for lookups.
+//
+// Once a crawl has finished the index never changes, so instead of a hash map
+// of separately allocated posting lists everything is packed into a handful of
+// flat arrays:
+//  - the vocabulary is sorted and concatenated into one string arena, and is
+//    searched with a binary search
+//  - the posting lists of every word are stored back to back in one array
+//    (CSR style: word i owns postings [offsets[i], offsets[i + 1])), block
+//    compressed as described in PostingCodec.hpp, each list with its own
+//    skip table if it needs one
+//  - documents are renumbered in name order, so ties in rank can be broken by
+//    comparing DocIds instead of document names
+//
+// All of those arrays live in a single contiguous image which is also the
+// on-disk index file format, so an index can be written once with write() and
+// later served straight out of a read-only mmap() of the file with open():
+// nothing is parsed or copied, and only the pages a lookup touches are ever
+// read from disk.
+class FrozenWordIndex {
+ public:
+  // Constructs an empty index that contains no words or documents
+  FrozenWordIndex();
+
+  // Constructs a frozen copy of index
+  explicit FrozenWordIndex(const WordIndex& index);
+
+  // default destructor
+  ~FrozenWordIndex() = default;
+
+  // Maps an index file previously written by write() into memory.
+  //
+  // Arguments:
+  //  - path: the index file to open
+  //
+  // Returns:
+  //  - the index, or nullopt if the file can't be mapped or isn't an index
+  //    file of the current format version
+  static std::optional<FrozenWordIndex> open(const string& path);
+
+  // Writes the index to a file that can later be passed to open().  The file
+  // is written next to path and renamed into place, so a server that has the
+  // old file mapped keeps a consistent view of it.
+  //
+  // Returns: true on success, false on any I/O error
+  bool write(const string& path) const;
+
+  // Returns the number of unique words in the index
+  size_t num_words() const;
+
+  // Returns the number of documents in the index
+  size_t num_docs() const;
+
+  // Returns a mutable copy of the index, e.g. to update it and freeze it
+  // again.  DocIds of the copy are those of this index.
+  WordIndex thaw() const;
+
+  // Writes an index file without building its image in memory first, see
+  // below
+  class Writer;
+
+  // Returns the total number of postings (word, document pairs) in the index
+  size_t num_postings() const;
+
+  // Returns the number of bytes the compressed postings and their skip tables
+  // take up, to compare against the 8 bytes per posting of a plain DocId and
+  // count array
+  size_t posting_bytes() const;
+
+  // Returns the name of a document
+  std::string_view doc_name(DocId doc) const;
+
+  // Lookup a word in the index.  Behaves the same as WordIndex::lookup_word().
+  //
+  // Arguments:
+  //  - word: a word we are looking up results for
+  //  - k: the maximum number of results to return
+  //  - offset: how many of the best ranked results to skip
+  //
+  // Returns:
+  //  - A list of results. Each result contains a document name and the number
+  //    of recorded occurances of the specified word in that document.
+  vector<Result> lookup_word(const string& word,
+                             size_t k = SIZE_MAX,
+                             size_t offset = 0) const;
+
+  // Lookup a query (multiple words) in the index.  Behaves the same as
+  // WordIndex::lookup_query().
+  //
+  // Arguments:
+  //  - query: the words we are looking up results for
+  //  - k: the maximum number of results to return
+  //  - offset: how many of the best ranked results to skip
+  //
+  // Returns:
+  //  - A list of results. Each result contains a document name and the sum of
+  //    the number of recorded occurances of each query word in that document.
+  vector<Result> lookup_query(const vector<string>& query,
+                              size_t k = SIZE_MAX,
+                              size_t offset = 0) const;
+
+  // default move and copy; copies share the (immutable) image
+  FrozenWordIndex(const FrozenWordIndex& other) = default;
+  FrozenWordIndex& operator=(const FrozenWordIndex& other) = default;
+  FrozenWordIndex(FrozenWordIndex&& other) = default;
+  FrozenWordIndex& operator=(FrozenWordIndex&& other) = default;
+
+ private:
+  // layout of the start of an image, defined in FrozenWordIndex.cpp
+  struct Header;
+
+  // fills in the rest of a header whose counts are set: places each section
+  // after the previous one, given the total size of the words and names
+  static void lay_out(Header* h, uint64_t word_bytes, uint64_t name_bytes);
+
+  // takes ownership of an image of size bytes kept alive by storage, checks
+  // that it is well formed, and points the section pointers into it
+  //
+  // Returns: false if the image is not a valid index
+  bool attach(std::shared_ptr<const void> storage, size_t size);
+
+  // binary searches the vocabulary for word
+  std::optional<CompressedPostingView> find(std::string_view word) const;
+
+  // returns the postings of word number w of the sorted vocabulary, or nullopt
+  // if its entry is malformed
+  std::optional<CompressedPostingView> view_at(size_t w) const;
+
+  // returns word number i of the sorted vocabulary
+  std::string_view word_at(size_t i) const;
+
+  // selects the requested window of hits and converts it into Results
+  vector<Result> make_results(vector<Hit> hits, size_t k, size_t offset) const;
+
+  // keeps the image alive: either a heap buffer built by the constructor or a
+  // read-only mapping of an index file
+  std::shared_ptr<const void> storage_;
+  size_t size_ = 0;
+  size_t num_words_ = 0;
+  size_t num_docs_ = 0;
+  size_t num_postings_ = 0;
+
+  // sorted vocabulary: word i is word_arena_[word_offsets_[i],
+  // word_offsets_[i + 1])
+  const char* word_arena_ = nullptr;
+  const uint64_t* word_offsets_ = nullptr;
+  uint64_t word_arena_size_ = 0;
+
+  // word i has posting_offsets_[i + 1] - posting_offsets_[i] postings,
+  // encoded by encode_list() in bytes [list_offsets_[i], list_offsets_[i + 1])
+  // of blocks_
+  const uint64_t* posting_offsets_ = nullptr;
+  const uint64_t* list_offsets_ = nullptr;
+  const uint8_t* blocks_ = nullptr;
+  size_t blocks_size_ = 0;
+
+  // document names in DocId (and name) order, laid out like the vocabulary
+  const char* name_arena_ = nullptr;
+  const uint64_t* name_offsets_ = nullptr;
+  uint64_t name_arena_size_ = 0;
+};
+
+// Writes an index file in the format of FrozenWordIndex::write() one word at
+// a time, for indexes that are too big to hold in memory (see IndexRuns.hpp).
+// Each section is streamed to a scratch file next to the index file, and
+// finish() lays them out once their sizes are known.  The file is the same,
+// byte for byte, as freezing and writing a WordIndex with the same contents.
+class FrozenWordIndex::Writer {
+ public:
+  // Starts an index file at path; scratch files are named path + ".s<n>"
+  explicit Writer(const string& path);
+
+  // Removes the scratch files
+  ~Writer();
+
+  // Adds the next document.  Documents must be added in name order, and get
+  // DocIds in the order they are added.
+  void add_document(std::string_view name);
+
+  // Adds the next word of the vocabulary, which must sort after every word
+  // added before it.
+  //
+  // Arguments:
+  //  - word: the word
+  //  - docs, counts: its n postings, sorted by DocId
+  void add_word(std::string_view word,
+                const DocId* docs,
+                const uint32_t* counts,
+                size_t n);
+
+  // Writes the index file next to path and renames it into place, like
+  // FrozenWordIndex::write().
+  //
+  // Returns: true on success, false on any I/O error
+  bool finish();
+
+  // not copyable or movable: the scratch files belong to this writer
+  Writer(const Writer& other) = delete;
+  Writer& operator=(const Writer& other) = delete;
+
+ private:
+  // the sections of the image, in file order
+  enum Section {
+    kWordOffsets,
+    kWordArena,
+    kPostingOffsets,
+    kListOffsets,
+    kBlocks,
+    kNameOffsets,
+    kNameArena,
+    kNumSections
+  };
+
+  // appends size bytes to a section
+  void append(Section section, const void* data, size_t size);
+
+  // returns the name of a section's scratch file
+  string scratch_file(int section) const;
+
+  string path_;
+  std::array<std::ofstream, kNumSections> sections_;
+  uint64_t num_words_ = 0;
+  uint64_t num_docs_ = 0;
+  uint64_t num_postings_ = 0;
+  uint64_t blocks_size_ = 0;
+  uint64_t word_bytes_ = 0;
+  uint64_t name_bytes_ = 0;
+
+  // one word's encoded list, reused across words
+  vector<uint8_t> blocks_;
+};
+
+}  // namespace searchserver
+
+#endif  // FROZEN_WORD_INDEX_H_
@@ -0,0 +1,171 @@
+#include "./HttpRequest.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace searchserver {
+
+// Returns true if a and b are equal, ignoring ASCII case
+static bool equals_ignoring_case(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    char x = a[i];
+    char y = b[i];
+    if (x >= 'A' && x <= 'Z')
+      x = static_cast<char>(x - 'A' + 'a');
+    if (y >= 'A' && y <= 'Z')
+      y = static_cast<char>(y - 'A' + 'a');
+    if (x != y)
+      return false;
+  }
+  return true;
+}
+
+// Returns s without leading and trailing spaces and tabs
+static std::string_view trim(std::string_view s) {
+  size_t start = s.find_first_not_of(" \t");
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  size_t end = s.find_last_not_of(" \t");
+  return s.substr(start, end - start + 1);
+}
+
+std::optional<std::string_view> HttpRequest::header(
+    std::string_view name) const {
+  for (size_t i = 0; i < layout_.num_headers; i++) {
+    if (equals_ignoring_case(header_name(i), name)) {
+      return header_value(i);
+    }
+  }
+  return std::nullopt;
+}
+
+bool HttpRequest::wants_close() const {
+  auto connection = header("Connection");
+  if (!connection) {
+    return false;
+  }
+  // a comma separated list of options
+  std::string_view options = *connection;
+  while (!options.empty()) {
+    size_t comma = options.find(',');
+    if (equals_ignoring_case(trim(options.substr(0, comma)), "close")) {
+      return true;
+    }
+    if (comma == std::string_view::npos)
+      break;
+    options.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse(std::string_view data) {
+  while (state_ == State::kRequestLine || state_ == State::kHeaders) {
+    // find the end of the current line, from where the last search stopped
+    size_t limit = std::min(data.size(), HttpRequest::kMaxSize);
+    const void* found = nullptr;
+    if (scanned_ < limit) {
+      found = memchr(data.data() + scanned_, '\n', limit - scanned_);
+    }
+    if (found == nullptr) {
+      scanned_ = limit;
+      if (limit == HttpRequest::kMaxSize) {
+        state_ = State::kError;
+        break;
+      }
+      return Status::kIncomplete;
+    }
+    size_t newline = static_cast<const char*>(found) - data.data();
+    size_t end = newline;
+    if (end > line_start_ && data[end - 1] == '\r') {
+      end--;
+    }
+
+    bool ok = true;
+    if (state_ == State::kRequestLine) {
+      // a client may send empty lines before a request
+      if (end > line_start_) {
+        ok = parse_request_line(data, end);
+        state_ = State::kHeaders;
+      }
+    } else if (end == line_start_) {
+      // an empty line ends the header
+      layout_.size = newline + 1;
+      state_ = State::kComplete;
+    } else {
+      ok = parse_header_line(data, end);
+    }
+    if (!ok) {
+      state_ = State::kError;
+    }
+    line_start_ = newline + 1;
+    scanned_ = line_start_;
+  }
+  return state_ == State::kComplete ? Status::kComplete : Status::kError;
+}
+
+bool HttpRequestParser::parse_request_line(std::string_view data, size_t end) {
+  // method SP target SP version
+  std::string_view line = data.substr(line_start_, end - line_start_);
+  size_t first = line.find(' ');
+  size_t second =
+      first == std::string_view::npos ? first : line.find(' ', first + 1);
+  if (first == 0 || second == std::string_view::npos || second == first + 1 ||
+      second + 1 == line.size() ||
+      line.find(' ', second + 1) != std::string_view::npos) {
+    return false;
+  }
+  auto start = static_cast<uint32_t>(line_start_);
+  layout_.method = {start, static_cast<uint32_t>(first)};
+  layout_.target = {static_cast<uint32_t>(start + first + 1),
+                    static_cast<uint32_t>(second - first - 1)};
+  layout_.version = {static_cast<uint32_t>(start + second + 1),
+                     static_cast<uint32_t>(line.size() - second - 1)};
+  return true;
+}
+
+bool HttpRequestParser::parse_header_line(std::string_view data, size_t end) {
+  // name ":" value, with optional whitespace around the value
+  std::string_view line = data.substr(line_start_, end - line_start_);
+  size_t colon = line.find(':');
+  if (colon == 0 || colon == std::string_view::npos ||
+      layout_.num_headers == HttpRequest::kMaxHeaders) {
+    return false;
+  }
+  std::string_view name = line.substr(0, colon);
+  if (name.find_first_of(" \t") != std::string_view::npos) {
+    return false;
+  }
+  std::string_view value = trim(line.substr(colon + 1));
+  auto offset = [&](std::string_view part) {
+    return static_cast<uint32_t>(part.data() - data.data());
+  };
+  auto& header = layout_.headers[layout_.num_headers++];
+  header.first = {offset(name), static_cast<uint32_t>(name.size())};
+  // an empty value has no position of its own in line
+  header.second = {value.empty() ? offset(name) : offset(value),
+                   static_cast<uint32_t>(value.size())};
+  return true;
+}
+
+void HttpRequestParser::take(std::string* buffer, HttpRequest* request) {
+  size_t size = layout_.size;
+  std::string& spare = request->buffer_;
+  spare.assign(*buffer, size, std::string::npos);
+  buffer->swap(spare);
+  request->layout_ = layout_;
+  reset();
+}
+
+void HttpRequestParser::reset() {
+  state_ = State::kRequestLine;
+  line_start_ = 0;
+  scanned_ = 0;
+  layout_.num_headers = 0;
+  layout_.size = 0;
+}
+
+}  // namespace searchserver
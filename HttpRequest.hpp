@@ -0,0 +1,146 @@
+#ifndef HTTP_REQUEST_H_
+#define HTTP_REQUEST_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace searchserver {
+
+// A parsed HTTP request header.
+//
+// The request is not copied out of the bytes it was read into: it holds the
+// buffer they arrived in, and every part of it is a string_view into that
+// buffer.  A connection keeps one HttpRequest and has each request parsed
+// into it, so that the buffers go back and forth between the two instead of
+// being allocated per request (see HttpRequestParser::take()).
+class HttpRequest {
+ public:
+  // Most header lines a request may have
+  static constexpr size_t kMaxHeaders = 64;
+
+  // Largest request header accepted, in bytes
+  static constexpr size_t kMaxSize = 64 * 1024;
+
+  // The request line
+  std::string_view method() const { return view(layout_.method); }
+  std::string_view target() const { return view(layout_.target); }
+  std::string_view version() const { return view(layout_.version); }
+
+  // Returns: the value of the first header called name, which is compared
+  // case-insensitively, or nullopt if there is none
+  std::optional<std::string_view> header(std::string_view name) const;
+
+  // The header lines, in the order they came in
+  size_t num_headers() const { return layout_.num_headers; }
+  std::string_view header_name(size_t i) const {
+    return view(layout_.headers[i].first);
+  }
+  std::string_view header_value(size_t i) const {
+    return view(layout_.headers[i].second);
+  }
+
+  // Returns true if the client asked for the connection to be closed after
+  // this request ("Connection: close")
+  bool wants_close() const;
+
+  // The whole header, including the empty line that ends it
+  std::string_view raw() const { return {buffer_.data(), layout_.size}; }
+
+ private:
+  friend class HttpRequestParser;
+
+  // a part of the request, as a position in buffer_, which can move before
+  // the request is complete
+  struct Span {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  // where the parts of the request are
+  struct Layout {
+    Span method;
+    Span target;
+    Span version;
+    std::array<std::pair<Span, Span>, kMaxHeaders> headers;
+    size_t num_headers;
+    // bytes of the whole header
+    size_t size;
+  };
+
+  std::string_view view(Span span) const {
+    return {buffer_.data() + span.offset, span.size};
+  }
+
+  // starts with the request; what follows it is left over from the buffer
+  std::string buffer_;
+  Layout layout_{};
+};
+
+// Parses a request header as its bytes arrive.
+//
+// The parser is resumable: each call to parse() carries on from where the
+// previous one stopped, so a header that arrives a few bytes at a time is
+// still only scanned once.  It doesn't hold on to the bytes; the caller keeps
+// them in a buffer of its own, and passes all of it to each call.
+class HttpRequestParser {
+ public:
+  // What parse() found
+  enum class Status {
+    // the header isn't complete yet
+    kIncomplete,
+    // the header is complete, take() it
+    kComplete,
+    // not an HTTP request, or one bigger than HttpRequest allows
+    kError,
+  };
+
+  // Parses what arrived since the last call.
+  //
+  // Arguments:
+  //  - data: the bytes received so far, starting with the first byte of the
+  //    request; the same bytes as in the previous call, with more at the end
+  //    (they may have moved)
+  //
+  // Returns: the state of the request.  Once it is complete or in error, it
+  // stays so until take() or reset().
+  Status parse(std::string_view data);
+
+  // Moves a complete request into request and starts on the next one.
+  //
+  // The request takes over *buffer, which was passed to parse() and starts
+  // with it.  Whatever followed the request in *buffer (the start of the next
+  // one) is moved into the buffer the request had, which then becomes
+  // *buffer.  Once both buffers have grown to fit, this allocates nothing.
+  void take(std::string* buffer, HttpRequest* request);
+
+  // Forgets the request being parsed
+  void reset();
+
+ private:
+  enum class State {
+    kRequestLine,
+    kHeaders,
+    kComplete,
+    kError,
+  };
+
+  // parses the line data[line_start_, end), without its line break
+  bool parse_request_line(std::string_view data, size_t end);
+  bool parse_header_line(std::string_view data, size_t end);
+
+  State state_ = State::kRequestLine;
+  // where the line being parsed starts
+  size_t line_start_ = 0;
+  // how far data has been searched for the end of that line
+  size_t scanned_ = 0;
+  HttpRequest::Layout layout_{};
+};
+
+}  // namespace searchserver
+
+#endif  // HTTP_REQUEST_H_
@@ -0,0 +1,152 @@
+#include "./HttpResponse.hpp"
+
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <utility>
+
+#include "./FileReader.hpp"
+
+namespace searchserver {
+
+HttpResponse::~HttpResponse() {
+  if (file_ != -1)
+    ::close(file_);
+}
+
+HttpResponse::HttpResponse(HttpResponse&& other) noexcept
+    : pieces_(std::move(other.pieces_)),
+      num_pieces_(other.num_pieces_),
+      piece_(other.piece_),
+      offset_(other.offset_),
+      file_(other.file_),
+      file_size_(other.file_size_),
+      close_(other.close_) {
+  other.num_pieces_ = other.piece_ = other.offset_ = 0;
+  other.file_ = -1;
+}
+
+HttpResponse& HttpResponse::operator=(HttpResponse&& other) noexcept {
+  std::swap(pieces_, other.pieces_);
+  std::swap(num_pieces_, other.num_pieces_);
+  std::swap(piece_, other.piece_);
+  std::swap(offset_, other.offset_);
+  std::swap(file_, other.file_);
+  std::swap(file_size_, other.file_size_);
+  std::swap(close_, other.close_);
+  return *this;
+}
+
+HttpResponse& HttpResponse::add_constant(std::string_view fragment) {
+  if (fragment.empty()) {
+    return *this;
+  }
+  if (num_pieces_ < kMaxPieces) {
+    pieces_[num_pieces_++].view = fragment;
+    return *this;
+  }
+  return add(std::string(fragment));
+}
+
+HttpResponse& HttpResponse::add(std::string text) {
+  if (text.empty()) {
+    return *this;
+  }
+  if (num_pieces_ < kMaxPieces) {
+    pieces_[num_pieces_++].text = std::move(text);
+    return *this;
+  }
+  // out of pieces: join onto the last one
+  Piece& last = pieces_[kMaxPieces - 1];
+  if (last.view.data() != nullptr) {
+    last.text = last.view;
+    last.view = {};
+  }
+  last.text += text;
+  return *this;
+}
+
+HttpResponse& HttpResponse::add_content_length(size_t size) {
+  static constexpr std::string_view kName = "Content-length: ";
+  std::array<char, 24> digits{};
+  auto [end, ec] = std::to_chars(digits.begin(), digits.end(), size);
+  std::string header;
+  header.reserve(kName.size() + (end - digits.begin()) + 4);
+  header.append(kName);
+  header.append(digits.begin(), end);
+  header.append("\r\n\r\n");
+  return add(std::move(header));
+}
+
+void HttpResponse::set_file(int fd, size_t size) {
+  if (file_ != -1)
+    ::close(file_);
+  file_ = fd;
+  file_size_ = size;
+}
+
+void HttpResponse::inline_file() {
+  if (file_ == -1) {
+    return;
+  }
+  std::string contents(file_size_, '\0');
+  if (!read_at(file_, contents.data(), file_size_, 0)) {
+    contents.clear();
+    close_ = true;
+  }
+  ::close(file_);
+  file_ = -1;
+  file_size_ = 0;
+  add(std::move(contents));
+}
+
+size_t HttpResponse::remaining() const {
+  size_t total = 0;
+  for (size_t i = piece_; i < num_pieces_; i++) {
+    total += pieces_[i].data().size();
+  }
+  return total - offset_;
+}
+
+size_t HttpResponse::iovecs(struct iovec* iov, size_t max) const {
+  size_t n = 0;
+  for (size_t i = piece_; i < num_pieces_ && n < max; i++, n++) {
+    std::string_view data = pieces_[i].data();
+    size_t skip = i == piece_ ? offset_ : 0;
+    iov[n].iov_base = const_cast<char*>(data.data() + skip);
+    iov[n].iov_len = data.size() - skip;
+  }
+  return n;
+}
+
+void HttpResponse::advance(size_t n) {
+  while (n > 0 && piece_ < num_pieces_) {
+    size_t left = pieces_[piece_].data().size() - offset_;
+    if (n < left) {
+      offset_ += n;
+      return;
+    }
+    n -= left;
+    piece_++;
+    offset_ = 0;
+  }
+}
+
+bool HttpResponse::write_to(int fd) {
+  std::array<struct iovec, kMaxPieces> iov{};
+  while (!done()) {
+    size_t n = iovecs(iov.data(), iov.size());
+    ssize_t written = writev(fd, iov.data(), static_cast<int>(n));
+    if (written >= 0) {
+      advance(static_cast<size_t>(written));
+      continue;
+    }
+    if (errno == EINTR)
+      continue;
+    // a full socket buffer is not an error, the rest goes out later
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+  return true;
+}
+
+}  // namespace searchserver
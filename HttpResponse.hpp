@@ -0,0 +1,130 @@
+#ifndef HTTP_RESPONSE_H_
+#define HTTP_RESPONSE_H_
+
+#include <sys/uio.h>
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace searchserver {
+
+// An HTTP response, kept as the pieces it was built from.
+//
+// The status line, the headers, the body chunks and the contents of a file
+// are never joined into one string: each is a piece of its own, and the
+// pieces go out together with one writev() (or one sendmsg() from
+// UringLoop), so a large body is not copied just to put a header in front
+// of it.  Constant fragments, like the status lines and headers below, are
+// referred to rather than copied at all.
+//
+// A response can end with the contents of an open file (a static file),
+// which the loop sending it reads in however suits it best.  The response
+// owns the file, and closes it when it is destroyed.
+class HttpResponse {
+ public:
+  // Most pieces a response is kept in; text appended after that is joined
+  // onto the last piece
+  static constexpr size_t kMaxPieces = 16;
+
+  // Header fragments that responses share
+  static constexpr std::string_view kOk = "HTTP/1.1 200 OK\r\n";
+  static constexpr std::string_view kFound = "HTTP/1.1 302 Found\r\n";
+  static constexpr std::string_view kNotFound =
+      "HTTP/1.1 404 Not Found\r\nContent-length: 0\r\n\r\n";
+  static constexpr std::string_view kUnavailable =
+      "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\n"
+      "Content-length: 0\r\n\r\n";
+  static constexpr std::string_view kTextPlain =
+      "Content-type: text/plain\r\n";
+  static constexpr std::string_view kTextHtml = "Content-type: text/html\r\n";
+  static constexpr std::string_view kApplicationJson =
+      "Content-type: application/json\r\n";
+
+  HttpResponse() = default;
+  ~HttpResponse();
+
+  // movable, not copyable: the file has one owner
+  HttpResponse(HttpResponse&& other) noexcept;
+  HttpResponse& operator=(HttpResponse&& other) noexcept;
+  HttpResponse(const HttpResponse& other) = delete;
+  HttpResponse& operator=(const HttpResponse& other) = delete;
+
+  // Appends a fragment that outlives the response (a string literal, say)
+  // without copying it
+  HttpResponse& add_constant(std::string_view fragment);
+
+  // Appends text, which the response takes over
+  HttpResponse& add(std::string text);
+
+  // Appends the Content-length header for a body of size bytes, and the
+  // empty line that ends the header
+  HttpResponse& add_content_length(size_t size);
+
+  // Ends the response with the first size bytes of the open file fd, which
+  // the response takes over
+  void set_file(int fd, size_t size);
+
+  // Reads the file, if there is one, into a last piece of the response and
+  // closes it.  A file that shrank since the response was made can't be sent
+  // in full, so the response asks for the connection to be closed after what
+  // was read.
+  void inline_file();
+
+  // The file the response ends with, or -1 for none, and its size
+  int file() const { return file_; }
+  size_t file_size() const { return file_size_; }
+
+  // Whether to close the connection once the response is sent
+  bool close() const { return close_; }
+  void set_close(bool close) { close_ = close; }
+
+  // Returns the number of bytes in the pieces (not the file) that have not
+  // been written yet
+  size_t remaining() const;
+
+  // Returns true once every piece has been written
+  bool done() const { return piece_ == num_pieces_; }
+
+  // Fills iov with the pieces that have not been written yet.
+  //
+  // Returns: the number of iovecs filled, at most max
+  size_t iovecs(struct iovec* iov, size_t max) const;
+
+  // Marks n more bytes of the pieces as written
+  void advance(size_t n);
+
+  // Writes the pieces to fd with writev(), picking up after a partial
+  // write.  A blocking fd is written until the pieces are all out; a
+  // non-blocking one until it would block.  The file has to have been read
+  // in with inline_file() first.
+  //
+  // Returns: false on error
+  bool write_to(int fd);
+
+ private:
+  // a fragment (view) or, if view is empty, owned text
+  struct Piece {
+    std::string_view view;
+    std::string text;
+
+    std::string_view data() const {
+      return view.data() != nullptr ? view : std::string_view(text);
+    }
+  };
+
+  std::array<Piece, kMaxPieces> pieces_;
+  size_t num_pieces_ = 0;
+  // what has been written: every piece before piece_, and the first offset_
+  // bytes of piece_
+  size_t piece_ = 0;
+  size_t offset_ = 0;
+  int file_ = -1;
+  size_t file_size_ = 0;
+  bool close_ = false;
+};
+
+}  // namespace searchserver
+
+#endif  // HTTP_RESPONSE_H_
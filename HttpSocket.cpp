@@ -10,7 +10,9 @@
  */
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <array>
+#include <cerrno>
 #include <cstdint>
 #include <cstring>
 #include <string>
@@ -27,47 +29,74 @@ using std::vector;
 
 namespace searchserver {
 
-static const char* const kHeaderEnd = "\r\n\r\n";
-static const int kHeaderEndLen = 4;
-
-// Read next HTTP request header, return it (incl. "\r\n\r\n");
-// return nullopt if connection closed or on error.
-optional<string> HttpSocket::next_request() {
-  // Use "wrapped_read" to read data into the buffer_
-  // instance variable.  Keep reading data until either the
-  // connection drops or you see a "\r\n\r\n" that demarcates
-  // the end of the request header. Be sure to try and read in
-  // a large amount of bytes each time you call wrapped_read.
-  //
-  // Once you've seen the request header, use parse_request()
-  // to parse the header into the *request argument.
-  //
-  // Very tricky part:  clients can send back-to-back requests
-  // on the same socket.  So, you need to preserve everything
-  // after the "\r\n\r\n" in buffer_ for the next time the
-  // caller invokes next_request()!
+// Bytes read_available() asks for per read()
+static constexpr size_t kReadSize = 16384;
 
+bool HttpSocket::next_request(HttpRequest* request) {
+  // Clients can send back-to-back requests on the same socket, so whatever
+  // follows the header stays in buffer_ for the next call
   while (true) {
-    // Check if we already have full header
-    auto pos = buffer_.find(kHeaderEnd);
-    if (pos != string::npos) {
-      size_t end = pos + kHeaderEndLen;
-      string req = buffer_.substr(0, end);
-      buffer_.erase(0, end);
-      return req;
+    switch (buffered_request(request)) {
+      case HttpRequestParser::Status::kComplete:
+        return true;
+      case HttpRequestParser::Status::kError:
+        return false;
+      case HttpRequestParser::Status::kIncomplete:
+        break;
     }
-    // Read more data into buffer_
     auto n = wrapped_read(fd_, &buffer_);
-    if (n <= 0) {
-      return nullopt;
+    if (n == 0 || n == static_cast<size_t>(-1)) {
+      return false;
     }
   }
 }
 
-// Write the entire response via wrapped_write; return false on error.
-bool HttpSocket::write_response(const string& response) const {
-  auto n = wrapped_write(fd_, response);
-  return n >= 0;
+// Write the entire response with writev(); return false on error.
+bool HttpSocket::write_response(HttpResponse* response) const {
+  response->inline_file();
+  return response->write_to(fd_) && response->done();
+}
+
+bool HttpSocket::set_nonblocking() {
+  int flags = fcntl(fd_, F_GETFL);
+  return flags != -1 && fcntl(fd_, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+HttpSocket::ReadStatus HttpSocket::read_available() {
+  // read straight into the end of the buffer until the socket is drained
+  while (true) {
+    if (input_full())
+      return ReadStatus::kFull;
+    size_t used = buffer_.size();
+    buffer_.resize(used + kReadSize);
+    ssize_t n = read(fd_, buffer_.data() + used, kReadSize);
+    buffer_.resize(used + (n > 0 ? n : 0));
+    if (n > 0)
+      continue;
+    if (n == 0)
+      return ReadStatus::kEof;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return ReadStatus::kAgain;
+    return ReadStatus::kError;
+  }
+}
+
+HttpRequestParser::Status HttpSocket::buffered_request(HttpRequest* request) {
+  auto status = parser_.parse(buffer_);
+  if (status == HttpRequestParser::Status::kComplete) {
+    parser_.take(&buffer_, request);
+  }
+  return status;
+}
+
+void HttpSocket::queue_response(HttpResponse response) {
+  out_ = std::move(response);
+}
+
+bool HttpSocket::flush() {
+  return out_.write_to(fd_);
 }
 
 // Below functions are given to you
@@ -0,0 +1,166 @@
+/*
+ * Copyright ©2025 Travis McGaha.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Pennsylvania
+ * CIT 5950 for use solely during Spring Semester 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HTTPSOCKET_HPP_
+#define HTTPSOCKET_HPP_
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "./HttpRequest.hpp"
+#include "./HttpResponse.hpp"
+
+namespace searchserver {
+
+// A connection to an HTTP client.
+//
+// It can be used blocking, one request at a time with next_request() and
+// write_response(), or, accepted non-blocking (see
+// ServerSocket::accept_client()), from an event loop (see EventLoop.hpp):
+// read_available() takes in whatever the client has sent, buffered_request()
+// parses complete requests out of it, and queue_response() and flush() write
+// responses out as fast as the client accepts them.  A loop that does its own
+// socket I/O (see UringLoop.hpp) hands what it received to add_input() and
+// still parses requests with buffered_request().
+//
+// Requests are parsed as the bytes come in, by an HttpRequestParser that
+// picks up where it left off, and are handed out in place, in a buffer that
+// the HttpRequest and the socket trade back and forth.
+class HttpSocket {
+ public:
+  // What read_available() found
+  enum class ReadStatus {
+    // read everything the client has sent so far; the connection is open
+    kAgain,
+    // the client closed its side of the connection
+    kEof,
+    // stopped with the request buffer full (see input_full()); the rest is
+    // read once requests have been taken out of it
+    kFull,
+    // the connection failed
+    kError,
+  };
+
+  // Takes ownership of the connected socket fd, from a client at addr
+  HttpSocket(int fd, socklen_t len, const struct sockaddr* addr) : fd_(fd) {
+    memcpy(&addr_, addr, len);
+  }
+
+  // Closes the connection
+  ~HttpSocket() {
+    if (fd_ != -1)
+      close(fd_);
+  }
+
+  // movable, not copyable: the socket has one owner
+  HttpSocket(HttpSocket&& other) noexcept
+      : fd_(other.fd_),
+        addr_(other.addr_),
+        buffer_(std::move(other.buffer_)),
+        parser_(other.parser_),
+        out_(std::move(other.out_)) {
+    other.fd_ = -1;
+  }
+  HttpSocket& operator=(HttpSocket&& other) noexcept {
+    std::swap(fd_, other.fd_);
+    addr_ = other.addr_;
+    buffer_.swap(other.buffer_);
+    std::swap(parser_, other.parser_);
+    std::swap(out_, other.out_);
+    return *this;
+  }
+  HttpSocket(const HttpSocket& other) = delete;
+  HttpSocket& operator=(const HttpSocket& other) = delete;
+
+  // Reads the next request header into request, blocking until it is
+  // complete.  The socket must be blocking.
+  //
+  // Returns: false if the connection closed or failed first, or the client
+  // sent something that isn't a request
+  bool next_request(HttpRequest* request);
+
+  // Writes a whole response, blocking until it is sent.  The socket must be
+  // blocking.
+  //
+  // Returns: false on error
+  bool write_response(HttpResponse* response) const;
+
+  // Puts the socket in non-blocking mode, for the calls below.
+  //
+  // Returns: false on error
+  bool set_nonblocking();
+
+  // Reads everything the client has sent so far into the request buffer,
+  // without blocking, or until the buffer is full.  Requests read before the
+  // client closed its side can still be taken out with buffered_request().
+  ReadStatus read_available();
+
+  // Appends bytes received from the client by some other means to the request
+  // buffer, in place of read_available()
+  void add_input(const char* data, size_t size) { buffer_.append(data, size); }
+
+  // Returns true if the request buffer holds HttpRequest::kMaxSize bytes not
+  // yet taken out as requests.  That is more than any one request, so the
+  // next is complete (or an error); a client that pipelines faster than its
+  // requests are answered waits until they have been, rather than growing
+  // the buffer without bound.
+  bool input_full() const { return buffer_.size() >= HttpRequest::kMaxSize; }
+
+  // Parses the next request header out of the request buffer, without
+  // reading from the socket.  A complete one is moved into request, which
+  // hands its own buffer over in exchange (see HttpRequestParser::take()).
+  //
+  // Returns: kComplete if request now holds the request, kIncomplete if no
+  // complete one has arrived yet, kError if the client sent something that
+  // isn't a request
+  HttpRequestParser::Status buffered_request(HttpRequest* request);
+
+  // Queues a response to be written by flush().  The previous one must have
+  // been written, and the file of this one read in.
+  void queue_response(HttpResponse response);
+
+  // Writes as much of the queued response as the socket takes without
+  // blocking.
+  //
+  // Returns: false on error
+  bool flush();
+
+  // Returns true if the queued response has not all been written yet
+  bool has_output() const { return !out_.done(); }
+
+  // Returns the socket's file descriptor
+  int fd() const { return fd_; }
+
+  std::string client_addr() const;
+  uint16_t client_port() const;
+  std::string server_addr() const;
+  uint16_t server_port() const;
+
+ private:
+  int fd_;
+  struct sockaddr_storage addr_ {};
+  // bytes read but not yet returned as a request, and how far they have
+  // been parsed
+  std::string buffer_;
+  HttpRequestParser parser_;
+  // the queued response, which knows how much of it has been written
+  HttpResponse out_;
+};
+
+}  // namespace searchserver
+
+#endif  // HTTPSOCKET_HPP_
@@ -44,6 +44,9 @@ using std::vector;
 
 namespace searchserver {
 
+// Bytes wrapped_read() asks for per read()
+static constexpr size_t kReadSize = 16384;
+
 // You don't have to implement thius function, but likely would be helpful
 // we would give it to you if it weren't an answer to past HW assignments
 
@@ -65,37 +68,35 @@ vector<string> split(const string& input, const string& delims) {
 optional<vector<DirEntry>> readdir(const string& dirname) {
   vector<DirEntry> entries;
 
-  struct dirent* dirent = nullptr;
-  struct stat st {};
-
-  int res = stat(dirname.c_str(), &st);
-  if (res != 0) {
+  DIR* dir = opendir(dirname.c_str());
+  if (dir == nullptr) {
     return nullopt;
   }
 
-  if (S_ISDIR(st.st_mode)) {
-    DIR* dir = opendir(dirname.c_str());
-    dirent = readdir(dir);
-    while (dirent != nullptr) {
-      string path = dirname + '/';
-      path += dirent->d_name;
-
-      if (stat(path.c_str(), &st) == 0) {
+  // d_type says what most entries are; only links (which are followed) and
+  // entries of file systems that leave it unset need a stat(), relative to
+  // the directory so that no path has to be built
+  struct dirent* dirent = readdir(dir);
+  while (dirent != nullptr) {
+    unsigned char type = dirent->d_type;
+    if (type == DT_LNK || type == DT_UNKNOWN) {
+      struct stat st {};
+      type = DT_UNKNOWN;
+      if (fstatat(dirfd(dir), dirent->d_name, &st, 0) == 0) {
         if (S_ISREG(st.st_mode)) {
-          DirEntry entry = {dirent->d_name, false};
-          entries.push_back(std::move(entry));
+          type = DT_REG;
         } else if (S_ISDIR(st.st_mode)) {
-          DirEntry entry = {dirent->d_name, true};
-          entries.push_back(std::move(entry));
+          type = DT_DIR;
         }
       }
-
-      dirent = readdir(dir);
     }
-    closedir(dir);
-  } else {
-    return nullopt;
+    if (type == DT_REG || type == DT_DIR) {
+      entries.push_back(DirEntry{dirent->d_name, type == DT_DIR});
+    }
+
+    dirent = readdir(dir);
   }
+  closedir(dir);
 
   return entries;
 }
@@ -194,6 +195,24 @@ string decode_URI(const string& from) {
   return retstr;
 }
 
+string encode_URI(const string& from) {
+  static constexpr char kHex[] = "0123456789ABCDEF";
+  string retstr;
+  retstr.reserve(from.size());
+  for (char c : from) {
+    auto u = static_cast<unsigned char>(c);
+    if (u >= 0x80 || isalnum(u) || c == '-' || c == '.' || c == '_' ||
+        c == '~') {
+      retstr.append(1, c);
+      continue;
+    }
+    retstr.append(1, '%');
+    retstr.append(1, kHex[u >> 4]);
+    retstr.append(1, kHex[u & 0xf]);
+  }
+  return retstr;
+}
+
 void URLParser::parse(const string& url) {
   url_ = url;
 
@@ -225,17 +244,19 @@ void URLParser::parse(const string& url) {
 }
 
 size_t wrapped_read(int fd, string* buf) {
+  // read straight into the end of buf, rather than through a temporary
+  size_t used = buf->size();
+  buf->resize(used + kReadSize);
   ssize_t res = 0;
-  array<char, 1024> buffer{};
   while (true) {
-    res = read(fd, buffer.data(), 1024);
+    res = read(fd, buf->data() + used, kReadSize);
     if (res == -1) {
       if ((errno == EAGAIN) || (errno == EINTR))
         continue;
     }
     break;
   }
-  *buf += string(buffer.data(), res);
+  buf->resize(used + (res > 0 ? res : 0));
   return static_cast<size_t>(res);
 }
 
@@ -55,6 +55,12 @@ std::string escape_html(const std::string &from);
 //
 std::string decode_URI(const std::string &from);
 
+// The reverse of decode_URI(): percent-encodes every ASCII character of from
+// but letters, digits and "-._~", so that it can be put in a URL as one
+// query argument value.  Bytes past ASCII are left as they are, since
+// decode_URI() doesn't decode them.
+std::string encode_URI(const std::string &from);
+
 // A URL that's part of a web request has the following structure:
 //
 //   /foo/bar/baz?field=value&field2=value2
@@ -98,7 +104,7 @@ size_t wrapped_write(int fd, const std::string& buf);
 // from dealing with the ugly issues of partial reads, EINTR, EAGAIN,
 // and so on.
 //
-// Reads 1024 bytes from the file descriptor fd onto the end of
+// Reads up to 16384 bytes from the file descriptor fd onto the end of
 // the buffer string "buf".  Returns the number of bytes actually
 // read.  On fatal error, returns -1.  If EOF is hit and no
 // bytes have been read, returns 0.  Might read fewer bytes
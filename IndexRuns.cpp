@@ -0,0 +1,349 @@
+#include "./IndexRuns.hpp"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string_view>
+#include <utility>
+
+#include "./FrozenWordIndex.hpp"
+
+namespace searchserver {
+
+// Run file format.
+//
+// A run is two lists of records, each ended by a record whose length is
+// kEndOfList:
+//  - the documents, in name order: a uint32_t length, then the name
+//  - the vocabulary, in sorted order: a uint32_t length, the word, a uint64_t
+//    number of postings n, then n DocIds and n counts, sorted by DocId
+// DocIds are positions in the run's own document list.  Runs only live as
+// long as the build that writes them, so integers are in host byte order.
+static constexpr uint32_t kEndOfList = UINT32_MAX;
+
+// Most runs merged at once, to stay well clear of the open file limit
+static constexpr size_t kMaxMergeWays = 64;
+
+// Size of the read buffer of each run being merged
+static constexpr size_t kRunBufferSize = 256 * 1024;
+
+// Writes a run file one record at a time.  Has the same interface as
+// FrozenWordIndex::Writer, so that merge_runs() can write either.
+class RunWriter {
+ public:
+  explicit RunWriter(const string& path)
+      : out_(path, std::ios::binary | std::ios::trunc) {}
+
+  void add_document(std::string_view name) { put_string(name); }
+
+  void add_word(std::string_view word,
+                const DocId* docs,
+                const uint32_t* counts,
+                size_t n) {
+    end_documents();
+    put_string(word);
+    put(static_cast<uint64_t>(n));
+    out_.write(reinterpret_cast<const char*>(docs), n * sizeof(DocId));
+    out_.write(reinterpret_cast<const char*>(counts), n * sizeof(uint32_t));
+  }
+
+  bool finish() {
+    end_documents();
+    put(kEndOfList);
+    out_.close();
+    return !out_.fail();
+  }
+
+ private:
+  template <typename T>
+  void put(T value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void put_string(std::string_view s) {
+    put(static_cast<uint32_t>(s.size()));
+    out_.write(s.data(), s.size());
+  }
+
+  // the first word ends the document list
+  void end_documents() {
+    if (in_documents_) {
+      put(kEndOfList);
+      in_documents_ = false;
+    }
+  }
+
+  std::ofstream out_;
+  bool in_documents_ = true;
+};
+
+// Reads a run file one record at a time
+class RunReader {
+ public:
+  explicit RunReader(const string& path) : buffer_(kRunBufferSize) {
+    // the buffer has to be set before the file is opened to take effect
+    in_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+    in_.open(path, std::ios::binary);
+  }
+
+  // Reads the next document into name().  Returns false at the end of the
+  // document list, or on an error.
+  bool next_document() { return get_string(&name_); }
+
+  // Reads the next word into word(), docs() and counts().  Returns false at
+  // the end of the vocabulary, or on an error.
+  bool next_word() {
+    uint64_t n = 0;
+    if (!get_string(&word_) || !get(&n))
+      return false;
+    docs_.resize(n);
+    counts_.resize(n);
+    in_.read(reinterpret_cast<char*>(docs_.data()), n * sizeof(DocId));
+    in_.read(reinterpret_cast<char*>(counts_.data()), n * sizeof(uint32_t));
+    return !in_.fail();
+  }
+
+  const string& name() const { return name_; }
+  const string& word() const { return word_; }
+  const vector<DocId>& docs() const { return docs_; }
+  const vector<uint32_t>& counts() const { return counts_; }
+
+  // Returns false if a read failed, rather than reaching the end of a list
+  bool ok() const { return !in_.fail(); }
+
+ private:
+  template <typename T>
+  bool get(T* value) {
+    in_.read(reinterpret_cast<char*>(value), sizeof(*value));
+    return !in_.fail();
+  }
+
+  bool get_string(string* s) {
+    uint32_t size = 0;
+    if (!get(&size) || size == kEndOfList)
+      return false;
+    s->resize(size);
+    in_.read(s->data(), size);
+    return !in_.fail();
+  }
+
+  vector<char> buffer_;
+  std::ifstream in_;
+  string name_;
+  string word_;
+  vector<DocId> docs_;
+  vector<uint32_t> counts_;
+};
+
+// Merges the runs into out (a RunWriter or a FrozenWordIndex::Writer), which
+// gets every document and then every word, in order.  Returns false if a run
+// can't be read.
+template <typename Output>
+static bool merge_runs(const vector<string>& runs, Output* out) {
+  vector<std::unique_ptr<RunReader>> readers;
+  for (auto& run : runs) {
+    readers.push_back(std::make_unique<RunReader>(run));
+  }
+
+  // k-way merge of the document names assigns the merged DocIds in name
+  // order; remap[r][DocId in run r] = merged DocId.  A walk that reported a
+  // file twice could leave it in two runs, it is still one document.
+  vector<vector<DocId>> remap(readers.size());
+  auto name_after = [&](size_t a, size_t b) {
+    return readers[a]->name() > readers[b]->name();
+  };
+  std::priority_queue<size_t, vector<size_t>, decltype(name_after)> names(
+      name_after);
+  for (size_t r = 0; r < readers.size(); r++) {
+    if (readers[r]->next_document())
+      names.push(r);
+  }
+  DocId num_docs = 0;
+  string last_name;
+  while (!names.empty()) {
+    size_t r = names.top();
+    names.pop();
+    const string& name = readers[r]->name();
+    if (num_docs == 0 || name != last_name) {
+      out->add_document(name);
+      last_name = name;
+      num_docs++;
+    }
+    remap[r].push_back(num_docs - 1);
+    if (readers[r]->next_document())
+      names.push(r);
+  }
+
+  // k-way merge of the vocabularies, combining the postings of each word
+  auto word_after = [&](size_t a, size_t b) {
+    return readers[a]->word() > readers[b]->word();
+  };
+  std::priority_queue<size_t, vector<size_t>, decltype(word_after)> words(
+      word_after);
+  for (size_t r = 0; r < readers.size(); r++) {
+    if (readers[r]->next_word())
+      words.push(r);
+  }
+  string word;
+  vector<std::pair<DocId, uint32_t>> list;
+  vector<DocId> docs;
+  vector<uint32_t> counts;
+  while (!words.empty()) {
+    word = readers[words.top()]->word();
+    list.clear();
+    size_t sources = 0;
+    while (!words.empty() && readers[words.top()]->word() == word) {
+      size_t r = words.top();
+      words.pop();
+      const RunReader& run = *readers[r];
+      for (size_t i = 0; i < run.docs().size(); i++) {
+        DocId local = run.docs()[i];
+        if (local >= remap[r].size())
+          return false;
+        list.emplace_back(remap[r][local], run.counts()[i]);
+      }
+      sources++;
+      if (readers[r]->next_word())
+        words.push(r);
+    }
+
+    // remapping keeps the order within a run, so only postings that come
+    // from several runs need sorting
+    if (sources > 1) {
+      std::sort(list.begin(), list.end());
+    }
+    docs.clear();
+    counts.clear();
+    for (auto& [doc, count] : list) {
+      if (!docs.empty() && docs.back() == doc) {
+        counts.back() += count;
+        continue;
+      }
+      docs.push_back(doc);
+      counts.push_back(count);
+    }
+    out->add_word(word, docs.data(), counts.data(), docs.size());
+  }
+
+  for (auto& reader : readers) {
+    if (!reader->ok())
+      return false;
+  }
+  return true;
+}
+
+IndexRuns::IndexRuns(string prefix) : prefix_(std::move(prefix)) {}
+
+IndexRuns::~IndexRuns() {
+  for (auto& run : runs_) {
+    unlink(run.c_str());
+  }
+}
+
+bool IndexRuns::spill(const WordIndex& index) {
+  if (index.docs_.empty()) {
+    return true;
+  }
+
+  // renumber the documents in name order and sort the vocabulary, the same
+  // way freezing an index does
+  vector<DocId> by_name;
+  by_name.reserve(index.num_docs());
+  for (size_t i = 0; i < index.docs_.size(); i++) {
+    if (index.docs_[i].live) {
+      by_name.push_back(static_cast<DocId>(i));
+    }
+  }
+  std::sort(by_name.begin(), by_name.end(), [&](DocId a, DocId b) {
+    return index.docs_[a].name < index.docs_[b].name;
+  });
+  vector<DocId> new_id(index.docs_.size());
+  for (size_t i = 0; i < by_name.size(); i++) {
+    new_id[by_name[i]] = static_cast<DocId>(i);
+  }
+  vector<const std::pair<const string, PostingList>*> words;
+  words.reserve(index.index_.size());
+  for (auto& entry : index.index_) {
+    words.push_back(&entry);
+  }
+  std::sort(words.begin(), words.end(),
+            [](auto* a, auto* b) { return a->first < b->first; });
+
+  string path = next_run_file();
+  RunWriter out(path);
+  for (DocId doc : by_name) {
+    out.add_document(index.docs_[doc].name);
+  }
+  vector<std::pair<DocId, uint32_t>> list;
+  vector<DocId> docs;
+  vector<uint32_t> counts;
+  for (auto* entry : words) {
+    PostingView view = entry->second.view();
+    list.clear();
+    for (size_t i = 0; i < view.size; i++) {
+      list.emplace_back(new_id[view.docs[i]], view.counts[i]);
+    }
+    std::sort(list.begin(), list.end());
+    docs.clear();
+    counts.clear();
+    for (auto& [doc, count] : list) {
+      docs.push_back(doc);
+      counts.push_back(count);
+    }
+    out.add_word(entry->first, docs.data(), counts.data(), docs.size());
+  }
+  bool ok = out.finish();
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (ok) {
+    runs_.push_back(path);
+  } else {
+    unlink(path.c_str());
+    failed_ = true;
+  }
+  return ok;
+}
+
+size_t IndexRuns::num_runs() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return runs_.size();
+}
+
+bool IndexRuns::merge(const string& path) {
+  if (failed_) {
+    return false;
+  }
+
+  // Too many runs to read at once: merge the oldest ones into a bigger run
+  // until few enough are left.  Every pass re-reads what it merges, so this
+  // only kicks in when the budget is tiny compared to the index.
+  while (runs_.size() > kMaxMergeWays) {
+    vector<string> group(runs_.begin(), runs_.begin() + kMaxMergeWays);
+    runs_.erase(runs_.begin(), runs_.begin() + kMaxMergeWays);
+    string merged = next_run_file();
+    RunWriter out(merged);
+    bool ok = merge_runs(group, &out);
+    ok = out.finish() && ok;
+    for (auto& run : group) {
+      unlink(run.c_str());
+    }
+    // even a failed run is recorded, so that it is removed
+    runs_.push_back(merged);
+    if (!ok) {
+      return false;
+    }
+  }
+
+  FrozenWordIndex::Writer out(path);
+  return merge_runs(runs_, &out) && out.finish();
+}
+
+string IndexRuns::next_run_file() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return prefix_ + ".run" + std::to_string(next_run_++);
+}
+
+}  // namespace searchserver
@@ -0,0 +1,69 @@
+#ifndef INDEX_RUNS_H_
+#define INDEX_RUNS_H_
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "./WordIndex.hpp"
+
+using std::string;
+using std::vector;
+
+namespace searchserver {
+
+// The sorted runs of an out-of-core index build.
+//
+// A crawl that may only use a bounded amount of memory fills a WordIndex
+// until it reaches its budget, spills it to disk as a run, and starts over
+// with an empty one.  A run is a WordIndex sorted the way a FrozenWordIndex
+// is (documents renumbered in name order, vocabulary sorted), written as a
+// plain stream of records.  merge() then reads every run at once, through a
+// small buffer each: a k-way merge of their document names assigns the final
+// DocIds, and a k-way merge of their vocabularies streams each word with its
+// combined postings into a FrozenWordIndex::Writer.  Apart from the budget,
+// memory use is a DocId per document and the postings of one word at a time,
+// however large the index is.
+class IndexRuns {
+ public:
+  // Run files are named prefix + ".run<n>"
+  explicit IndexRuns(string prefix);
+
+  // Removes the run files
+  ~IndexRuns();
+
+  // Writes out the documents and postings in index as a new run.  Safe to
+  // call from several threads at once.
+  //
+  // Returns: true on success, false on any I/O error
+  bool spill(const WordIndex& index);
+
+  // Returns the number of runs spilled so far
+  size_t num_runs() const;
+
+  // Merges every run into an index file that FrozenWordIndex::open() can map,
+  // written next to path and renamed into place.  If there are more runs than
+  // can be read at once, groups of them are first merged into bigger runs.
+  //
+  // Returns: true on success, false if a spill or the merge failed
+  bool merge(const string& path);
+
+  // not copyable: the run files belong to this object
+  IndexRuns(const IndexRuns& other) = delete;
+  IndexRuns& operator=(const IndexRuns& other) = delete;
+
+ private:
+  // returns the name for a new run file
+  string next_run_file();
+
+  string prefix_;
+  mutable std::mutex lock_;
+  vector<string> runs_;
+  size_t next_run_ = 0;
+  bool failed_ = false;
+};
+
+}  // namespace searchserver
+
+#endif  // INDEX_RUNS_H_
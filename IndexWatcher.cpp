@@ -0,0 +1,230 @@
+#include "./IndexWatcher.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "./HttpUtils.hpp"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace searchserver {
+
+// Events that can change which files a directory has or what they contain
+static constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY |
+                                       IN_CLOSE_WRITE | IN_ATTRIB |
+                                       IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+// Changes are applied once no event has arrived for kSettleDelay, so a file
+// being written (or a tree being copied) is indexed once rather than after
+// every write, but never more than kMaxDelay after the first of them.
+static constexpr auto kSettleDelay = std::chrono::milliseconds(200);
+static constexpr auto kMaxDelay = std::chrono::seconds(2);
+
+IndexWatcher::IndexWatcher(string root,
+                           ServingIndex* serving,
+                           Manifest manifest,
+                           const CrawlOptions& opts)
+    : root_(std::move(root)),
+      serving_(serving),
+      manifest_(std::move(manifest)),
+      opts_(opts) {
+  opts_.manifest = nullptr;
+  opts_.stats = nullptr;
+  opts_.on_progress = nullptr;
+}
+
+IndexWatcher::~IndexWatcher() {
+  if (thread_.joinable()) {
+    char c = 0;
+    while (write(stop_pipe_[1], &c, 1) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+  }
+  for (int fd : {inotify_fd_, stop_pipe_[0], stop_pipe_[1]}) {
+    if (fd >= 0)
+      close(fd);
+  }
+}
+
+bool IndexWatcher::start() {
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0 || pipe2(stop_pipe_, O_CLOEXEC) != 0) {
+    return false;
+  }
+  if (!watch_tree(root_)) {
+    return false;
+  }
+  thread_ = std::thread([this] { run(); });
+  return true;
+}
+
+void IndexWatcher::run() {
+  // Anything that changed between the crawl and the watches going up has no
+  // events, so start with a rescan against the manifest
+  index_ = serving_->snapshot()->thaw();
+  rescan_ = true;
+  first_mark_ = last_mark_ = Clock::now();
+
+  struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+  while (true) {
+    bool dirty = rescan_ || !pending_.empty();
+    int timeout = -1;
+    if (dirty) {
+      auto due = std::min(last_mark_ + kSettleDelay, first_mark_ + kMaxDelay);
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+          due - Clock::now());
+      timeout = static_cast<int>(std::max<int64_t>(wait.count(), 0));
+    }
+
+    int ready = poll(fds, 2, timeout);
+    if (ready < 0 && errno != EINTR) {
+      cerr << "Warning: stopped watching " << root_ << ": poll() failed"
+           << endl;
+      return;
+    }
+    if (ready > 0 && fds[1].revents != 0) {
+      return;
+    }
+    if (ready > 0 && fds[0].revents != 0) {
+      read_events();
+    }
+
+    // checked even while events keep coming, so that kMaxDelay holds
+    dirty = rescan_ || !pending_.empty();
+    auto now = Clock::now();
+    if (dirty && (now >= last_mark_ + kSettleDelay ||
+                  now >= first_mark_ + kMaxDelay)) {
+      flush();
+    }
+  }
+}
+
+void IndexWatcher::read_events() {
+  alignas(struct inotify_event) char buf[4096];
+  while (true) {
+    ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+    if (len <= 0) {
+      // EAGAIN: the queue is drained
+      return;
+    }
+    for (char* p = buf; p < buf + len;) {
+      auto* ev = reinterpret_cast<struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + ev->len;
+
+      if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+        // events were dropped, so there's no telling what changed
+        rescan_ = true;
+        mark(root_);
+        continue;
+      }
+      auto it = watches_.find(ev->wd);
+      if (it == watches_.end()) {
+        continue;
+      }
+      if ((ev->mask & IN_IGNORED) != 0) {
+        // the directory is gone, or unwatch_tree() removed its watch
+        watches_.erase(it);
+        continue;
+      }
+
+      // ev->name is nul padded to ev->len
+      string path = it->second;
+      if (ev->len > 0) {
+        path += "/";
+        path += ev->name;
+      }
+      if ((ev->mask & IN_ISDIR) != 0) {
+        // the watch on a directory that is moved away keeps following it, so
+        // drop it and watch the directory again under the name it moves to
+        if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+          watch_tree(path);
+        } else if ((ev->mask & IN_MOVED_FROM) != 0) {
+          unwatch_tree(path);
+        }
+      }
+      mark(std::move(path));
+    }
+  }
+}
+
+bool IndexWatcher::watch_tree(const string& dir) {
+  int wd = inotify_add_watch(inotify_fd_, dir.c_str(), kWatchMask);
+  if (wd < 0) {
+    if (errno == ENOSPC && !out_of_watches_) {
+      out_of_watches_ = true;
+      cerr << "Warning: out of inotify watches (see "
+           << "/proc/sys/fs/inotify/max_user_watches), changes under " << dir
+           << " and other new directories will not be picked up" << endl;
+    }
+    return false;
+  }
+  watches_[wd] = dir;
+
+  // a directory may already have subdirectories by the time it is watched;
+  // its files are picked up because the caller marks the whole directory
+  auto entries = readdir(dir);
+  if (!entries) {
+    return true;
+  }
+  for (auto& e : *entries) {
+    if (e.is_dir && e.name != "." && e.name != "..") {
+      watch_tree(dir + "/" + e.name);
+    }
+  }
+  return true;
+}
+
+void IndexWatcher::unwatch_tree(const string& dir) {
+  string prefix = dir + "/";
+  for (auto& [wd, path] : watches_) {
+    if (path == dir || path.rfind(prefix, 0) == 0) {
+      // the IN_IGNORED event this queues erases the entry
+      inotify_rm_watch(inotify_fd_, wd);
+    }
+  }
+}
+
+void IndexWatcher::mark(string path) {
+  auto now = Clock::now();
+  if (!rescan_ && pending_.empty()) {
+    first_mark_ = now;
+  }
+  last_mark_ = now;
+  pending_.insert(std::move(path));
+}
+
+void IndexWatcher::flush() {
+  CrawlChanges changes;
+  if (rescan_) {
+    auto full = update_filetree(root_, &index_, &manifest_, opts_);
+    if (!full) {
+      cerr << "Warning: cannot crawl directory " << root_ << endl;
+    } else {
+      changes = *full;
+    }
+  } else {
+    std::vector<string> paths(pending_.begin(), pending_.end());
+    changes = update_paths(paths, &index_, &manifest_, opts_);
+  }
+  pending_.clear();
+  rescan_ = false;
+
+  if (changes.added + changes.modified + changes.removed == 0) {
+    return;
+  }
+  serving_->publish(index_.freeze());
+  cout << "Reindexed: " << changes.added << " added, " << changes.modified
+       << " modified, " << changes.removed << " removed" << endl;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,122 @@
+#ifndef INDEX_WATCHER_H_
+#define INDEX_WATCHER_H_
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "./CrawlFileTree.hpp"
+#include "./ServingIndex.hpp"
+#include "./WordIndex.hpp"
+
+namespace searchserver {
+
+// Keeps a ServingIndex up to date with the files under the crawl root while
+// the server runs.
+//
+// The watcher puts an inotify watch on every directory under the root (and on
+// every directory created later) and collects the paths that events name.
+// Once events have stopped arriving for a moment (or have kept arriving for a
+// couple of seconds), it re-reads just those paths with update_paths(),
+// freezes the updated index and publishes it.  All of that happens on the
+// watcher's own thread, against its own mutable copy of the index, so queries
+// keep being served from the previous snapshot in the meantime.
+//
+// If the kernel drops events (its queue overflowed), the watcher falls back
+// to update_filetree() over the whole root, which still only reads the files
+// whose manifest stamps changed.
+//
+// Reading the changed files costs in proportion to the change: a few files
+// are read on the watcher's thread, without starting a crawl pool.  The rest
+// of a flush costs in proportion to the whole index: removing the old
+// postings of changed files is a pass over every posting list, and every
+// publish freezes the whole index again, copying every list.  Changes are
+// batched for that reason.  The mutable copy lives as long as the watcher,
+// so the index is held twice, once mutable and once frozen for serving.
+// Removed documents don't pile up in the mutable copy, see
+// WordIndex::remove_documents().
+class IndexWatcher {
+ public:
+  // Arguments:
+  //  - root: the directory the served index was crawled from, spelled the
+  //    same way as when it was crawled
+  //  - serving: where updated indexes are published
+  //  - manifest: the stamps of the files in the served index.  Files it is
+  //    missing or has outdated stamps for are indexed again when the watcher
+  //    starts, so an empty manifest works, but re-reads every file.
+  //  - opts: how to crawl changed files; opts.manifest, opts.stats and
+  //    opts.on_progress are not used
+  IndexWatcher(string root,
+               ServingIndex* serving,
+               Manifest manifest,
+               const CrawlOptions& opts);
+
+  // Stops the watcher thread, if it was started
+  ~IndexWatcher();
+
+  // Watches the tree and starts the watcher thread.  The thread first catches
+  // up on anything that changed since the served index was built.
+  //
+  // Returns: false if root can't be watched, in which case the served index
+  // is never updated
+  bool start();
+
+  // disallow copy and move, the watcher thread points back at it
+  IndexWatcher(const IndexWatcher& other) = delete;
+  IndexWatcher& operator=(const IndexWatcher& other) = delete;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // the watcher thread
+  void run();
+
+  // reads and handles every queued inotify event
+  void read_events();
+
+  // Adds a watch on dir and every directory under it.  Returns false if dir
+  // itself can't be watched.
+  bool watch_tree(const string& dir);
+
+  // removes the watches on dir and every directory under it
+  void unwatch_tree(const string& dir);
+
+  // notes that path (a file or directory) may have changed
+  void mark(string path);
+
+  // applies the marked changes to index_ and publishes the result; see the
+  // class comment for what that costs
+  void flush();
+
+  string root_;
+  ServingIndex* serving_;
+  Manifest manifest_;
+  CrawlOptions opts_;
+
+  // the watcher thread's mutable copy of the served index
+  WordIndex index_;
+
+  int inotify_fd_ = -1;
+  // written to by the destructor to wake the watcher thread up and stop it
+  int stop_pipe_[2] = {-1, -1};
+  std::thread thread_;
+
+  // watch descriptor -> the directory it watches
+  std::unordered_map<int, string> watches_;
+  // set once a watch failed for lack of inotify watches, so it's only
+  // reported once
+  bool out_of_watches_ = false;
+
+  // paths marked since the last flush(), and whether a full rescan is due
+  std::unordered_set<string> pending_;
+  bool rescan_ = false;
+  // when the first and the last of the pending changes were marked
+  Clock::time_point first_mark_;
+  Clock::time_point last_mark_;
+};
+
+}  // namespace searchserver
+
+#endif  // INDEX_WATCHER_H_
@@ -0,0 +1,287 @@
+#include "./PostingCodec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace searchserver {
+
+// number of bits needed to store v
+static unsigned bit_width(uint32_t v) {
+  return v == 0 ? 0 : 32 - __builtin_clz(v);
+}
+
+// loads 8 bytes as a little endian integer; packed data is a byte stream, so
+// this keeps decoding independent of the host byte order
+static uint64_t load_le64(const uint8_t* p) {
+  uint64_t v = 0;
+  std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+// appends n values of the given bit width to out, least significant bit first
+static void pack(const uint32_t* in,
+                 size_t n,
+                 unsigned bits,
+                 vector<uint8_t>* out) {
+  uint64_t acc = 0;
+  unsigned filled = 0;
+  for (size_t i = 0; i < n; i++) {
+    acc |= static_cast<uint64_t>(in[i]) << filled;
+    filled += bits;
+    while (filled >= 8) {
+      out->push_back(static_cast<uint8_t>(acc));
+      acc >>= 8;
+      filled -= 8;
+    }
+  }
+  if (filled > 0) {
+    out->push_back(static_cast<uint8_t>(acc));
+  }
+}
+
+// reads n values of the given bit width written by pack()
+static void unpack(const uint8_t* in, size_t n, unsigned bits, uint32_t* out) {
+  if (bits == 0) {
+    std::fill(out, out + n, 0);
+    return;
+  }
+  // bits <= 32 and the shift is < 8, so every value is inside one 8 byte load
+  uint64_t mask = (uint64_t{1} << bits) - 1;
+  size_t bitpos = 0;
+  for (size_t i = 0; i < n; i++, bitpos += bits) {
+    uint64_t word = load_le64(in + bitpos / 8);
+    out[i] = static_cast<uint32_t>((word >> (bitpos % 8)) & mask);
+  }
+}
+
+// number of bytes pack() produces for n values of the given width
+static size_t packed_size(size_t n, unsigned bits) {
+  return (n * bits + 7) / 8;
+}
+
+void encode_block(const DocId* docs,
+                  const uint32_t* counts,
+                  size_t n,
+                  DocId base,
+                  vector<uint8_t>* out) {
+  std::array<uint32_t, kBlockSize> deltas{};
+  std::array<uint32_t, kBlockSize> small_counts{};
+  uint32_t max_delta = 0;
+  uint32_t max_count = 0;
+  DocId prev = base;
+  for (size_t i = 0; i < n; i++) {
+    deltas[i] = docs[i] - prev;
+    prev = docs[i];
+    // every recorded count is at least one
+    small_counts[i] = counts[i] - 1;
+    max_delta = std::max(max_delta, deltas[i]);
+    max_count = std::max(max_count, small_counts[i]);
+  }
+
+  unsigned delta_bits = bit_width(max_delta);
+  unsigned count_bits = bit_width(max_count);
+  out->push_back(static_cast<uint8_t>(delta_bits));
+  out->push_back(static_cast<uint8_t>(count_bits));
+  pack(deltas.data(), n, delta_bits, out);
+  pack(small_counts.data(), n, count_bits, out);
+}
+
+void decode_block(const uint8_t* in,
+                  size_t n,
+                  DocId base,
+                  DocId* docs,
+                  uint32_t* counts) {
+  unsigned delta_bits = std::min<unsigned>(in[0], 32);
+  unsigned count_bits = std::min<unsigned>(in[1], 32);
+  in += 2;
+  unpack(in, n, delta_bits, docs);
+  unpack(in + packed_size(n, delta_bits), n, count_bits, counts);
+
+  // undo the delta and minus one encodings
+  DocId prev = base;
+  for (size_t i = 0; i < n; i++) {
+    prev += docs[i];
+    docs[i] = prev;
+    counts[i] += 1;
+  }
+}
+
+void encode_list(const DocId* docs,
+                 const uint32_t* counts,
+                 size_t n,
+                 vector<uint8_t>* out) {
+  size_t num_blocks = (n + kBlockSize - 1) / kBlockSize;
+  size_t start = out->size();
+  // the skip table is filled in as the blocks are written after it
+  size_t table = num_blocks > 1 ? 2 * num_blocks * sizeof(uint32_t) : 0;
+  out->resize(start + table);
+  DocId base = 0;
+  for (size_t b = 0; b < num_blocks; b++) {
+    size_t first = b * kBlockSize;
+    size_t block_n = std::min(kBlockSize, n - first);
+    if (table > 0) {
+      DocId last = docs[first + block_n - 1];
+      auto offset = static_cast<uint32_t>(out->size() - start);
+      std::memcpy(&(*out)[start + b * sizeof(DocId)], &last, sizeof(last));
+      std::memcpy(&(*out)[start + (num_blocks + b) * sizeof(uint32_t)],
+                  &offset, sizeof(offset));
+    }
+    encode_block(docs + first, counts + first, block_n, base, out);
+    base = docs[first + block_n - 1];
+  }
+}
+
+std::optional<CompressedPostingView> view_list(const uint8_t* data,
+                                               uint64_t data_size,
+                                               size_t n) {
+  size_t num_blocks = n / kBlockSize + (n % kBlockSize != 0);
+  if (num_blocks > 1 && num_blocks > data_size / (2 * sizeof(uint32_t))) {
+    return std::nullopt;
+  }
+  return CompressedPostingView{data, data_size, num_blocks, n};
+}
+
+bool CompressedPostingView::block_fits(size_t b) const {
+  uint64_t offset = block_offset(b);
+  if (offset > data_size || data_size - offset < 2) {
+    return false;
+  }
+  const uint8_t* in = data + offset;
+  if (in[0] > 32 || in[1] > 32) {
+    return false;
+  }
+  size_t n = block_size(b);
+  return packed_size(n, in[0]) + packed_size(n, in[1]) <=
+         data_size - offset - 2;
+}
+
+bool CompressedPostingView::decode(vector<DocId>* docs,
+                                   vector<uint32_t>* counts) const {
+  docs->resize(size);
+  counts->resize(size);
+  for (size_t b = 0; b < num_blocks; b++) {
+    if (!block_fits(b)) {
+      docs->clear();
+      counts->clear();
+      return false;
+    }
+    decode_block(data + block_offset(b), block_size(b), block_base(b),
+                 docs->data() + b * kBlockSize,
+                 counts->data() + b * kBlockSize);
+  }
+  return true;
+}
+
+// returns the first block of list at or after block lo whose last DocId is
+// >= target, or num_blocks, searching the skip table exponentially outward
+// from lo
+static size_t gallop(const CompressedPostingView& list,
+                     size_t lo,
+                     DocId target) {
+  size_t n = list.num_blocks;
+  size_t hi = lo;
+  size_t step = 1;
+  while (hi < n && list.last_doc(hi) < target) {
+    lo = hi + 1;
+    hi = lo + step;
+    step *= 2;
+  }
+  // binary search [lo, min(hi + 1, n)), which ends at a block >= target
+  size_t end = std::min(hi + 1, n);
+  while (lo < end) {
+    size_t mid = lo + (end - lo) / 2;
+    if (list.last_doc(mid) < target) {
+      lo = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return lo;
+}
+
+vector<Hit> intersect_compressed(vector<CompressedPostingView> lists) {
+  if (lists.empty())
+    return {};
+
+  // rarest list first: it bounds the size of the result
+  std::sort(lists.begin(), lists.end(),
+            [](auto& a, auto& b) { return a.size < b.size; });
+
+  vector<DocId> docs;
+  vector<uint32_t> counts;
+  if (!lists[0].decode(&docs, &counts)) {
+    return {};
+  }
+  vector<size_t> ranks(counts.begin(), counts.end());
+
+  vector<DocId> next_docs;
+  vector<uint32_t> next_counts;
+  vector<uint32_t> a_pos;
+  vector<uint32_t> b_pos;
+  std::array<DocId, kBlockSize> block_docs{};
+  std::array<uint32_t, kBlockSize> block_counts{};
+
+  for (size_t l = 1; l < lists.size() && !docs.empty(); l++) {
+    const CompressedPostingView& next = lists[l];
+    size_t n = 0;
+
+    if (next.size / docs.size() >= kGallopRatio) {
+      // probe the skip table for each candidate, only decoding blocks that
+      // might contain one
+      size_t block = 0;
+      size_t decoded = SIZE_MAX;
+      for (size_t i = 0; i < docs.size(); i++) {
+        DocId target = docs[i];
+        // a list of one block has no skip table: its only block is decoded
+        block = next.num_blocks > 1 ? gallop(next, block, target) : 0;
+        if (block == next.num_blocks)
+          break;
+        size_t block_n = next.block_size(block);
+        if (block != decoded) {
+          if (!next.block_fits(block)) {
+            return {};
+          }
+          decode_block(next.data + next.block_offset(block), block_n,
+                       next.block_base(block), block_docs.data(),
+                       block_counts.data());
+          decoded = block;
+        }
+        auto* end = block_docs.data() + block_n;
+        auto* it = std::lower_bound(block_docs.data(), end, target);
+        if (it != end && *it == target) {
+          docs[n] = target;
+          ranks[n] = ranks[i] + block_counts[it - block_docs.data()];
+          n++;
+        }
+      }
+    } else {
+      // comparable lengths: decode the list and merge against it
+      if (!next.decode(&next_docs, &next_counts)) {
+        return {};
+      }
+      a_pos.resize(docs.size());
+      b_pos.resize(docs.size());
+      n = intersect_blocks(docs.data(), docs.size(), next_docs.data(),
+                           next_docs.size(), a_pos.data(), b_pos.data());
+      for (size_t k = 0; k < n; k++) {
+        docs[k] = docs[a_pos[k]];
+        ranks[k] = ranks[a_pos[k]] + next_counts[b_pos[k]];
+      }
+    }
+    docs.resize(n);
+    ranks.resize(n);
+  }
+
+  vector<Hit> hits;
+  hits.reserve(docs.size());
+  for (size_t k = 0; k < docs.size(); k++) {
+    hits.push_back({docs[k], ranks[k]});
+  }
+  return hits;
+}
+
+}  // namespace searchserver
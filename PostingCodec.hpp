@@ -0,0 +1,149 @@
+#ifndef POSTING_CODEC_HPP_
+#define POSTING_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "./PostingList.hpp"
+
+using std::vector;
+
+namespace searchserver {
+
+// Block compression for posting lists.
+//
+// A posting list is cut into blocks of kBlockSize postings.  Inside a block
+// the DocIds are stored as deltas from the previous DocId (the first one as a
+// delta from the last DocId of the previous block, or from 0), and the counts
+// are stored minus one.  Each of the two arrays is then bit-packed with the
+// smallest width that fits its largest value:
+//
+//   [delta width: 1 byte][count width: 1 byte][packed deltas][packed counts]
+//
+// Most deltas and counts are tiny, so a block usually takes a few bits per
+// posting instead of 8 bytes.
+//
+// A list of more than one block starts with a skip table, so a lookup can
+// jump straight to the only block that could hold a given DocId and decode
+// just that one:
+//
+//   [last DocId of each block: 4 bytes each][offset of each block: 4 bytes
+//   each][blocks]
+//
+// Offsets are from the start of the list.  Most lists are a single block,
+// and those are stored as just that block: its offset is 0, and a lookup
+// decodes it anyway.
+
+// number of postings in every block but the last one of a list
+static constexpr size_t kBlockSize = 128;
+
+// Readers may load up to this many bytes past the end of the last block, so
+// encoded data must be followed by this much (zeroed) padding.
+static constexpr size_t kBlockPadding = 8;
+
+// Compresses one block of postings, appending it to out.
+//
+// Arguments:
+//  - docs / counts: the n (<= kBlockSize) postings of the block, docs sorted
+//  - n: the number of postings in the block
+//  - base: the last DocId of the previous block of the list, or 0
+//  - out: where the encoded block is appended
+void encode_block(const DocId* docs,
+                  const uint32_t* counts,
+                  size_t n,
+                  DocId base,
+                  vector<uint8_t>* out);
+
+// Decompresses one block written by encode_block().
+//
+// Arguments:
+//  - in: the start of the encoded block
+//  - n: the number of postings in the block
+//  - base: the same base the block was encoded with
+//  - docs / counts: output arrays with room for n entries
+void decode_block(const uint8_t* in,
+                  size_t n,
+                  DocId base,
+                  DocId* docs,
+                  uint32_t* counts);
+
+// Compresses a posting list into its skip table and blocks, appending them to
+// out.  Block offsets are 32 bits, which holds for lists of up to about 500
+// million postings (a block takes at most 1026 bytes).
+//
+// Arguments:
+//  - docs / counts: the n postings of the list, docs sorted
+//  - n: the number of postings
+//  - out: where the encoded list is appended
+void encode_list(const DocId* docs,
+                 const uint32_t* counts,
+                 size_t n,
+                 vector<uint8_t>* out);
+
+// Read-only view of a list written by encode_list()
+struct CompressedPostingView {
+  // the encoded list, followed by at least kBlockPadding readable bytes
+  const uint8_t* data;
+  // the number of bytes of the list at data, not counting the padding
+  uint64_t data_size;
+  // number of blocks
+  size_t num_blocks;
+  // number of postings
+  size_t size;
+
+  // number of postings in block b
+  size_t block_size(size_t b) const {
+    return b + 1 < num_blocks ? kBlockSize : size - b * kBlockSize;
+  }
+
+  // the last DocId of block b, from the skip table; only lists of more than
+  // one block have one
+  DocId last_doc(size_t b) const { return load32(b); }
+
+  // the byte offset of block b from data
+  uint64_t block_offset(size_t b) const {
+    return num_blocks > 1 ? load32(num_blocks + b) : 0;
+  }
+
+  // the base block b was encoded with
+  DocId block_base(size_t b) const { return b == 0 ? 0 : last_doc(b - 1); }
+
+  // Returns true if block b, as its offset and its header describe it, lies
+  // inside data_size.  A view of a mapped file checks a block with this
+  // before decoding it, since the file may be truncated or corrupt.
+  bool block_fits(size_t b) const;
+
+  // Decompresses the whole list into docs and counts (resized to fit).
+  //
+  // Returns: false, leaving docs and counts empty, if a block doesn't fit
+  bool decode(vector<DocId>* docs, vector<uint32_t>* counts) const;
+
+  // reads entry i of the skip table, which needn't be aligned
+  uint32_t load32(size_t i) const {
+    uint32_t v = 0;
+    std::memcpy(&v, data + i * sizeof(v), sizeof(v));
+    return v;
+  }
+};
+
+// Returns a view of the list of n postings that encode_list() wrote to the
+// data_size bytes at data, or nullopt if its skip table doesn't fit in them.
+std::optional<CompressedPostingView> view_list(const uint8_t* data,
+                                               uint64_t data_size,
+                                               size_t n);
+
+// Compressed counterpart of intersect_postings(), with the same result.
+//
+// The rarest list is decoded in full.  Lists that are much longer than the
+// remaining candidates are probed through their skip tables, decoding only the
+// blocks that can contain a candidate; lists of comparable length are decoded
+// and merged with intersect_blocks().  A list with a block that doesn't fit
+// (see block_fits()) matches nothing.
+vector<Hit> intersect_compressed(vector<CompressedPostingView> lists);
+
+}  // namespace searchserver
+
+#endif  // POSTING_CODEC_HPP_
@@ -0,0 +1,186 @@
+#include "./PostingList.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace searchserver {
+
+void PostingList::add(DocId doc, uint32_t count) {
+  // fast path: the crawler records all words of a document before moving on
+  // to the next one, so doc is either the last document or a new, larger one
+  if (docs_.empty() || docs_.back() < doc) {
+    docs_.push_back(doc);
+    counts_.push_back(count);
+    return;
+  }
+  auto it = std::lower_bound(docs_.begin(), docs_.end(), doc);
+  auto pos = it - docs_.begin();
+  if (it != docs_.end() && *it == doc) {
+    counts_[pos] += count;
+    return;
+  }
+  docs_.insert(it, doc);
+  counts_.insert(counts_.begin() + pos, count);
+}
+
+void PostingList::renumber(const vector<DocId>& new_id) {
+  size_t kept = 0;
+  for (size_t i = 0; i < docs_.size(); i++) {
+    DocId doc = docs_[i] < new_id.size() ? new_id[docs_[i]] : docs_[i];
+    if (doc == kNoDoc)
+      continue;
+    docs_[kept] = doc;
+    counts_[kept] = counts_[i];
+    kept++;
+  }
+  docs_.resize(kept);
+  counts_.resize(kept);
+}
+
+vector<Hit> intersect_postings(vector<PostingView> lists) {
+  if (lists.empty())
+    return {};
+
+  // rarest list first: it bounds the size of the result
+  std::sort(lists.begin(), lists.end(),
+            [](auto& a, auto& b) { return a.size < b.size; });
+
+  const PostingView& rarest = lists[0];
+  vector<DocId> docs(rarest.docs, rarest.docs + rarest.size);
+  vector<size_t> ranks(rarest.counts, rarest.counts + rarest.size);
+  vector<uint32_t> a_pos(docs.size());
+  vector<uint32_t> b_pos(docs.size());
+
+  for (size_t l = 1; l < lists.size() && !docs.empty(); l++) {
+    const PostingView& next = lists[l];
+    size_t n = 0;
+    if (next.size / docs.size() >= kGallopRatio) {
+      n = intersect_galloping(docs.data(), docs.size(), next.docs, next.size,
+                              a_pos.data(), b_pos.data());
+    } else {
+      n = intersect_blocks(docs.data(), docs.size(), next.docs, next.size,
+                           a_pos.data(), b_pos.data());
+    }
+
+    // compact the candidates in place; a_pos is increasing so k <= a_pos[k]
+    for (size_t k = 0; k < n; k++) {
+      docs[k] = docs[a_pos[k]];
+      ranks[k] = ranks[a_pos[k]] + next.counts[b_pos[k]];
+    }
+    docs.resize(n);
+    ranks.resize(n);
+  }
+
+  vector<Hit> hits;
+  hits.reserve(docs.size());
+  for (size_t k = 0; k < docs.size(); k++) {
+    hits.push_back({docs[k], ranks[k]});
+  }
+  return hits;
+}
+
+size_t intersect_galloping(const DocId* a,
+                           size_t na,
+                           const DocId* b,
+                           size_t nb,
+                           uint32_t* a_pos,
+                           uint32_t* b_pos) {
+  size_t k = 0;
+  size_t lo = 0;
+  for (size_t i = 0; i < na && lo < nb; i++) {
+    DocId target = a[i];
+
+    // exponential search for a window of b that must contain target, every
+    // element before lo is known to be smaller than target
+    size_t hi = lo;
+    size_t step = 1;
+    while (hi < nb && b[hi] < target) {
+      lo = hi + 1;
+      hi = lo + step;
+      step *= 2;
+    }
+
+    // then binary search inside that window
+    size_t end = std::min(hi + 1, nb);
+    lo = std::lower_bound(b + lo, b + end, target) - b;
+    if (lo < nb && b[lo] == target) {
+      a_pos[k] = static_cast<uint32_t>(i);
+      b_pos[k] = static_cast<uint32_t>(lo);
+      k++;
+      lo++;
+    }
+  }
+  return k;
+}
+
+size_t intersect_blocks(const DocId* a,
+                        size_t na,
+                        const DocId* b,
+                        size_t nb,
+                        uint32_t* a_pos,
+                        uint32_t* b_pos) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+
+#if defined(__SSE2__)
+  // Compare blocks of 4 ids from each list all-against-all, by rotating one
+  // block through every lane.  Both lists are strictly increasing, so the
+  // n'th match found in the a block pairs with the n'th match in the b block.
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+    __m128i b1 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+    __m128i b2 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i b3 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3));
+    __m128i in_b = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, b1)),
+        _mm_or_si128(_mm_cmpeq_epi32(va, b2), _mm_cmpeq_epi32(va, b3)));
+
+    __m128i a1 = _mm_shuffle_epi32(va, _MM_SHUFFLE(0, 3, 2, 1));
+    __m128i a2 = _mm_shuffle_epi32(va, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i a3 = _mm_shuffle_epi32(va, _MM_SHUFFLE(2, 1, 0, 3));
+    __m128i in_a = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(vb, va), _mm_cmpeq_epi32(vb, a1)),
+        _mm_or_si128(_mm_cmpeq_epi32(vb, a2), _mm_cmpeq_epi32(vb, a3)));
+
+    unsigned a_mask = _mm_movemask_ps(_mm_castsi128_ps(in_b));
+    unsigned b_mask = _mm_movemask_ps(_mm_castsi128_ps(in_a));
+    while (a_mask != 0) {
+      a_pos[k] = static_cast<uint32_t>(i + __builtin_ctz(a_mask));
+      b_pos[k] = static_cast<uint32_t>(j + __builtin_ctz(b_mask));
+      k++;
+      a_mask &= a_mask - 1;
+      b_mask &= b_mask - 1;
+    }
+
+    // advance whichever block ends first (or both if they end together)
+    DocId a_max = a[i + 3];
+    DocId b_max = b[j + 3];
+    if (a_max <= b_max)
+      i += 4;
+    if (b_max <= a_max)
+      j += 4;
+  }
+#endif
+
+  // scalar merge for the tails (or everything, without SSE2)
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      a_pos[k] = static_cast<uint32_t>(i++);
+      b_pos[k] = static_cast<uint32_t>(j++);
+      k++;
+    }
+  }
+  return k;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,142 @@
+#ifndef POSTING_LIST_HPP_
+#define POSTING_LIST_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+namespace searchserver {
+
+// Compact identifier of a document inside a WordIndex.  Ids are handed out
+// densely starting at 0 in the order documents are first added.
+using DocId = uint32_t;
+
+// Stands for no document, e.g. one that was removed
+static constexpr DocId kNoDoc = UINT32_MAX;
+
+// Once a list is this many times longer than the current candidate set it is
+// cheaper to skip through it than to merge against it.
+static constexpr size_t kGallopRatio = 32;
+
+// A document matching a lookup, along with its rank (the summed number of
+// occurances of the looked up words in that document)
+struct Hit {
+  DocId doc;
+  size_t rank;
+};
+
+// Read-only view of a posting list: an array of DocIds sorted in increasing
+// order, and a parallel array with the number of occurances of the word in
+// each of those documents.
+struct PostingView {
+  const DocId* docs;
+  const uint32_t* counts;
+  size_t size;
+};
+
+// The list of documents a word shows up in, kept sorted by DocId so that
+// lists can be intersected without hashing.
+class PostingList {
+ public:
+  PostingList() = default;
+
+  // Record count more occurances of the word in the document doc.
+  //
+  // Appending is O(1) as long as documents are recorded in increasing DocId
+  // order (which is what the crawler does), anything else falls back to an
+  // O(n) sorted insert.
+  void add(DocId doc, uint32_t count = 1);
+
+  // Replaces every document d by new_id[d], dropping it if that is kNoDoc.
+  // new_id must keep the documents it keeps in the same order, so that the
+  // list stays sorted.
+  void renumber(const vector<DocId>& new_id);
+
+  // Returns the number of documents in the list
+  size_t size() const { return docs_.size(); }
+
+  // Returns a view of the list, valid until the next call to add()
+  PostingView view() const { return {docs_.data(), counts_.data(), size()}; }
+
+ private:
+  vector<DocId> docs_;
+  vector<uint32_t> counts_;
+};
+
+// Intersects the posting lists of every word in a query.
+//
+// Lists are processed from rarest to most common, so the work done is
+// proportional to the length of the rarest list: each further list is
+// either galloped through (when it is much longer than the current
+// candidates) or merged with a SIMD block kernel (when the lengths are
+// comparable).
+//
+// Arguments:
+//  - lists: the posting lists of each query word
+//
+// Returns:
+//  - every document present in all lists, in increasing DocId order, with a
+//    rank that is the sum of the counts across the lists
+vector<Hit> intersect_postings(vector<PostingView> lists);
+
+// Keeps only the window [offset, offset + k) of hits in the order given by
+// better, leaving that window sorted.
+//
+// This is a partial selection: O(n) to find the window and O(k log k) to sort
+// it, rather than sorting every hit when only one page is wanted.
+//
+// Arguments:
+//  - hits: the hits to select from, replaced by the selected window
+//  - offset: the number of best hits to skip
+//  - k: the maximum number of hits to keep
+//  - better: strict weak ordering, true if its first argument ranks higher
+template <typename Compare>
+void select_window(vector<Hit>* hits,
+                   size_t offset,
+                   size_t k,
+                   Compare better) {
+  if (offset >= hits->size()) {
+    hits->clear();
+    return;
+  }
+  size_t end = hits->size() - offset > k ? offset + k : hits->size();
+
+  auto first = hits->begin();
+  if (end < hits->size()) {
+    std::nth_element(first, first + end, hits->end(), better);
+  }
+  if (offset > 0) {
+    std::nth_element(first, first + offset, first + end, better);
+  }
+  std::sort(first + offset, first + end, better);
+
+  hits->resize(end);
+  hits->erase(hits->begin(), hits->begin() + offset);
+}
+
+// Lower level kernels used by intersect_postings(), exposed for testing.
+//
+// Both find the values present in both the sorted arrays a and b, and for the
+// k'th match store its position in a at a_pos[k] and its position in b at
+// b_pos[k]; a_pos and b_pos must have room for min(na, nb) entries.
+//
+// Returns: the number of matches
+size_t intersect_galloping(const DocId* a,
+                           size_t na,
+                           const DocId* b,
+                           size_t nb,
+                           uint32_t* a_pos,
+                           uint32_t* b_pos);
+size_t intersect_blocks(const DocId* a,
+                        size_t na,
+                        const DocId* b,
+                        size_t nb,
+                        uint32_t* a_pos,
+                        uint32_t* b_pos);
+
+}  // namespace searchserver
+
+#endif  // POSTING_LIST_HPP_
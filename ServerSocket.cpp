@@ -11,7 +11,10 @@
 
 #include <arpa/inet.h>   // for inet_ntop()
 #include <netdb.h>       // for getaddrinfo()
+#include <netinet/in.h>  // for IPPROTO_TCP
+#include <netinet/tcp.h> // for TCP_NODELAY, TCP_DEFER_ACCEPT
 #include <sys/socket.h>  // for socket(), getaddrinfo(), etc.
+#include <fcntl.h>       // for fcntl()
 #include <sys/types.h>   // for socket(), getaddrinfo(), etc.
 #include <unistd.h>      // for close(), fcntl()
 #include <cerrno>        // for errno, used by strerror()
@@ -28,7 +31,8 @@ namespace searchserver {
 
 ServerSocket::ServerSocket(sa_family_t family,
                            const string& address,
-                           uint16_t port)
+                           uint16_t port,
+                           const ListenOptions& options)
     : port_(port), listen_sock_fd_() {
   // TODO:
   // - create a stream socket
@@ -69,6 +73,14 @@ ServerSocket::ServerSocket(sa_family_t family,
 
     int opt = 1;
     setsockopt(listen_sock_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // every socket sharing the port has to ask for it before binding
+    if (options.reuse_port &&
+        setsockopt(listen_sock_fd_, SOL_SOCKET, SO_REUSEPORT, &opt,
+                   sizeof(opt)) != 0) {
+      close(listen_sock_fd_);
+      listen_sock_fd_ = -1;
+      continue;
+    }
 
     if (bind(listen_sock_fd_, p->ai_addr, p->ai_addrlen) == 0) {
       // success
@@ -83,8 +95,18 @@ ServerSocket::ServerSocket(sa_family_t family,
     throw runtime_error("Failed to bind to " + address + ":" + port_str);
   }
 
+  // Both options are only hints: a server without them still works
+  int opt = 1;
+  if (options.no_delay) {
+    setsockopt(listen_sock_fd_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  }
+  if (options.defer_accept_s > 0) {
+    setsockopt(listen_sock_fd_, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+               &options.defer_accept_s, sizeof(options.defer_accept_s));
+  }
+
   // Start listening
-  if (listen(listen_sock_fd_, SOMAXCONN) < 0) {
+  if (listen(listen_sock_fd_, options.backlog) < 0) {
     close(listen_sock_fd_);
     throw runtime_error(string("listen: ") + strerror(errno));
   }
@@ -99,15 +121,23 @@ ServerSocket::~ServerSocket() {
   listen_sock_fd_ = -1;
 }
 
-optional<HttpSocket> ServerSocket::accept_client() const {
+bool ServerSocket::set_nonblocking() {
+  int flags = fcntl(listen_sock_fd_, F_GETFL);
+  return flags != -1 &&
+         fcntl(listen_sock_fd_, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+optional<HttpSocket> ServerSocket::accept_client(bool nonblocking) const {
   // TODO accept the next client connection and return it as an HttpSocket
   // object nullopt on error
   // Accept a client and wrap in HttpSocket
   struct sockaddr_storage client_addr {};
   socklen_t client_len = sizeof(client_addr);
+  // the flags save the fcntl() calls a loop would otherwise make per client
+  int flags = SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0);
   int client_fd =
-      accept(listen_sock_fd_, reinterpret_cast<struct sockaddr*>(&client_addr),
-             &client_len);
+      accept4(listen_sock_fd_, reinterpret_cast<struct sockaddr*>(&client_addr),
+              &client_len, flags);
   if (client_fd < 0) {
     return std::nullopt;  // error accepting
   }
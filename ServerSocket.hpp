@@ -0,0 +1,83 @@
+/*
+ * Copyright ©2025 Travis McGaha.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Pennsylvania
+ * CIT 5950 for use solely during Spring Semester 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef SERVERSOCKET_HPP_
+#define SERVERSOCKET_HPP_
+
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "./HttpSocket.hpp"
+
+namespace searchserver {
+
+// How a ServerSocket listens
+struct ListenOptions {
+  // length of the queue of connections waiting to be accepted
+  int backlog = SOMAXCONN;
+  // share the port with other sockets that set this too (SO_REUSEPORT); the
+  // kernel spreads new connections across them, so each can have an accept
+  // loop of its own
+  bool reuse_port = false;
+  // send small responses right away instead of waiting to coalesce them
+  // (TCP_NODELAY); accepted connections inherit this from the listener
+  bool no_delay = false;
+  // if nonzero, only report a connection once the client has sent data, or
+  // after about this many seconds (TCP_DEFER_ACCEPT)
+  int defer_accept_s = 0;
+};
+
+// A listening TCP socket that accepts HTTP clients
+class ServerSocket {
+ public:
+  // Binds to address:port and starts listening.  Throws if that fails.
+  ServerSocket(sa_family_t family,
+               const std::string& address,
+               uint16_t port,
+               const ListenOptions& options = {});
+
+  // Stops listening
+  ~ServerSocket();
+
+  // Accepts the next client connection.  Blocks, unless the socket was made
+  // non-blocking, in which case it returns nullopt when no client is waiting.
+  //
+  // Arguments:
+  //  - nonblocking: whether the connection is non-blocking, for an event
+  //    loop, or blocking, for next_request() and write_response().  Either
+  //    way it is close-on-exec.
+  //
+  // Returns: the connection, or nullopt on error, with errno set by accept()
+  std::optional<HttpSocket> accept_client(bool nonblocking = false) const;
+
+  // Puts the listening socket in non-blocking mode, for an event loop.
+  //
+  // Returns: false on error
+  bool set_nonblocking();
+
+  // Returns the listening socket's file descriptor
+  int fd() const { return listen_sock_fd_; }
+
+  // not copyable: the socket has one owner
+  ServerSocket(const ServerSocket& other) = delete;
+  ServerSocket& operator=(const ServerSocket& other) = delete;
+
+ private:
+  uint16_t port_;
+  int listen_sock_fd_;
+};
+
+}  // namespace searchserver
+
+#endif  // SERVERSOCKET_HPP_
@@ -0,0 +1,84 @@
+#include "./ServingIndex.hpp"
+
+#include <chrono>
+#include <thread>
+#include <utility>
+
+namespace searchserver {
+
+// source of ServingIndex::id_
+static std::atomic<uint64_t> next_id{1};
+
+// The calling thread's slot in each ServingIndex it has read from, by id.
+// There is hardly ever more than one, so a linear search is the fastest.
+static thread_local std::vector<std::pair<uint64_t, void*>> slot_cache;
+
+ServingIndex::ServingIndex(FrozenWordIndex index)
+    : id_(next_id.fetch_add(1)),
+      current_(new FrozenWordIndex(std::move(index))) {}
+
+ServingIndex::~ServingIndex() {
+  delete current_.load();
+}
+
+ServingIndex::Snapshot ServingIndex::snapshot() const {
+  Slot* slot = thread_slot();
+  if (slot->depth++ == 0) {
+    // Announce the epoch before loading current_.  The fence pairs with the
+    // one in publish(): either publish() sees this slot pinned, or this load
+    // sees the generation it swapped in.
+    slot->pinned.store(epoch_.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  return Snapshot(slot, current_.load(std::memory_order_acquire));
+}
+
+ServingIndex::Snapshot::~Snapshot() {
+  if (--slot_->depth == 0) {
+    // release: every read of the generation happens before it may be freed
+    slot_->pinned.store(kIdle, std::memory_order_release);
+  }
+}
+
+void ServingIndex::publish(FrozenWordIndex index) {
+  auto* next = new FrozenWordIndex(std::move(index));
+  std::lock_guard<std::mutex> guard(publish_lock_);
+
+  const FrozenWordIndex* old = current_.exchange(next);
+  // readers that announce this epoch or a later one load next (or newer)
+  uint64_t epoch = epoch_.fetch_add(1) + 1;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  // wait out the readers that may still have old; they are in the middle of
+  // one query, so this takes about as long as a query does
+  std::vector<Slot*> slots;
+  {
+    std::lock_guard<std::mutex> slots_guard(slots_lock_);
+    for (auto& slot : slots_) {
+      slots.push_back(slot.get());
+    }
+  }
+  for (Slot* slot : slots) {
+    while (true) {
+      uint64_t pinned = slot->pinned.load(std::memory_order_acquire);
+      if (pinned == kIdle || pinned >= epoch)
+        break;
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  delete old;
+}
+
+ServingIndex::Slot* ServingIndex::thread_slot() const {
+  for (auto& [owner, slot] : slot_cache) {
+    if (owner == id_)
+      return static_cast<Slot*>(slot);
+  }
+  std::lock_guard<std::mutex> guard(slots_lock_);
+  slots_.push_back(std::make_unique<Slot>());
+  slot_cache.emplace_back(id_, slots_.back().get());
+  return slots_.back().get();
+}
+
+}  // namespace searchserver
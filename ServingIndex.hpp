@@ -0,0 +1,103 @@
+#ifndef SERVING_INDEX_H_
+#define SERVING_INDEX_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "./FrozenWordIndex.hpp"
+
+namespace searchserver {
+
+// The index queries are served from, which can be replaced while queries run.
+//
+// Publication works like RCU: the current generation of the index is a plain
+// atomic pointer, and every generation is immutable.  A reader pins the
+// generation it loads by announcing the epoch it started in, in a slot of its
+// own, and unpins it when done; neither step takes a lock or does an atomic
+// read-modify-write, so readers on different cores never contend.  publish()
+// swaps in the new generation, moves to a new epoch and waits until no
+// reader is still pinned in an epoch from before the swap, then frees the old
+// generation.  All of the waiting and freeing happens on the publishing
+// thread, so queries run at full speed while a new generation goes live.
+class ServingIndex {
+ private:
+  struct Slot;
+
+ public:
+  // A pinned generation of the index, valid until the Snapshot is destroyed.
+  // Snapshots are cheap and meant to live for one query; a thread may hold
+  // several at once (inner ones may see a newer generation).
+  class Snapshot {
+   public:
+    ~Snapshot();
+
+    const FrozenWordIndex& operator*() const { return *index_; }
+    const FrozenWordIndex* operator->() const { return index_; }
+
+    // disallow copy and move, the pin belongs to the creating thread
+    Snapshot(const Snapshot& other) = delete;
+    Snapshot& operator=(const Snapshot& other) = delete;
+
+   private:
+    friend class ServingIndex;
+    Snapshot(Slot* slot, const FrozenWordIndex* index)
+        : slot_(slot), index_(index) {}
+
+    Slot* slot_;
+    const FrozenWordIndex* index_;
+  };
+
+  // Starts out serving index
+  explicit ServingIndex(FrozenWordIndex index);
+
+  // Frees the current generation; no Snapshot may outlive the ServingIndex
+  ~ServingIndex();
+
+  // Pins and returns the generation currently being served
+  Snapshot snapshot() const;
+
+  // Replaces the index being served with index, then waits for the readers of
+  // the old generation to finish and frees it.  Publishers are serialized.
+  // Must not be called by a thread that holds a Snapshot, which it would wait
+  // on forever.
+  void publish(FrozenWordIndex index);
+
+  // disallow copy and move, snapshots point back into it
+  ServingIndex(const ServingIndex& other) = delete;
+  ServingIndex& operator=(const ServingIndex& other) = delete;
+
+ private:
+  // A reader thread's announcement of the epoch it is reading in, on a cache
+  // line of its own so readers don't slow each other down.
+  struct alignas(64) Slot {
+    // the epoch the thread pinned a generation in, or kIdle
+    std::atomic<uint64_t> pinned{kIdle};
+    // number of Snapshots the thread holds; only touched by that thread
+    size_t depth = 0;
+  };
+  static constexpr uint64_t kIdle = 0;
+
+  // returns the calling thread's slot, registering one on first use
+  Slot* thread_slot() const;
+
+  // tells registered ServingIndexes apart in the per-thread slot cache
+  const uint64_t id_;
+
+  std::atomic<const FrozenWordIndex*> current_;
+  // bumped by every publish(); starts above kIdle
+  std::atomic<uint64_t> epoch_{kIdle + 1};
+
+  // serializes publish() calls
+  std::mutex publish_lock_;
+  // guards slots_, which only grows: a thread keeps its slot for the life of
+  // the ServingIndex
+  mutable std::mutex slots_lock_;
+  mutable std::vector<std::unique_ptr<Slot>> slots_;
+};
+
+}  // namespace searchserver
+
+#endif  // SERVING_INDEX_H_
@@ -9,101 +9,656 @@
  * author.
  */
 
+#include <sched.h>
 #include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "./ThreadPool.hpp"
 
 namespace searchserver {
 
+// Rounds an idle worker looks for work before it parks
+static constexpr int kSpinRounds = 64;
+
+// Most tasks a worker moves from the normal lane onto its own deque at once,
+// besides the one it runs.  High priority tasks are taken one at a time, so
+// none of them waits behind another worker's deque.
+static constexpr size_t kMaxInjectBatch = 32;
+
+// Slots a worker's deque starts with; it doubles when full
+static constexpr int64_t kInitialCapacity = 256;
+
+// Tells the CPU this is a spin loop, so a hyperthread sibling gets the core
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// Returns the time tasks are timed with, in nanoseconds
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// A task, as the deques see it
+using Work = ThreadPool::Work;
+using Histogram = ThreadPool::Histogram;
+
+// Words in a Work
+static constexpr size_t kWorkWords = sizeof(Work) / sizeof(uintptr_t);
+static_assert(sizeof(Work) % sizeof(uintptr_t) == 0);
+static_assert(std::is_trivially_copyable_v<Work>);
+
+// One slot of a TaskDeque.  A thief can read a slot while the owner writes it
+// (it then loses the race for the slot and throws what it read away), so the
+// task is kept as atomic words, read and written relaxed.
+struct TaskSlot {
+  std::array<std::atomic<uintptr_t>, kWorkWords> words{};
+};
+
+// The circular array of a TaskDeque
+struct TaskRing {
+  explicit TaskRing(int64_t cap) : capacity(cap), slots(new TaskSlot[cap]) {}
+
+  void put(int64_t i, const Work& work) {
+    std::array<uintptr_t, kWorkWords> words;
+    std::memcpy(words.data(), &work, sizeof(work));
+    TaskSlot& slot = slots[i & (capacity - 1)];
+    for (size_t w = 0; w < kWorkWords; w++) {
+      slot.words[w].store(words[w], std::memory_order_relaxed);
+    }
+  }
+
+  Work get(int64_t i) const {
+    std::array<uintptr_t, kWorkWords> words;
+    const TaskSlot& slot = slots[i & (capacity - 1)];
+    for (size_t w = 0; w < kWorkWords; w++) {
+      words[w] = slot.words[w].load(std::memory_order_relaxed);
+    }
+    Work work;
+    std::memcpy(&work, words.data(), sizeof(work));
+    return work;
+  }
+
+  // a power of two
+  int64_t capacity;
+  std::unique_ptr<TaskSlot[]> slots;
+};
+
+// A Chase-Lev work-stealing deque ("Dynamic Circular Work-Stealing Deque",
+// with the memory orders of Lê et al., "Correct and Efficient Work-Stealing
+// for Weak Memory Models").
+//
+// Its owner pushes and pops at the bottom without taking any lock; other
+// threads steal from the top, and only race with each other (and with the
+// owner, for the last task) through a compare-and-swap of top_.
+struct TaskDeque {
+  TaskDeque() {
+    rings_.push_back(std::make_unique<TaskRing>(kInitialCapacity));
+    ring_.store(rings_.back().get(), std::memory_order_relaxed);
+  }
+
+  // Owner only: adds t at the bottom
+  void push(const Work& work) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t_top = top_.load(std::memory_order_acquire);
+    TaskRing* ring = ring_.load(std::memory_order_relaxed);
+    if (b - t_top > ring->capacity - 1) {
+      ring = grow(ring, t_top, b);
+    }
+    ring->put(b, work);
+    // publishes the task to thieves, whose load of bottom_ acquires
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // Owner only: takes the task at the bottom.  Returns false if empty.
+  bool pop(Work* out) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    TaskRing* ring = ring_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    *out = ring->get(b);
+    if (t == b) {
+      // the last task: a thief may be after it too
+      bool won = top_.compare_exchange_strong(t, t + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread: takes the task at the top.  Returns false if empty.
+  bool steal(Work* out) {
+    while (true) {
+      int64_t t = top_.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t b = bottom_.load(std::memory_order_acquire);
+      if (t >= b) {
+        return false;
+      }
+      TaskRing* ring = ring_.load(std::memory_order_acquire);
+      Work task = ring->get(t);
+      if (top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        *out = task;
+        return true;
+      }
+      // another thief (or the owner) got it first; try the next one
+    }
+  }
+
+  // Returns true if the deque looks empty; exact only for the owner
+  bool empty() const {
+    return bottom_.load(std::memory_order_relaxed) <=
+           top_.load(std::memory_order_relaxed);
+  }
+
+  // Returns about how many tasks the deque holds; exact only for the owner
+  size_t size() const {
+    int64_t n = bottom_.load(std::memory_order_relaxed) -
+                top_.load(std::memory_order_relaxed);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+  }
+
+ private:
+  // Owner only: moves the tasks in [t, b) to a ring twice as big.  The old
+  // ring is kept until the deque goes away, since a thief may still be
+  // reading from it.
+  TaskRing* grow(TaskRing* old, int64_t t, int64_t b) {
+    rings_.push_back(std::make_unique<TaskRing>(old->capacity * 2));
+    TaskRing* ring = rings_.back().get();
+    for (int64_t i = t; i < b; i++) {
+      ring->put(i, old->get(i));
+    }
+    ring_.store(ring, std::memory_order_release);
+    return ring;
+  }
+
+  // thieves write top_ and the owner writes bottom_: keep them on separate
+  // cache lines
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<TaskRing*> ring_{nullptr};
+  // every ring the deque has had, the current one last
+  std::vector<std::unique_ptr<TaskRing>> rings_;
+};
+
+// What a worker has done.  Only the worker writes its counters, so it adds
+// to them with a plain load and store instead of a locked read-modify-write,
+// and stats() reads them from any thread.  They are on cache lines of their
+// own, away from the deque that thieves write to.
+struct alignas(64) WorkerCounters {
+  std::atomic<uint64_t> tasks{0};
+  std::atomic<uint64_t> steals{0};
+  std::atomic<uint64_t> busy_ns{0};
+  std::array<std::atomic<uint64_t>, Histogram::kBuckets> wait{};
+  std::array<std::atomic<uint64_t>, Histogram::kBuckets> run{};
+};
+
+// Adds n to a counter of the calling worker's own
+static void bump(std::atomic<uint64_t>* counter, uint64_t n = 1) {
+  counter->store(counter->load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+}
+
+struct ThreadPool::Worker {
+  Worker(ThreadPool* p, size_t i) : pool(p), index(i), rng(i * 2 + 1) {}
+
+  ThreadPool* pool;
+  size_t index;
+  pthread_t thread{};
+  // xorshift state for picking whom to steal from
+  uint64_t rng;
+  // tasks running on the worker, one inside the other when a task waits
+  // for others (see help_until())
+  int depth = 0;
+  // the CPU the worker is pinned to, or -1
+  std::atomic<int> cpu{-1};
+  TaskDeque deque;
+  WorkerCounters counters;
+};
+
+thread_local ThreadPool::Worker* ThreadPool::current_worker_ = nullptr;
+
 // This is the thread start routine, i.e., the function that threads
 // are born into.
-void* thread_loop(void* t_pool);
+void* thread_loop(void* t_worker);
 
-ThreadPool::ThreadPool(size_t num_threads)
-    : q_lock_(),
-      q_cond_(),
-      work_queue_(),
-      killthreads_(false),
-      num_threads_(num_threads),
-      thread_vec_(num_threads) {
-  // Initialize our member variables.
-
-  // TODO
-  pthread_mutex_init(&q_lock_, nullptr);
-  pthread_cond_init(&q_cond_, nullptr);
+ThreadPool::ThreadPool(size_t num_threads, size_t max_queued)
+    : num_threads_(std::max<size_t>(num_threads, 1)),
+      started_ns_(now_ns()),
+      max_queued_(max_queued) {
+  // Every worker exists before any thread starts, so that thieves can look
+  // at all of them
+  for (size_t i = 0; i < num_threads_; ++i) {
+    workers_.push_back(std::make_unique<Worker>(this, i));
+  }
 
   // Spawn worker threads
   for (size_t i = 0; i < num_threads_; ++i) {
-    if (pthread_create(&thread_vec_[i], nullptr, thread_loop, this) != 0) {
+    Worker* w = workers_[i].get();
+    if (pthread_create(&w->thread, nullptr, thread_loop, w) != 0) {
+      // stop the threads that did start before giving up
+      killthreads_.store(true);
+      {
+        std::lock_guard<std::mutex> guard(park_lock_);
+        park_cond_.notify_all();
+      }
+      for (size_t j = 0; j < i; ++j) {
+        pthread_join(workers_[j]->thread, nullptr);
+      }
       throw std::runtime_error("Failed to create thread");
     }
   }
 }
 
 ThreadPool::~ThreadPool() {
-  // TODO
-  // Signal threads to shutdown
-  pthread_mutex_lock(&q_lock_);
-  killthreads_ = true;
-  pthread_cond_broadcast(&q_cond_);
-  pthread_mutex_unlock(&q_lock_);
+  // Signal threads to shutdown; they run what is queued first
+  killthreads_.store(true);
+  {
+    std::lock_guard<std::mutex> guard(park_lock_);
+    park_cond_.notify_all();
+  }
 
   // Join all threads
-  for (pthread_t& tid : thread_vec_) {
-    pthread_join(tid, nullptr);
+  for (auto& w : workers_) {
+    pthread_join(w->thread, nullptr);
   }
+}
 
-  // Clean up
-  pthread_mutex_destroy(&q_lock_);
-  pthread_cond_destroy(&q_cond_);
+void WaitGroup::done() {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    cond_.notify_all();
+  }
+}
+
+void WaitGroup::wait() {
+  std::unique_lock<std::mutex> lock(lock_);
+  cond_.wait(lock, [this] { return finished(); });
 }
 
 // Enqueue a Task for dispatch.
 void ThreadPool::dispatch(Task t) {
-  // TODO
-  // Add task to queue and notify a worker
-  pthread_mutex_lock(&q_lock_);
-  work_queue_.push_back(t);
-  pthread_cond_signal(&q_cond_);
-  pthread_mutex_unlock(&q_lock_);
+  dispatch([t] { t.func_(t.arg_); });
 }
 
-// This is the main loop that all worker threads are born into.  They
-// wait for a signal on the work queue condition variable, then they
-// grab work off the queue.  Threads return (i.e., kill themselves)
-// when they notice that killthreads_ is true.
-void* thread_loop(void* t_pool) {
-  // TODO
-  // Recover the ThreadPool pointer
-  ThreadPool* pool = static_cast<ThreadPool*>(t_pool);
+void ThreadPool::wait(WaitGroup* group) {
+  Worker* w = current_worker_;
+  if (w != nullptr && w->pool == this) {
+    help_until(group);
+  }
+  // returns at once if the group is done, but not before done() has let go
+  // of it
+  group->wait();
+}
 
-  while (true) {
-    // 1. Lock the queue before touching shared data
-    pthread_mutex_lock(&pool->q_lock_);
+void ThreadPool::help_until(WaitGroup* group) {
+  Worker* w = current_worker_;
+  Work work{};
+  for (int idle = 0; !group->finished();) {
+    if (find_task(w, &work)) {
+      run(w, &work);
+      idle = 0;
+    } else if (++idle < kSpinRounds) {
+      cpu_relax();
+    } else {
+      // the last tasks are running elsewhere
+      std::this_thread::yield();
+    }
+  }
+}
 
-    // 2. Wait until there's either a task or a shutdown
-    while (pool->work_queue_.empty() && !pool->killthreads_) {
-      pthread_cond_wait(&pool->q_cond_, &pool->q_lock_);
+void ThreadPool::push(Work work) {
+  Worker* w = current_worker_;
+  if (w == nullptr || w->pool != this) {
+    inject(&lanes_[static_cast<size_t>(Priority::kNormal)], work);
+    return;
+  }
+  work.queued_ns_ = now_ns();
+  w->deque.push(work);
+  // Pairs with the fence in park(): either this sees the parked worker, or
+  // the worker sees the task before it goes to sleep
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_parked_.load(std::memory_order_relaxed) > 0) {
+    wake_one();
+  }
+}
+
+void ThreadPool::inject(Lane* lane, Work work) {
+  work.queued_ns_ = now_ns();
+  {
+    std::lock_guard<std::mutex> guard(lane->lock);
+    lane->push(work);
+  }
+  // as in push()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_parked_.load(std::memory_order_relaxed) > 0) {
+    wake_one();
+  }
+}
+
+void ThreadPool::Lane::push(const Work& work) {
+  size_t queued = size.load(std::memory_order_relaxed);
+  if (queued == ring.size()) {
+    // full: unroll the ring into one twice the size
+    std::vector<Work> bigger(std::max<size_t>(kInitialCapacity, 2 * queued));
+    for (size_t i = 0; i < queued; i++) {
+      bigger[i] = ring[(head + i) & (ring.size() - 1)];
     }
+    ring.swap(bigger);
+    head = 0;
+  }
+  ring[(head + queued) & (ring.size() - 1)] = work;
+  size.store(queued + 1, std::memory_order_relaxed);
+}
 
-    // 3. If we're shutting down and no tasks remain, clean up and exit
-    if (pool->killthreads_ && pool->work_queue_.empty()) {
-      pthread_mutex_unlock(&pool->q_lock_);
-      break;
+ThreadPool::Work ThreadPool::Lane::pop() {
+  Work work = ring[head];
+  head = (head + 1) & (ring.size() - 1);
+  size.store(size.load(std::memory_order_relaxed) - 1,
+             std::memory_order_relaxed);
+  return work;
+}
+
+bool ThreadPool::take_injected(Lane* lane,
+                               Worker* w,
+                               Work* task,
+                               size_t max_batch) {
+  if (lane->size.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::array<Work, kMaxInjectBatch> batch;
+  size_t moved = 0;
+  {
+    std::lock_guard<std::mutex> guard(lane->lock);
+    size_t queued = lane->size.load(std::memory_order_relaxed);
+    if (queued == 0) {
+      return false;
+    }
+    *task = lane->pop();
+    // take a fair share of the rest, so the lane isn't locked per task
+    moved = std::min({(queued - 1) / num_threads_, max_batch, kMaxInjectBatch});
+    for (size_t i = 0; i < moved; i++) {
+      batch[i] = lane->pop();
+    }
+  }
+  // the worker pops its deque from the bottom: push the batch in reverse, so
+  // that it still runs the oldest first
+  for (size_t i = moved; i > 0; i--) {
+    w->deque.push(batch[i - 1]);
+  }
+  // what this worker took on, a parked one can steal
+  if (moved > 0 && num_parked_.load(std::memory_order_relaxed) > 0) {
+    wake_one();
+  }
+  return true;
+}
+
+bool ThreadPool::steal(Worker* w, Work* task) {
+  if (num_threads_ == 1) {
+    return false;
+  }
+  // xorshift64
+  w->rng ^= w->rng << 13;
+  w->rng ^= w->rng >> 7;
+  w->rng ^= w->rng << 17;
+  size_t start = w->rng % num_threads_;
+  for (size_t i = 0; i < num_threads_; i++) {
+    Worker* victim = workers_[(start + i) % num_threads_].get();
+    if (victim != w && victim->deque.steal(task)) {
+      bump(&w->counters.steals);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::find_task(Worker* w, Work* task) {
+  Lane* high = &lanes_[static_cast<size_t>(Priority::kHigh)];
+  Lane* normal = &lanes_[static_cast<size_t>(Priority::kNormal)];
+  return take_injected(high, w, task, 0) || w->deque.pop(task) ||
+         take_injected(normal, w, task, kMaxInjectBatch) || steal(w, task);
+}
+
+bool ThreadPool::has_work() {
+  for (auto& lane : lanes_) {
+    if (lane.size.load(std::memory_order_relaxed) > 0) {
+      return true;
+    }
+  }
+  for (auto& w : workers_) {
+    if (!w->deque.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::wake_one() {
+  std::lock_guard<std::mutex> guard(park_lock_);
+  park_cond_.notify_one();
+}
+
+void ThreadPool::park() {
+  std::unique_lock<std::mutex> lock(park_lock_);
+  num_parked_.fetch_add(1, std::memory_order_relaxed);
+  // Pairs with the fence in dispatch(), see there.  Holding park_lock_ from
+  // here until wait() releases it means a wake_one() can't slip in between.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!killthreads_.load() && !has_work()) {
+    park_cond_.wait(lock);
+  }
+  num_parked_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ThreadPool::run(Worker* w, Work* task) {
+  WorkerCounters& counters = w->counters;
+  uint64_t start = now_ns();
+  uint64_t waited = start > task->queued_ns_ ? start - task->queued_ns_ : 0;
+  bump(&counters.wait[Histogram::bucket(waited)]);
+
+  // a task run while another waits for it is already busy time of the one
+  // waiting, so only the outermost counts towards busy_ns
+  bool outermost = w->depth++ == 0;
+  task->run_(task->storage_);
+  w->depth--;
+
+  uint64_t elapsed = now_ns() - start;
+  bump(&counters.run[Histogram::bucket(elapsed)]);
+  bump(&counters.tasks);
+  if (outermost) {
+    bump(&counters.busy_ns, elapsed);
+  }
+}
+
+bool ThreadPool::pin_workers(size_t first_cpu) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return false;
+  }
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty()) {
+    return false;
+  }
+
+  bool pinned = true;
+  for (auto& w : workers_) {
+    int cpu = cpus[(first_cpu + w->index) % cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(w->thread, sizeof(set), &set) == 0) {
+      w->cpu.store(cpu, std::memory_order_relaxed);
+    } else {
+      pinned = false;
+    }
+  }
+  return pinned;
+}
+
+ThreadPool::Stats ThreadPool::stats() const {
+  Stats stats;
+  stats.uptime_ns = now_ns() - started_ns_;
+  for (auto& lane : lanes_) {
+    stats.queued += lane.size.load(std::memory_order_relaxed);
+    stats.refused += lane.refused.load(std::memory_order_relaxed);
+  }
+  for (auto& w : workers_) {
+    const WorkerCounters& counters = w->counters;
+    stats.queued += w->deque.size();
+    for (size_t i = 0; i < Histogram::kBuckets; i++) {
+      stats.wait.counts[i] += counters.wait[i].load(std::memory_order_relaxed);
+      stats.run.counts[i] += counters.run[i].load(std::memory_order_relaxed);
+    }
+
+    WorkerStats worker;
+    worker.cpu = w->cpu.load(std::memory_order_relaxed);
+    worker.tasks = counters.tasks.load(std::memory_order_relaxed);
+    worker.steals = counters.steals.load(std::memory_order_relaxed);
+    worker.busy_ns = counters.busy_ns.load(std::memory_order_relaxed);
+    if (stats.uptime_ns > 0) {
+      worker.busy_ratio =
+          std::min(1.0, static_cast<double>(worker.busy_ns) / stats.uptime_ns);
     }
+    stats.workers.push_back(worker);
+  }
+  return stats;
+}
 
-    // 4. Otherwise grab the next task
-    auto task = pool->work_queue_.front();
-    pool->work_queue_.pop_front();
+size_t Histogram::bucket(uint64_t ns) {
+  return std::min<size_t>(std::bit_width(ns / 1000), kBuckets - 1);
+}
 
-    // 5. Unlock so others can add or take tasks
-    pthread_mutex_unlock(&pool->q_lock_);
+uint64_t Histogram::total() const {
+  uint64_t total = 0;
+  for (uint64_t count : counts) {
+    total += count;
+  }
+  return total;
+}
 
-    // 6. Run the task
-    task.func_(task.arg_);
+uint64_t Histogram::quantile_us(double p) const {
+  uint64_t n = total();
+  if (n == 0) {
+    return 0;
+  }
+  auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * n)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return upper_us(i);
+    }
+  }
+  return upper_us(kBuckets - 1);
+}
+
+std::string ThreadPool::Stats::to_json() const {
+  auto seconds = [](uint64_t ns) { return ns / 1e9; };
+  // quantiles, and the buckets that counted anything by their upper bound
+  auto histogram = [](std::ostringstream& out, const Histogram& h) {
+    out << "{\"count\": " << h.total() << ", \"p50\": " << h.quantile_us(0.5)
+        << ", \"p90\": " << h.quantile_us(0.9)
+        << ", \"p99\": " << h.quantile_us(0.99)
+        << ", \"max\": " << h.quantile_us(1) << ", \"buckets\": [";
+    bool first = true;
+    for (size_t i = 0; i < Histogram::kBuckets; i++) {
+      if (h.counts[i] == 0) {
+        continue;
+      }
+      out << (first ? "" : ", ") << "{\"le\": " << Histogram::upper_us(i)
+          << ", \"count\": " << h.counts[i] << "}";
+      first = false;
+    }
+    out << "]}";
+  };
+
+  uint64_t tasks = 0;
+  uint64_t steals = 0;
+  for (auto& worker : workers) {
+    tasks += worker.tasks;
+    steals += worker.steals;
+  }
+
+  std::ostringstream out;
+  out << "{\"uptime_s\": " << seconds(uptime_ns)
+      << ", \"threads\": " << workers.size() << ", \"queued\": " << queued
+      << ", \"refused\": " << refused << ", \"tasks\": " << tasks
+      << ", \"steals\": " << steals << ", \"wait_us\": ";
+  histogram(out, wait);
+  out << ", \"run_us\": ";
+  histogram(out, run);
+  out << ", \"workers\": [";
+  for (size_t i = 0; i < workers.size(); i++) {
+    out << (i == 0 ? "" : ", ") << "{\"cpu\": " << workers[i].cpu
+        << ", \"tasks\": " << workers[i].tasks
+        << ", \"steals\": " << workers[i].steals
+        << ", \"busy_s\": " << seconds(workers[i].busy_ns)
+        << ", \"busy_ratio\": " << workers[i].busy_ratio << "}";
+  }
+  out << "]}";
+  return out.str();
+}
+
+// This is the main loop that all worker threads are born into.  They
+// run high priority tasks first, then their own, then injected ones,
+// then stolen ones; when there are none, they spin for a while and then
+// park until a task is dispatched.  Threads return (i.e., kill
+// themselves) when they notice that killthreads_ is true and no task is
+// left anywhere.
+void* thread_loop(void* t_worker) {
+  auto* w = static_cast<ThreadPool::Worker*>(t_worker);
+  ThreadPool* pool = w->pool;
+  ThreadPool::current_worker_ = w;
+
+  Work task{};
+  while (true) {
+    bool found = pool->find_task(w, &task);
+    for (int i = 0; !found && i < kSpinRounds; i++) {
+      cpu_relax();
+      found = pool->find_task(w, &task);
+    }
+    if (found) {
+      ThreadPool::run(w, &task);
+      continue;
+    }
+
+    // Drain before exiting: tasks still running may dispatch more, but
+    // only onto their own worker's deque, which that worker then runs
+    if (pool->killthreads_.load() && !pool->has_work()) {
+      break;
+    }
+    pool->park();
   }
-  // 7. Clean up and exit
+  ThreadPool::current_worker_ = nullptr;
   return nullptr;
 }
 
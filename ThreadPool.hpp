@@ -0,0 +1,433 @@
+/*
+ * Copyright ©2025 Travis McGaha.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Pennsylvania
+ * CIT 5950 for use solely during Spring Semester 2025 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace searchserver {
+
+// Counts tasks that have yet to finish, so that a thread can wait for all of
+// them: add() before dispatching, done() at the end of each task, and
+// ThreadPool::wait() (or wait(), outside the pool) to wait.
+class WaitGroup {
+ public:
+  // Adds n tasks to wait for
+  void add(size_t n = 1) { pending_.fetch_add(n, std::memory_order_relaxed); }
+
+  // Marks one task as finished
+  void done();
+
+  // Returns true once every task added has finished
+  bool finished() const {
+    return pending_.load(std::memory_order_acquire) == 0;
+  }
+
+  // Blocks until every task added has finished.  A pool thread should use
+  // ThreadPool::wait() instead, which runs tasks meanwhile.
+  void wait();
+
+ private:
+  std::atomic<size_t> pending_{0};
+  // done() wakes wait() up under lock_, so that a group can be destroyed as
+  // soon as wait() returns
+  std::mutex lock_;
+  std::condition_variable cond_;
+};
+
+// A fixed set of worker threads that run Tasks.
+//
+// Tasks are scheduled by work stealing rather than through one shared queue:
+//  - every worker has a deque of its own.  A task dispatched from a worker
+//    goes on the bottom of that worker's deque, and the worker takes its
+//    tasks back from the bottom, without locking
+//  - a task dispatched from any other thread (an event loop, the crawler's
+//    directory walk) goes on a shared injection queue, which workers take
+//    tasks from in small batches
+//  - a worker with nothing of its own to run steals from the top of the
+//    deque of another, picked at random
+//
+// For admission control, try_dispatch() queues a task in one of two lanes
+// (injection queues) of bounded length, and refuses it when its lane is
+// full, so that a caller under load can turn work away instead of letting
+// the queue, and the wait, grow without bound.  Workers start every task in
+// the high priority lane before any other queued task, so cheap work isn't
+// held up behind a backlog of expensive work.
+//
+// A task is any callable taking no arguments, lambdas included.  One that is
+// small and trivially copyable (a lambda capturing a few pointers or numbers,
+// say) is stored right in the slot of the deque or queue it waits in, so
+// dispatching it allocates nothing; anything else is moved to the heap.
+//
+// An idle worker spins for a little while looking for work, and then parks
+// until a task is dispatched.  Destroying the pool runs every task that was
+// dispatched before the threads exit.
+//
+// Every worker counts what it does (tasks run, steals, time busy, and how
+// long tasks waited and ran) in counters only it writes, which stats() reads
+// without stopping it.
+class ThreadPool {
+ public:
+  // No limit on queued tasks
+  static constexpr size_t kUnbounded = SIZE_MAX;
+
+  // Starts num_threads workers, with room for max_queued tasks in each lane
+  // of try_dispatch().  Throws if a thread can't be created.
+  explicit ThreadPool(size_t num_threads, size_t max_queued = kUnbounded);
+
+  // Runs the tasks that are still queued and joins the workers
+  ~ThreadPool();
+
+  // A function for a worker to run, and the argument to pass it
+  struct Task {
+    void (*func_)(void*);
+    void* arg_;
+  };
+
+  // Bytes of captures a task can have and still be stored inline
+  static constexpr size_t kInlineSize = 4 * sizeof(void*);
+
+  // A task as the deques and the injection queue hold it, built by
+  // dispatch(): run_ is called with storage_, which holds either the
+  // callable itself or a pointer to it on the heap, and queued_ns_ is when
+  // it was queued.  It is copied around as plain words (see ThreadPool.cpp).
+  struct Work {
+    void (*run_)(void* storage);
+    uint64_t queued_ns_;
+    alignas(void*) unsigned char storage_[kInlineSize];
+  };
+
+  // Queues t to run on a worker.  Can be called from any thread, including
+  // from a task.
+  void dispatch(Task t);
+
+  // Queues f, a callable taking no arguments, to run on a worker.  f may be
+  // move-only.  Can be called from any thread, including from a task.
+  template <typename F>
+  void dispatch(F&& f);
+
+  // The lanes of try_dispatch()
+  enum class Priority { kNormal, kHigh };
+
+  // Queues f like dispatch(), in the lane for priority, unless that lane
+  // already has max_queued tasks that haven't started.  Unlike dispatch(),
+  // the task goes in the lane even when called from a worker.
+  //
+  // Returns: false, without queueing f, if the lane is full
+  template <typename F>
+  bool try_dispatch(F&& f, Priority priority = Priority::kNormal);
+
+  // Queues f like dispatch(), and returns a future for what it returns (or
+  // throws).  The future's shared state is allocated, so this is for work
+  // whose result is wanted, not for every small task.
+  template <typename F>
+  auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>&>>;
+
+  // Runs body(i) for every i in [begin, end), in chunks of grain indices
+  // spread across the workers and the calling thread, and returns once they
+  // have all run.  Can be called from a task.  If body throws on the calling
+  // thread, the exception is rethrown once the chunks already handed to the
+  // workers have finished, since they still use body; like any task, body
+  // must not throw on a worker.
+  template <typename F>
+  void parallel_for(size_t begin, size_t end, size_t grain, F&& body);
+
+  // Waits until every task in group has finished.  Called from a worker of
+  // this pool, it runs queued tasks while it waits, since the tasks it waits
+  // for may be queued behind it; from any other thread, it blocks.
+  void wait(WaitGroup* group);
+
+  // Returns the number of worker threads
+  size_t num_threads() const { return num_threads_; }
+
+  // Pins worker i to the (first_cpu + i)-th of the CPUs the process may run
+  // on, wrapping around, so that pools given different first_cpus spread
+  // over different cores.
+  //
+  // Returns: false if a worker couldn't be pinned
+  bool pin_workers(size_t first_cpu);
+
+  // A count of durations by power of two: bucket 0 counts those under 1 us,
+  // bucket i those in [2^(i-1), 2^i) us, and the last bucket everything
+  // longer
+  struct Histogram {
+    static constexpr size_t kBuckets = 28;
+
+    // Returns the bucket a duration of ns nanoseconds goes in
+    static size_t bucket(uint64_t ns);
+
+    // Returns the upper bound of bucket i, in microseconds
+    static uint64_t upper_us(size_t i) { return uint64_t{1} << i; }
+
+    // Returns the number of durations counted
+    uint64_t total() const;
+
+    // Returns the upper bound, in microseconds, of the bucket that the p-th
+    // quantile (0 < p <= 1) falls in; 0 if nothing was counted
+    uint64_t quantile_us(double p) const;
+
+    std::array<uint64_t, kBuckets> counts{};
+  };
+
+  // What one worker has done since the pool started
+  struct WorkerStats {
+    // the CPU it is pinned to, or -1
+    int cpu = -1;
+    uint64_t tasks = 0;
+    // tasks it took from the deque of another worker
+    uint64_t steals = 0;
+    // time spent running tasks, and its share of the time since the pool
+    // started; the rest the worker was looking for work or parked
+    uint64_t busy_ns = 0;
+    double busy_ratio = 0;
+  };
+
+  // A snapshot of what the pool has done since it started, and what is
+  // queued now.  The counters are read one at a time while the workers go
+  // on, so they may be a few tasks apart.
+  struct Stats {
+    uint64_t uptime_ns = 0;
+    // tasks queued that haven't started, in the lanes and on the deques
+    size_t queued = 0;
+    // tasks try_dispatch() turned away because their lane was full
+    uint64_t refused = 0;
+    // how long tasks waited between being queued and starting, and how long
+    // they ran
+    Histogram wait;
+    Histogram run;
+    std::vector<WorkerStats> workers;
+
+    // the stats as a JSON object, for tools to read
+    std::string to_json() const;
+  };
+
+  // Returns what the pool has done so far.  Can be called from any thread,
+  // and takes no lock the workers take.
+  Stats stats() const;
+
+  // not copyable: the workers point back at the pool
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+
+ private:
+  // A queue of tasks dispatched from outside the pool: a ring of ring.size()
+  // slots (a power of two, doubled when full, so that it stops allocating
+  // once it has grown to fit), size of them queued from head on.  size is
+  // also read without the lock, to skip an empty lane.
+  struct alignas(64) Lane {
+    // queue and dequeue; lock must be held
+    void push(const Work& work);
+    Work pop();
+
+    std::mutex lock;
+    std::vector<Work> ring;
+    size_t head = 0;
+    std::atomic<size_t> size{0};
+    // tasks try_dispatch()ed to the lane that haven't started yet
+    std::atomic<size_t> admitted{0};
+    // tasks try_dispatch() turned away
+    std::atomic<uint64_t> refused{0};
+  };
+
+  // Returns true if a callable of type Fn is stored inline in a Work
+  template <typename Fn>
+  static constexpr bool stored_inline() {
+    return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(void*) &&
+           std::is_trivially_copyable_v<Fn>;
+  }
+
+  // Returns f as a Work, moving it to the heap if it isn't stored inline
+  template <typename F>
+  static Work make_work(F&& f);
+
+  // queues work on the calling worker's deque, or the normal lane
+  void push(Work work);
+
+  // queues work in lane, and wakes a worker for it
+  void inject(Lane* lane, Work work);
+
+  // runs queued tasks on the calling worker until group has finished
+  void help_until(WaitGroup* group);
+
+  // a worker thread, its deque and its counters
+  struct Worker;
+
+  // runs task on w, counting it
+  static void run(Worker* w, Work* task);
+
+  // the thread start routine, given the Worker it runs as
+  friend void* thread_loop(void* t_worker);
+
+  // Takes a task from lane into task, moving up to max_batch more of the
+  // queued tasks onto w's deque for it (or thieves) to run next.
+  //
+  // Returns: false if the lane is empty
+  bool take_injected(Lane* lane, Worker* w, Work* task, size_t max_batch);
+
+  // Steals a task from the deque of another worker, trying them all from a
+  // random one.
+  //
+  // Returns: false if there was nothing to steal
+  bool steal(Worker* w, Work* task);
+
+  // finds the next task for w: high priority, its own, then normal, then
+  // stolen
+  bool find_task(Worker* w, Work* task);
+
+  // Returns true if some task is queued anywhere
+  bool has_work();
+
+  // wakes one parked worker, if any are parked
+  void wake_one();
+
+  // parks the calling worker until work is dispatched or the pool shuts down
+  void park();
+
+  // the worker the calling thread runs as, if it is a thread of some pool
+  static thread_local Worker* current_worker_;
+
+  size_t num_threads_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // when the pool started, on the clock of now_ns()
+  uint64_t started_ns_;
+
+  // most tasks a lane takes from try_dispatch()
+  size_t max_queued_;
+  // tasks dispatched from outside the pool, indexed by Priority
+  std::array<Lane, 2> lanes_;
+
+  // parked workers wait on park_cond_; num_parked_ lets dispatch() skip
+  // the lock when nobody is parked
+  std::mutex park_lock_;
+  std::condition_variable park_cond_;
+  std::atomic<size_t> num_parked_{0};
+
+  // set once the pool is being destroyed
+  std::atomic<bool> killthreads_{false};
+};
+
+template <typename F>
+void ThreadPool::dispatch(F&& f) {
+  push(make_work(std::forward<F>(f)));
+}
+
+template <typename F>
+bool ThreadPool::try_dispatch(F&& f, Priority priority) {
+  Lane* lane = &lanes_[static_cast<size_t>(priority)];
+  if (lane->admitted.fetch_add(1, std::memory_order_relaxed) >= max_queued_) {
+    lane->admitted.fetch_sub(1, std::memory_order_relaxed);
+    lane->refused.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // the task leaves the count as it starts; with a small f this is still
+  // stored inline
+  inject(lane, make_work([lane, fn = std::forward<F>(f)]() mutable {
+           lane->admitted.fetch_sub(1, std::memory_order_relaxed);
+           fn();
+         }));
+  return true;
+}
+
+template <typename F>
+ThreadPool::Work ThreadPool::make_work(F&& f) {
+  using Fn = std::decay_t<F>;
+  Work work{};
+  if constexpr (stored_inline<Fn>()) {
+    ::new (static_cast<void*>(work.storage_)) Fn(std::forward<F>(f));
+    work.run_ = [](void* storage) {
+      (*std::launder(static_cast<Fn*>(storage)))();
+    };
+  } else {
+    Fn* boxed = new Fn(std::forward<F>(f));
+    std::memcpy(work.storage_, &boxed, sizeof(boxed));
+    work.run_ = [](void* storage) {
+      Fn* fn = nullptr;
+      std::memcpy(&fn, storage, sizeof(fn));
+      std::unique_ptr<Fn> owned(fn);
+      (*owned)();
+    };
+  }
+  return work;
+}
+
+template <typename F>
+auto ThreadPool::submit(F&& f)
+    -> std::future<std::invoke_result_t<std::decay_t<F>&>> {
+  using R = std::invoke_result_t<std::decay_t<F>&>;
+  std::packaged_task<R()> task(std::forward<F>(f));
+  auto future = task.get_future();
+  dispatch(std::move(task));
+  return future;
+}
+
+template <typename F>
+void ThreadPool::parallel_for(size_t begin,
+                              size_t end,
+                              size_t grain,
+                              F&& body) {
+  if (begin >= end) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  // every chunk but the first goes to the pool; each task is a few pointers
+  // and numbers, so none of them allocates
+  WaitGroup group;
+  auto* fn = &body;
+  try {
+    for (size_t lo = begin + std::min(grain, end - begin); lo < end;) {
+      size_t hi = lo + std::min(grain, end - lo);
+      group.add();
+      try {
+        dispatch([fn, &group, lo, hi] {
+          for (size_t i = lo; i < hi; i++) {
+            (*fn)(i);
+          }
+          group.done();
+        });
+      } catch (...) {
+        // dispatch() ran out of memory: this chunk never got queued
+        group.done();
+        throw;
+      }
+      lo = hi;
+    }
+    for (size_t i = begin, hi = begin + std::min(grain, end - begin); i < hi;
+         i++) {
+      body(i);
+    }
+  } catch (...) {
+    // the dispatched chunks point at group and body, both about to go away
+    wait(&group);
+    throw;
+  }
+  wait(&group);
+}
+
+}  // namespace searchserver
+
+#endif  // THREADPOOL_HPP_
@@ -0,0 +1,119 @@
+#include "./Tokenizer.hpp"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace searchserver {
+
+// the bytes that separate words
+static constexpr std::string_view kDelimiters = " \r\t\v\n,.:;?!";
+
+// character classes, as bit flags
+static constexpr uint8_t kDelimiter = 1;
+static constexpr uint8_t kUpper = 2;
+
+// the class of every byte value
+static constexpr auto kCharClass = [] {
+  std::array<uint8_t, 256> table{};
+  for (char c : kDelimiters) {
+    table[static_cast<unsigned char>(c)] = kDelimiter;
+  }
+  for (int c = 'A'; c <= 'Z'; c++) {
+    table[c] = kUpper;
+  }
+  return table;
+}();
+
+#if defined(__SSE2__)
+// Lowercases the 16 bytes at p in place, returning a mask with bit i set if
+// p[i] is a delimiter
+static unsigned classify16(char* p) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i delim = _mm_setzero_si128();
+  for (char d : kDelimiters) {
+    delim = _mm_or_si128(delim, _mm_cmpeq_epi8(v, _mm_set1_epi8(d)));
+  }
+
+  // 'A' <= c <= 'Z' as a single signed compare, by moving 'A' to -128
+  __m128i shifted =
+      _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+  __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + 26));
+  v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+  return static_cast<unsigned>(_mm_movemask_epi8(delim));
+}
+#endif
+
+bool Tokenizer::next(std::string_view* word) {
+  // skip to the first byte that is neither a delimiter nor consumed
+  while (delims_ == ~uint64_t{0}) {
+    if (!load_chunk())
+      return false;
+  }
+  unsigned start_bit = __builtin_ctzll(~delims_);
+  size_t start = chunk_ + start_bit;
+
+  // every bit below start_bit is set, so the word ends at the next set bit,
+  // which may be a few chunks further on
+  uint64_t rest = delims_ >> start_bit;
+  size_t end = 0;
+  if (rest != 0) {
+    end = start + __builtin_ctzll(rest);
+  } else {
+    end = size_;
+    while (load_chunk()) {
+      if (delims_ != 0) {
+        end = chunk_ + __builtin_ctzll(delims_);
+        break;
+      }
+    }
+  }
+
+  // consume the word; end is the delimiter (or padding) bit found above, if
+  // it is in this chunk at all
+  if (end < chunk_end_) {
+    delims_ |= (uint64_t{1} << (end - chunk_)) - 1;
+  } else {
+    delims_ = ~uint64_t{0};
+  }
+  *word = std::string_view(text_ + start, end - start);
+  return true;
+}
+
+bool Tokenizer::load_chunk() {
+  if (chunk_end_ >= size_)
+    return false;
+  chunk_ = chunk_end_;
+  size_t n = std::min(kChunkSize, size_ - chunk_);
+  chunk_end_ = chunk_ + n;
+
+  char* p = text_ + chunk_;
+  uint64_t mask = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    mask |= static_cast<uint64_t>(classify16(p + i)) << i;
+  }
+#endif
+  // the tail of the text (or everything, without SSE2)
+  for (; i < n; i++) {
+    uint8_t cls = kCharClass[static_cast<unsigned char>(p[i])];
+    if ((cls & kDelimiter) != 0) {
+      mask |= uint64_t{1} << i;
+    } else if ((cls & kUpper) != 0) {
+      p[i] = static_cast<char>(p[i] | 0x20);
+    }
+  }
+  // past the end of the text counts as a delimiter
+  if (n < kChunkSize) {
+    mask |= ~uint64_t{0} << n;
+  }
+  delims_ = mask;
+  return true;
+}
+
+}  // namespace searchserver
@@ -0,0 +1,59 @@
+#ifndef TOKENIZER_HPP_
+#define TOKENIZER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace searchserver {
+
+// Splits text into the words the crawler indexes, lowercasing it as it goes.
+//
+// A word is a maximal run of bytes that are not one of the delimiters
+// " \r\t\v\n,.:;?!", the same words split() finds with those delimiters.  Each
+// byte is classified once, through a 256 entry table or, with SSE2, 16 bytes
+// at a time; ASCII upper case letters are lowercased in place during the same
+// pass.  Words are returned as string_views into the text, so tokenizing
+// allocates nothing.
+//
+// Usage:
+//   Tokenizer tokens(text.data(), text.size());
+//   std::string_view word;
+//   while (tokens.next(&word)) { ... }
+class Tokenizer {
+ public:
+  // Arguments:
+  //  - text: the text to split, which is lowercased in place and must outlive
+  //    the returned words
+  //  - size: the number of bytes in text
+  Tokenizer(char* text, size_t size) : text_(text), size_(size) {}
+
+  // Finds the next word.
+  //
+  // Arguments:
+  //  - word: output parameter for the word, a view into the text
+  //
+  // Returns: false once there are no more words
+  bool next(std::string_view* word);
+
+ private:
+  // number of bytes classified at a time
+  static constexpr size_t kChunkSize = 64;
+
+  // classifies (and lowercases) the next chunk of text, starting at
+  // chunk_end_.  Returns false at the end of the text.
+  bool load_chunk();
+
+  char* text_;
+  size_t size_;
+  // text_[chunk_, chunk_end_) is the chunk that has been classified
+  size_t chunk_ = 0;
+  size_t chunk_end_ = 0;
+  // bit i is set if text_[chunk_ + i] is a delimiter; positions that have
+  // been consumed already, and positions past the end, are set too
+  uint64_t delims_ = ~uint64_t{0};
+};
+
+}  // namespace searchserver
+
+#endif  // TOKENIZER_HPP_
@@ -0,0 +1,650 @@
+#include "./UringLoop.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+namespace searchserver {
+
+// Size of the submission ring.  Completions can outnumber submissions (every
+// multishot operation keeps posting them), so the completion ring is bigger.
+static constexpr unsigned kSqEntries = 1024;
+static constexpr unsigned kCqEntries = 8 * kSqEntries;
+
+// The provided buffers recv picks from: a buffer is only held between a recv
+// completing and the loop copying its bytes out, so a few serve any number of
+// connections
+static constexpr unsigned kNumBuffers = 256;
+static constexpr size_t kBufferSize = 16384;
+static constexpr uint16_t kBufferGroup = 0;
+
+// How long accepting pauses when the process runs out of file descriptors,
+// unless a connection closes first
+static constexpr int64_t kAcceptBackoffNs = 100'000'000;
+
+// Largest file sent with a linked read; the length of a read is 32 bits.
+// Anything bigger is read in by the worker, as EventLoop does.
+static constexpr size_t kMaxLinkedRead = 1 << 30;
+
+// What a completion is for: the low bits of its user_data, the Connection it
+// belongs to (if any) in the rest
+enum Op : uint64_t {
+  kAccept = 1,
+  kWake,
+  // completions nobody waits for: cancels, and buffers that couldn't be
+  // handed back
+  kIgnore,
+  kRecv,
+  kSendHeader,
+  kReadFile,
+  kSendFile,
+};
+static constexpr uint64_t kOpMask = 7;
+
+static uint64_t tag(const void* conn, Op op) {
+  return reinterpret_cast<uintptr_t>(conn) | op;
+}
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd,
+                          unsigned to_submit,
+                          unsigned min_complete,
+                          unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned op, void* arg, unsigned n) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, op, arg, n));
+}
+
+struct UringLoop::Connection {
+  explicit Connection(HttpSocket socket) : sock(std::move(socket)) {}
+
+  HttpSocket sock;
+  // the request in the pool, parsed in place; reused for every request
+  HttpRequest request;
+  // when the request was handed to the pool
+  std::chrono::steady_clock::time_point queued_at;
+  // the multishot recv is still armed: the connection can't be freed before
+  // its last completion
+  bool recv_armed = false;
+  // the recv has been cancelled, the connection is going away
+  bool cancelled = false;
+  // the recv has been cancelled with the request buffer full: armed again
+  // once the requests in it are answered
+  bool full = false;
+  // a request of this connection is in the pool
+  bool busy = false;
+  // sends and reads of the current response that haven't completed
+  unsigned in_flight = 0;
+  // one of them came up short
+  bool send_failed = false;
+  // the response to the request in the pool, filled in by the worker, and
+  // then sent: its pieces, gathered for sendmsg(), and the contents of its
+  // file
+  EventLoop::Response response;
+  size_t header_size = 0;
+  std::array<iovec, HttpResponse::kMaxPieces> iov{};
+  msghdr msg{};
+  std::unique_ptr<char[]> body;
+  // close once the response is sent
+  bool closing = false;
+  // the client won't send anything more
+  bool eof = false;
+  // the connection failed: close as soon as nothing refers to it
+  bool failed = false;
+};
+
+struct UringLoop::Rings {
+  ~Rings() {
+    if (sq_ptr != MAP_FAILED)
+      munmap(sq_ptr, sq_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqes_size);
+  }
+
+  void* sq_ptr = MAP_FAILED;
+  size_t sq_size = 0;
+  void* cq_ptr = MAP_FAILED;
+  size_t cq_size = 0;
+  void* sqes = MAP_FAILED;
+  size_t sqes_size = 0;
+
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned sq_mask = 0;
+  unsigned sq_entries = 0;
+  // the tail including entries not yet published to the kernel
+  unsigned sq_local_tail = 0;
+
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+};
+
+UringLoop::UringLoop(ServerSocket* server,
+                     ThreadPool* pool,
+                     EventLoop::Handler handler,
+                     Admission admission)
+    : server_(server),
+      pool_(pool),
+      handler_(std::move(handler)),
+      admission_(std::move(admission)) {}
+
+UringLoop::~UringLoop() {
+  // A loop that gave up can still have requests in the pool, which post back
+  // to it: wait for them.  Not by reading the eventfd, which the ring may
+  // still have a read armed on.
+  {
+    std::unique_lock<std::mutex> lock(done_lock_);
+    done_posted_.wait(lock, [this] { return done_.size() == jobs_in_pool_; });
+  }
+  // closing the ring cancels whatever is still in flight
+  if (ring_fd_ != -1)
+    close(ring_fd_);
+  rings_.reset();
+  connections_.clear();
+  if (wake_fd_ != -1)
+    close(wake_fd_);
+}
+
+bool UringLoop::setup() {
+  io_uring_params params{};
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+                 IORING_SETUP_COOP_TASKRUN;
+  params.cq_entries = kCqEntries;
+  ring_fd_ = io_uring_setup(kSqEntries, &params);
+  if (ring_fd_ < 0) {
+    ring_fd_ = -1;
+    return false;
+  }
+  if ((params.features & IORING_FEAT_NODROP) == 0) {
+    return false;
+  }
+
+  // Multishot recv came in the same kernel (6.0) as IORING_OP_SEND_ZC, which,
+  // unlike the multishot flags, the probe reports
+  size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> probe_buf(new char[probe_size]());
+  auto* probe = reinterpret_cast<io_uring_probe*>(probe_buf.get());
+  if (io_uring_register(ring_fd_, IORING_REGISTER_PROBE, probe, 256) != 0 ||
+      probe->last_op < IORING_OP_SEND_ZC ||
+      (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED) == 0) {
+    return false;
+  }
+
+  // map the rings
+  rings_ = std::make_unique<Rings>();
+  Rings& r = *rings_;
+  r.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  r.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+    r.sq_size = r.cq_size = std::max(r.sq_size, r.cq_size);
+  }
+  r.sq_ptr = mmap(nullptr, r.sq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (r.sq_ptr == MAP_FAILED) {
+    return false;
+  }
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+    r.cq_ptr = r.sq_ptr;
+  } else {
+    r.cq_ptr = mmap(nullptr, r.cq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (r.cq_ptr == MAP_FAILED) {
+      return false;
+    }
+  }
+  r.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  r.sqes = mmap(nullptr, r.sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (r.sqes == MAP_FAILED) {
+    return false;
+  }
+
+  char* sq = static_cast<char*>(r.sq_ptr);
+  r.sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  r.sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  r.sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  r.sq_entries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+  r.sq_local_tail = *r.sq_tail;
+  // entry i of the ring is always submission entry i
+  auto* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  for (unsigned i = 0; i < r.sq_entries; i++) {
+    array[i] = i;
+  }
+  char* cq = static_cast<char*>(r.cq_ptr);
+  r.cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  r.cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  r.cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  r.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // hand the kernel all of the provided buffers
+  buffers_.reset(new char[kNumBuffers * kBufferSize]);
+  io_uring_sqe* sqe = next_sqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = kNumBuffers;
+  sqe->addr = reinterpret_cast<uintptr_t>(buffers_.get());
+  sqe->len = kBufferSize;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = tag(nullptr, kIgnore);
+
+  wake_fd_ = eventfd(0, EFD_CLOEXEC);
+  return wake_fd_ != -1;
+}
+
+io_uring_sqe* UringLoop::next_sqe() {
+  Rings& r = *rings_;
+  unsigned head = __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE);
+  if (r.sq_local_tail - head == r.sq_entries) {
+    // full: hand the kernel what is queued to make room
+    if (!enter(0)) {
+      failed_ = true;
+      return nullptr;
+    }
+    head = __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE);
+    if (r.sq_local_tail - head == r.sq_entries) {
+      failed_ = true;
+      return nullptr;
+    }
+  }
+  auto* sqe =
+      static_cast<io_uring_sqe*>(r.sqes) + (r.sq_local_tail & r.sq_mask);
+  memset(sqe, 0, sizeof(*sqe));
+  r.sq_local_tail++;
+  to_submit_++;
+  return sqe;
+}
+
+bool UringLoop::enter(unsigned wait_for) {
+  Rings& r = *rings_;
+  // publish the queued entries; the release orders their contents before
+  // the tail the kernel reads
+  __atomic_store_n(r.sq_tail, r.sq_local_tail, __ATOMIC_RELEASE);
+  unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int ret = io_uring_enter(ring_fd_, to_submit_, wait_for, flags);
+  if (ret < 0) {
+    // EBUSY: completions have to be reaped before more can be submitted
+    return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+  }
+  to_submit_ -= std::min(to_submit_, static_cast<unsigned>(ret));
+  return true;
+}
+
+bool UringLoop::run() {
+  if (!setup() || !arm_accept() || !arm_wake()) {
+    return false;
+  }
+  started_ = true;
+
+  Rings& r = *rings_;
+  while (!failed_) {
+    if (!enter(1)) {
+      return false;
+    }
+    // one enter() submits everything the previous batch queued and collects
+    // everything that finished since
+    unsigned head = *r.cq_head;
+    while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe cqe = r.cqes[head & r.cq_mask];
+      head++;
+      __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+      complete(cqe.user_data, cqe.res, cqe.flags);
+    }
+  }
+  return false;
+}
+
+bool UringLoop::arm_accept() {
+  io_uring_sqe* sqe = next_sqe();
+  if (sqe == nullptr)
+    return false;
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = server_->fd();
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = tag(nullptr, kAccept);
+  return true;
+}
+
+bool UringLoop::arm_wake() {
+  io_uring_sqe* sqe = next_sqe();
+  if (sqe == nullptr)
+    return false;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wake_fd_;
+  sqe->addr = reinterpret_cast<uintptr_t>(&wake_count_);
+  sqe->len = sizeof(wake_count_);
+  sqe->user_data = tag(nullptr, kWake);
+  return true;
+}
+
+void UringLoop::arm_recv(Connection* conn) {
+  io_uring_sqe* sqe = next_sqe();
+  if (sqe == nullptr) {
+    conn->failed = true;
+    return;
+  }
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = conn->sock.fd();
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = tag(conn, kRecv);
+  conn->recv_armed = true;
+}
+
+void UringLoop::cancel_recv(Connection* conn) {
+  io_uring_sqe* sqe = next_sqe();
+  if (sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = tag(conn, kRecv);
+  sqe->user_data = tag(nullptr, kIgnore);
+}
+
+void UringLoop::arm_backoff() {
+  if (backoff_armed_)
+    return;
+  io_uring_sqe* sqe = next_sqe();
+  if (sqe == nullptr)
+    return;
+  accept_backoff_.tv_sec = 0;
+  accept_backoff_.tv_nsec = kAcceptBackoffNs;
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->addr = reinterpret_cast<uintptr_t>(&accept_backoff_);
+  sqe->len = 1;
+  // tagged with the timespec, to tell it from the accept
+  sqe->user_data = tag(&accept_backoff_, kAccept);
+  backoff_armed_ = true;
+}
+
+void UringLoop::resume_accepting() {
+  if (!accept_paused_)
+    return;
+  accept_paused_ = false;
+  if (!arm_accept())
+    failed_ = true;
+}
+
+void UringLoop::recycle_buffer(uint16_t bid) {
+  // goes out with the next batch; only a failure posts a completion
+  io_uring_sqe* sqe = next_sqe();
+  if (sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = 1;
+  sqe->addr = reinterpret_cast<uintptr_t>(buffers_.get() + bid * kBufferSize);
+  sqe->len = kBufferSize;
+  sqe->off = bid;
+  sqe->buf_group = kBufferGroup;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = tag(nullptr, kIgnore);
+}
+
+void UringLoop::run_job(Connection* conn) {
+  auto waited = std::chrono::steady_clock::now() - conn->queued_at;
+  if (admission_.deadline.count() > 0 && waited > admission_.deadline) {
+    conn->response = EventLoop::overloaded(conn->request);
+  } else {
+    conn->response = handler_(conn->request);
+  }
+  if (conn->response.file_size() > kMaxLinkedRead) {
+    conn->response.inline_file();
+  }
+  // all under the lock, so that the destructor, once it sees the job back,
+  // can't close the eventfd before the write
+  std::lock_guard<std::mutex> guard(done_lock_);
+  done_.push_back(conn);
+  uint64_t one = 1;
+  while (write(wake_fd_, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+  done_posted_.notify_one();
+}
+
+void UringLoop::complete(uint64_t user_data, int32_t res, uint32_t flags) {
+  auto op = static_cast<Op>(user_data & kOpMask);
+  auto* conn = reinterpret_cast<Connection*>(user_data & ~kOpMask);
+  switch (op) {
+    case kAccept:
+      if (conn == nullptr) {
+        on_accept(res, flags);
+      } else {
+        // the backoff timer
+        backoff_armed_ = false;
+        resume_accepting();
+      }
+      break;
+    case kWake:
+      finish_jobs();
+      if (!arm_wake())
+        failed_ = true;
+      break;
+    case kIgnore:
+      break;
+    case kRecv:
+      on_recv(conn, res, flags);
+      break;
+    case kSendHeader:
+    case kReadFile:
+    case kSendFile:
+      on_send(conn, op == kSendHeader, res);
+      break;
+  }
+}
+
+void UringLoop::on_accept(int32_t res, uint32_t flags) {
+  if (res >= 0) {
+    // a multishot accept has nowhere to put each client's address
+    sockaddr_storage addr{};
+    socklen_t len = sizeof(addr);
+    getpeername(res, reinterpret_cast<sockaddr*>(&addr), &len);
+    auto conn = std::make_unique<Connection>(
+        HttpSocket(res, len, reinterpret_cast<sockaddr*>(&addr)));
+    Connection* ptr = conn.get();
+    connections_[ptr] = std::move(conn);
+    arm_recv(ptr);
+    advance(ptr);
+  } else if (res == -EINVAL) {
+    // the kernel can't accept this way at all
+    failed_ = true;
+    return;
+  }
+  if ((flags & IORING_CQE_F_MORE) != 0) {
+    return;
+  }
+  // the accept stops after an error
+  if (res < 0 && res != -EINTR && res != -ECONNABORTED && res != -EPROTO) {
+    // Out of file descriptors (or memory): trying again right away would only
+    // fail again.  Wait for a connection to close, or for the backoff.
+    accept_paused_ = true;
+    arm_backoff();
+    return;
+  }
+  if (!arm_accept()) {
+    failed_ = true;
+  }
+}
+
+void UringLoop::on_recv(Connection* conn, int32_t res, uint32_t flags) {
+  if (res > 0) {
+    auto bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    conn->sock.add_input(buffers_.get() + bid * kBufferSize, res);
+    recycle_buffer(bid);
+    if (conn->sock.input_full() && !conn->full && !conn->cancelled) {
+      // the client pipelines faster than it is answered: hold the rest back
+      cancel_recv(conn);
+      conn->full = true;
+    }
+  } else if (res == 0) {
+    conn->eof = true;
+  } else if (res != -ENOBUFS && res != -ECANCELED) {
+    // ENOBUFS only means every buffer was taken at that moment
+    conn->failed = true;
+  }
+  if ((flags & IORING_CQE_F_MORE) == 0) {
+    conn->recv_armed = false;
+    if (!conn->cancelled && !conn->full && !conn->eof && !conn->failed) {
+      arm_recv(conn);
+    }
+  }
+  advance(conn);
+}
+
+void UringLoop::on_send(Connection* conn, bool header, int32_t res) {
+  size_t expected = header ? conn->header_size : conn->response.file_size();
+  if (res < 0 || static_cast<size_t>(res) != expected) {
+    // later operations of the chain are cancelled, and complete too
+    conn->send_failed = true;
+  }
+  if (--conn->in_flight > 0) {
+    return;
+  }
+  conn->response = {};
+  conn->body.reset();
+  if (conn->send_failed) {
+    conn->failed = true;
+  }
+  advance(conn);
+}
+
+void UringLoop::finish_jobs() {
+  std::vector<Connection*> done;
+  {
+    std::lock_guard<std::mutex> guard(done_lock_);
+    done.swap(done_);
+  }
+  for (Connection* conn : done) {
+    jobs_in_pool_--;
+    conn->busy = false;
+    send_response(conn);
+  }
+}
+
+void UringLoop::send_response(Connection* conn) {
+  conn->closing = conn->response.close();
+  conn->send_failed = false;
+  HttpResponse& out = conn->response;
+  bool has_file = out.file() != -1 && out.file_size() > 0;
+
+  // The pieces in one sendmsg(), then the file read straight into a buffer
+  // and sent from it, all submitted at once.  Links make each operation wait
+  // for the one before it, and cancel the rest of the chain if one fails or
+  // comes up short.
+  conn->header_size = out.remaining();
+  if (conn->header_size > 0) {
+    io_uring_sqe* sqe = next_sqe();
+    if (sqe == nullptr) {
+      conn->failed = true;
+      return;
+    }
+    conn->msg = {};
+    conn->msg.msg_iov = conn->iov.data();
+    conn->msg.msg_iovlen = out.iovecs(conn->iov.data(), conn->iov.size());
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->sock.fd();
+    sqe->addr = reinterpret_cast<uintptr_t>(&conn->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL | (has_file ? MSG_MORE : 0);
+    sqe->flags = has_file ? IOSQE_IO_LINK : 0;
+    sqe->user_data = tag(conn, kSendHeader);
+    conn->in_flight++;
+  }
+  if (has_file) {
+    conn->body.reset(new char[out.file_size()]);
+    io_uring_sqe* read = next_sqe();
+    io_uring_sqe* send = read == nullptr ? nullptr : next_sqe();
+    if (send == nullptr) {
+      conn->failed = true;
+      return;
+    }
+    read->opcode = IORING_OP_READ;
+    read->fd = out.file();
+    read->addr = reinterpret_cast<uintptr_t>(conn->body.get());
+    read->len = out.file_size();
+    read->off = 0;
+    read->flags = IOSQE_IO_LINK;
+    read->user_data = tag(conn, kReadFile);
+    send->opcode = IORING_OP_SEND;
+    send->fd = conn->sock.fd();
+    send->addr = reinterpret_cast<uintptr_t>(conn->body.get());
+    send->len = out.file_size();
+    send->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    send->user_data = tag(conn, kSendFile);
+    conn->in_flight += 2;
+  }
+  if (conn->in_flight == 0) {
+    // nothing to send
+    conn->response = {};
+    advance(conn);
+  }
+}
+
+void UringLoop::advance(Connection* conn) {
+  if (conn->busy || conn->in_flight > 0) {
+    return;
+  }
+  if (!conn->failed && !conn->closing) {
+    auto status = conn->sock.buffered_request(&conn->request);
+    if (status == HttpRequestParser::Status::kComplete) {
+      auto priority = admission_.priority
+                          ? admission_.priority(conn->request)
+                          : ThreadPool::Priority::kNormal;
+      conn->queued_at = std::chrono::steady_clock::now();
+      if (pool_->try_dispatch([this, conn] { run_job(conn); }, priority)) {
+        conn->busy = true;
+        jobs_in_pool_++;
+      } else {
+        // no room in the pool: turn the request away from here, and move on
+        // to the next one once that is sent
+        conn->response = EventLoop::overloaded(conn->request);
+        send_response(conn);
+      }
+      return;
+    }
+    if (status == HttpRequestParser::Status::kIncomplete && conn->full) {
+      // the buffered requests are answered: take in the rest
+      conn->full = false;
+      if (!conn->recv_armed && !conn->eof && !conn->failed) {
+        arm_recv(conn);
+      }
+    }
+    if (status == HttpRequestParser::Status::kIncomplete && !conn->eof) {
+      // wait for the rest of the next request
+      return;
+    }
+    // the client is done, or sent something that isn't a request
+  }
+
+  // Done with the connection.  The kernel may still post to its recv, so
+  // that is cancelled first, and the connection is freed on its last
+  // completion.
+  if (conn->recv_armed) {
+    if (!conn->cancelled) {
+      cancel_recv(conn);
+      conn->cancelled = true;
+    }
+    return;
+  }
+  connections_.erase(conn);
+  if (accept_paused_) {
+    // that freed a file descriptor for the next client
+    resume_accepting();
+  }
+}
+
+}  // namespace searchserver
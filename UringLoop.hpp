@@ -0,0 +1,172 @@
+#ifndef URING_LOOP_H_
+#define URING_LOOP_H_
+
+#include <linux/io_uring.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./EventLoop.hpp"
+#include "./HttpSocket.hpp"
+#include "./ServerSocket.hpp"
+#include "./ThreadPool.hpp"
+
+namespace searchserver {
+
+// Serves HTTP connections from one thread through io_uring.
+//
+// Does the same job as EventLoop, with the same handler, but instead of
+// waiting for readiness and then making a syscall per read() and write(), it
+// queues the socket and file I/O itself in a submission ring, and one
+// io_uring_enter() per turn of the loop both submits everything queued and
+// collects everything finished:
+//  - one multishot accept on the listening socket keeps producing clients
+//  - one multishot recv per connection keeps producing bytes, into buffers
+//    the kernel picks from a pool the loop provides up front (and hands each
+//    back to as soon as its bytes are copied out), so an idle connection holds
+//    no read buffer at all; the bytes go into the connection's HttpSocket,
+//    which still parses them into requests
+//  - a response is one sendmsg() of its pieces, or for a static file a linked
+//    sendmsg() of the header, read of the file and send of its contents, so
+//    the file is never copied through a worker
+//  - a read of the eventfd the workers post finished jobs to
+//
+// Requests are handled in the ThreadPool, one at a time per connection, as
+// with EventLoop.  io_uring is used through raw syscalls (no liburing); a
+// kernel without the features above makes run() fail, and the caller can fall
+// back to EventLoop.
+class UringLoop {
+ public:
+  // Arguments:
+  //  - server: the listening socket to accept clients from
+  //  - pool: where requests are handled
+  //  - handler: what handles them
+  //  - admission: when to turn requests away instead
+  UringLoop(ServerSocket* server,
+            ThreadPool* pool,
+            EventLoop::Handler handler,
+            Admission admission = {});
+
+  // Closes every connection and the ring, once the requests it handed to the
+  // pool are back.
+  ~UringLoop();
+
+  // Runs the loop on the calling thread.
+  //
+  // Returns: false if io_uring is unavailable or fails.  A loop that fails to
+  // set up has not touched the listening socket.
+  bool run();
+
+  // Returns true if run() got as far as serving clients, so that a failure
+  // came later
+  bool started() const { return started_; }
+
+  // Returns the number of client connections open, which the destructor
+  // closes
+  size_t connections() const { return connections_.size(); }
+
+  // not copyable or movable: pool tasks and the kernel point back at it
+  UringLoop(const UringLoop& other) = delete;
+  UringLoop& operator=(const UringLoop& other) = delete;
+
+ private:
+  // a client connection and the operations it has in flight
+  struct Connection;
+
+  // the mmap()ed submission and completion rings
+  struct Rings;
+
+  // sets up the ring, the provided buffers and the eventfd
+  bool setup();
+
+  // Returns the next free submission entry, zeroed, submitting what is
+  // queued first if the ring is full; nullptr if that fails
+  io_uring_sqe* next_sqe();
+
+  // submits the queued entries and waits for at least wait_for completions
+  bool enter(unsigned wait_for);
+
+  // queues the operations that keep the loop going
+  bool arm_accept();
+  bool arm_wake();
+  void arm_recv(Connection* conn);
+
+  // queues cancelling conn's recv
+  void cancel_recv(Connection* conn);
+
+  // queues the timer that ends a pause in accepting, unless it is queued
+  // already
+  void arm_backoff();
+
+  // accepts clients again, if that was paused
+  void resume_accepting();
+
+  // queues handing a provided buffer back to the kernel
+  void recycle_buffer(uint16_t bid);
+
+  // ThreadPool task: runs the handler on conn's request and posts the
+  // connection back
+  void run_job(Connection* conn);
+
+  // handles one completion
+  void complete(uint64_t user_data, int32_t res, uint32_t flags);
+
+  void on_accept(int32_t res, uint32_t flags);
+  void on_recv(Connection* conn, int32_t res, uint32_t flags);
+  // a send of the header (or a read or send of the file) of a response
+  void on_send(Connection* conn, bool header, int32_t res);
+  void finish_jobs();
+
+  // queues conn's response, which its finished job left in it
+  void send_response(Connection* conn);
+
+  // moves conn along: hands its next buffered request to the pool once the
+  // previous response is out, and closes it when it is done with
+  void advance(Connection* conn);
+
+  ServerSocket* server_;
+  ThreadPool* pool_;
+  EventLoop::Handler handler_;
+  Admission admission_;
+
+  int ring_fd_ = -1;
+  std::unique_ptr<Rings> rings_;
+  // entries queued since the last io_uring_enter()
+  unsigned to_submit_ = 0;
+  // the ring can't be used any more
+  bool failed_ = false;
+  // run() set the ring up and armed the accept
+  bool started_ = false;
+
+  // the provided buffers: kNumBuffers of kBufferSize bytes
+  std::unique_ptr<char[]> buffers_;
+
+  // accepting is paused for want of file descriptors, until a connection
+  // closes or the backoff timer (if armed) fires
+  bool accept_paused_ = false;
+  bool backoff_armed_ = false;
+  __kernel_timespec accept_backoff_{};
+
+  // written by workers to wake the loop up when jobs finish
+  int wake_fd_ = -1;
+  uint64_t wake_count_ = 0;
+
+  std::unordered_map<Connection*, std::unique_ptr<Connection>> connections_;
+
+  // jobs handed to the pool and not yet taken back
+  size_t jobs_in_pool_ = 0;
+  // connections whose jobs finished, handed from the workers to the loop,
+  // and signalled on each one for the destructor
+  std::mutex done_lock_;
+  std::condition_variable done_posted_;
+  std::vector<Connection*> done_;
+};
+
+}  // namespace searchserver
+
+#endif  // URING_LOOP_H_
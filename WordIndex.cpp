@@ -1,9 +1,23 @@
 #include "./WordIndex.hpp"
 
 #include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "./FrozenWordIndex.hpp"
 
 namespace searchserver {
 
+// Estimated bytes taken by a hash map node holding a value of type T: the
+// value, the next pointer and cached hash, and its share of the buckets
+template <typename T>
+static constexpr size_t kNodeBytes = sizeof(T) + 3 * sizeof(void*);
+
+// Estimated bytes per posting: a DocId and a count, plus the slack a growing
+// vector leaves on average
+static constexpr size_t kPostingBytes =
+    (sizeof(DocId) + sizeof(uint32_t)) * 3 / 2;
+
 WordIndex::WordIndex() = default;
 
 size_t WordIndex::num_words() {
@@ -11,72 +25,192 @@ size_t WordIndex::num_words() {
   return index_.size();
 }
 
-void WordIndex::record(const string& word, const string& doc_name) {
-  // increment occurrence count for word in given document
-  index_[word][doc_name]++;
+size_t WordIndex::num_docs() const {
+  return doc_ids_.size();
 }
 
-vector<Result> WordIndex::lookup_word(const string& word) {
-  vector<Result> results;
+DocId WordIndex::add_document(const string& doc_name) {
+  // intern the name: each document is stored once, postings only keep its id
+  auto [it, inserted] =
+      doc_ids_.try_emplace(doc_name, static_cast<DocId>(docs_.size()));
+  if (inserted) {
+    docs_.push_back(DocInfo{doc_name, 0});
+    // the name is stored twice, in the table and as the key of doc_ids_
+    memory_usage_ += sizeof(DocInfo) + 2 * doc_name.size() +
+                     kNodeBytes<std::pair<const string, DocId>>;
+  }
+  return it->second;
+}
+
+const DocInfo& WordIndex::document(DocId doc) const {
+  return docs_.at(doc);
+}
+
+void WordIndex::record(std::string_view word, DocId doc) {
+  // increment occurrence count for word in given document
   auto it = index_.find(word);
-  // if word not found, return empty list
-  if (it == index_.end())
-    return results;
+  if (it == index_.end()) {
+    it = index_.emplace(string(word), PostingList()).first;
+    memory_usage_ +=
+        word.size() + kNodeBytes<std::pair<const string, PostingList>>;
+  }
+  size_t before = it->second.size();
+  it->second.add(doc);
+  if (it->second.size() != before) {
+    memory_usage_ += kPostingBytes;
+  }
+  docs_[doc].num_words++;
+}
 
-  // collect doc-name and count pairs into results
-  for (auto& [doc, count] : it->second) {
-    results.emplace_back(doc, count);
+void WordIndex::record(const string& word, const string& doc_name) {
+  record(word, add_document(doc_name));
+}
+
+size_t WordIndex::remove_documents(const vector<string>& doc_names) {
+  // documents keep their ids, except for the removed ones, which have none
+  vector<DocId> new_id(docs_.size());
+  for (size_t i = 0; i < docs_.size(); i++) {
+    new_id[i] = docs_[i].live ? static_cast<DocId>(i) : kNoDoc;
+  }
+  size_t count = 0;
+  for (auto& name : doc_names) {
+    auto it = doc_ids_.find(name);
+    if (it == doc_ids_.end())
+      continue;
+    new_id[it->second] = kNoDoc;
+    docs_[it->second].live = false;
+    docs_[it->second].num_words = 0;
+    doc_ids_.erase(it);
+    count++;
   }
-  // sort by descending count, then ascending doc name
-  std::sort(results.begin(), results.end(), [](auto& a, auto& b) {
+  if (count == 0)
+    return 0;
+
+  // Once enough of the table is dead, the live documents move down over the
+  // dead ones.  They keep their order, so the lists stay sorted, and since
+  // every list is rewritten below anyway, this costs the table and no more.
+  if ((docs_.size() - doc_ids_.size()) * kCompactRatio > docs_.size()) {
+    size_t kept = 0;
+    for (size_t i = 0; i < docs_.size(); i++) {
+      if (!docs_[i].live)
+        continue;
+      new_id[i] = static_cast<DocId>(kept);
+      doc_ids_[docs_[i].name] = new_id[i];
+      if (kept != i)
+        docs_[kept] = std::move(docs_[i]);
+      kept++;
+    }
+    docs_.resize(kept);
+  }
+
+  // drop the removed documents from every list, and words left with none
+  for (auto it = index_.begin(); it != index_.end();) {
+    it->second.renumber(new_id);
+    if (it->second.size() == 0) {
+      it = index_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return count;
+}
+
+void WordIndex::merge(WordIndex&& other) {
+  if (docs_.empty()) {
+    std::swap(*this, other);
+    return;
+  }
+
+  // documents of other get fresh ids after ours, so their postings can be
+  // appended to our (sorted) lists in order
+  vector<DocId> new_id(other.docs_.size());
+  for (size_t i = 0; i < other.docs_.size(); i++) {
+    if (!other.docs_[i].live)
+      continue;
+    new_id[i] = add_document(other.docs_[i].name);
+    docs_[new_id[i]].num_words += other.docs_[i].num_words;
+  }
+
+  for (auto& [word, list] : other.index_) {
+    PostingList& ours = index_[word];
+    PostingView view = list.view();
+    for (size_t i = 0; i < view.size; i++) {
+      ours.add(new_id[view.docs[i]], view.counts[i]);
+    }
+  }
+
+  memory_usage_ += other.memory_usage_;
+  other.docs_.clear();
+  other.doc_ids_.clear();
+  other.index_.clear();
+  other.memory_usage_ = 0;
+}
+
+size_t WordIndex::memory_usage() const {
+  return memory_usage_;
+}
+
+vector<Result> WordIndex::make_results(vector<Hit> hits,
+                                      size_t k,
+                                      size_t offset) const {
+  // order by descending count, then ascending doc name.  This is done on the
+  // ids so that only the final hits have their names copied into a Result.
+  select_window(&hits, offset, k, [this](auto& a, auto& b) {
     if (a.rank != b.rank)
       return a.rank > b.rank;
-    return a.doc_name < b.doc_name;
+    return docs_[a.doc].name < docs_[b.doc].name;
   });
+
+  vector<Result> results;
+  results.reserve(hits.size());
+  for (auto& hit : hits) {
+    results.emplace_back(docs_[hit.doc].name, hit.rank);
+  }
   return results;
 }
 
+vector<Result> WordIndex::lookup_word(const string& word) {
+  return lookup_word(word, SIZE_MAX);
+}
+
 vector<Result> WordIndex::lookup_query(const vector<string>& query) {
-  if (query.empty())
-    return {};
+  return lookup_query(query, SIZE_MAX);
+}
 
-  // start with posting list for first word
-  auto first_it = index_.find(query[0]);
-  if (first_it == index_.end())
+vector<Result> WordIndex::lookup_word(const string& word,
+                                      size_t k,
+                                      size_t offset) {
+  auto it = index_.find(word);
+  // if word not found, return empty list
+  if (it == index_.end())
     return {};
 
-  // doc -> accumulated count
-  std::unordered_map<std::string, size_t> doc_counts = first_it->second;
+  return make_results(intersect_postings({it->second.view()}), k, offset);
+}
+
+vector<Result> WordIndex::lookup_query(const vector<string>& query,
+                                       size_t k,
+                                       size_t offset) {
+  if (query.empty())
+    return {};
 
-  // for each additional word, intersect and sum counts
-  for (size_t i = 1; i < query.size(); i++) {
-    auto it = index_.find(query[i]);
+  // gather the posting list of every word; a missing word means no document
+  // can contain the whole query
+  vector<PostingView> lists;
+  lists.reserve(query.size());
+  for (auto& word : query) {
+    auto it = index_.find(word);
     if (it == index_.end())
       return {};
-    std::unordered_map<std::string, size_t> next_counts;
-    for (auto& [doc, cnt] : it->second) {
-      auto it2 = doc_counts.find(doc);
-      if (it2 != doc_counts.end()) {
-        next_counts[doc] = it2->second + cnt;
-      }
-    }
-    doc_counts.swap(next_counts);
-    if (doc_counts.empty())
-      return {};
+    lists.push_back(it->second.view());
   }
 
-  // convert to vector<Result> and sort same as single-word lookup
-  vector<Result> results;
-  results.reserve(doc_counts.size());
-  for (auto& [doc, cnt] : doc_counts) {
-    results.emplace_back(doc, cnt);
-  }
-  std::sort(results.begin(), results.end(), [](auto& a, auto& b) {
-    if (a.rank != b.rank)
-      return a.rank > b.rank;
-    return a.doc_name < b.doc_name;
-  });
-  return results;
+  // intersect from the rarest list up, summing counts
+  return make_results(intersect_postings(std::move(lists)), k, offset);
+}
+
+FrozenWordIndex WordIndex::freeze() const {
+  return FrozenWordIndex(*this);
 }
 
-}  // namespace searchserver
\ No newline at end of file
+}  // namespace searchserver
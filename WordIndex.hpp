@@ -1,10 +1,13 @@
 #ifndef WORD_INDEX_H_
 #define WORD_INDEX_H_
 
+#include <functional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "./PostingList.hpp"
 #include "./Result.hpp"
 
 using std::string;
@@ -12,10 +15,35 @@ using std::vector;
 
 namespace searchserver {
 
+class FrozenWordIndex;
+
+// Per-document metadata kept in the document table of a WordIndex
+struct DocInfo {
+  // the name (path) of the document
+  string name;
+  // total number of word occurances recorded for the document
+  size_t num_words;
+  // false once the document has been removed, until the table is compacted
+  // (see WordIndex::remove_documents())
+  bool live = true;
+};
+
+// Hashes the words of a WordIndex.  Words are stored as strings but can be
+// looked up as string_views, without building a string first.
+struct WordHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view word) const {
+    return std::hash<std::string_view>{}(word);
+  }
+};
+
 // A WordIndex is used to keep track of which documents contain certain words
 // and how many occurances there are of that word in the document
 class WordIndex {
  public:
+  // See remove_documents()
+  static constexpr size_t kCompactRatio = 4;
+
   // Constructs an empty WordIndex that stores
   // no words or documents to start
   WordIndex();
@@ -26,13 +54,36 @@ class WordIndex {
   // Returns the number of unique words recorded in the index
   size_t num_words();
 
+  // Returns the number of (not removed) documents in the index
+  size_t num_docs() const;
+
+  // Adds a document to the document table, or finds it if it is already there
+  //
+  // Arguments:
+  //  - doc_name: the name of the document
+  //
+  // Returns:
+  //  - the DocId of the document, to be passed to record()
+  DocId add_document(const string& doc_name);
+
+  // Returns the document table entry for a DocId returned by add_document()
+  const DocInfo& document(DocId doc) const;
+
   // Record an occurance of a document having the specified word show up in it
   //
   // Arguments:
   //  - word: the word found in the specified document
-  //  - doc_name: the name of the document the word occurance showed up in
+  //  - doc: the id of the document the word occurance showed up in
   //
   // Returns: None
+  //
+  // Only the first occurance of a word in the whole index copies the word, so
+  // word can point into a buffer the caller reuses.
+  void record(std::string_view word, DocId doc);
+
+  // Same as above, but looks the document up by name first, adding it to the
+  // document table if needed.  Prefer the DocId version when recording many
+  // words for the same document.
   void record(const string& word, const string& doc_name);
 
   // Lookup a word in the index, getting a list of all documents that contain
@@ -60,6 +111,51 @@ class WordIndex {
   //    number of recorded occurances of the each query word in that document.
   vector<Result> lookup_query(const vector<string>& query);
 
+  // Same as the lookups above, but only returns one window of the ranked
+  // results, without sorting everything outside of it.
+  //
+  // Arguments:
+  //  - word / query: what to look up
+  //  - k: the maximum number of results to return
+  //  - offset: how many of the best ranked results to skip
+  //
+  // Returns:
+  //  - Results offset through offset + k - 1 of the full lookup, in order
+  vector<Result> lookup_word(const string& word, size_t k, size_t offset = 0);
+  vector<Result> lookup_query(const vector<string>& query,
+                              size_t k,
+                              size_t offset = 0);
+
+  // Removes documents from the index, along with every word occurance
+  // recorded for them.  Names that aren't in the index are ignored.
+  //
+  // A removed document leaves a dead entry in the document table, until more
+  // than 1/kCompactRatio of the table is dead: then the table is compacted,
+  // renumbering the documents left, so DocIds from before the call are not
+  // valid after it.
+  //
+  // This is a pass over every posting list, so remove documents in batches.
+  //
+  // Arguments:
+  //  - doc_names: the names of the documents to remove
+  //
+  // Returns: the number of documents removed
+  size_t remove_documents(const vector<string>& doc_names);
+
+  // Moves every document and word occurance recorded in other into this
+  // index, leaving other empty.  Used to combine the per-thread indexes of a
+  // parallel crawl.
+  void merge(WordIndex&& other);
+
+  // Returns a read-only copy of this index, laid out for fast lookups.  See
+  // FrozenWordIndex.hpp
+  FrozenWordIndex freeze() const;
+
+  // Returns an estimate of the bytes of memory the index holds, counting what
+  // add_document() and record() add to it.  An out-of-core crawl compares it
+  // against its budget to decide when to spill (see IndexRuns.hpp).
+  size_t memory_usage() const;
+
   // default move, delete copy
   WordIndex(const WordIndex& other) = default;
   WordIndex& operator=(const WordIndex& other) = default;
@@ -67,8 +163,23 @@ class WordIndex {
   WordIndex& operator=(WordIndex&& other) = default;
 
  private:
-  std::unordered_map<std::string, std::unordered_map<std::string, size_t>>
+  // read docs_ and index_ directly when packing them
+  friend class FrozenWordIndex;
+  friend class IndexRuns;
+
+  // selects the window [offset, offset + k) of hits in the order results are
+  // returned in, and converts only those into Results
+  vector<Result> make_results(vector<Hit> hits, size_t k, size_t offset) const;
+
+  // document table, indexed by DocId
+  vector<DocInfo> docs_;
+  // document name -> DocId
+  std::unordered_map<std::string, DocId> doc_ids_;
+  // word -> documents it occurs in, sorted by DocId, with occurance counts
+  std::unordered_map<std::string, PostingList, WordHash, std::equal_to<>>
       index_;
+  // see memory_usage()
+  size_t memory_usage_ = 0;
 };
 
 }  // namespace searchserver
@@ -1,17 +1,36 @@
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>  // for strlen()
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "CrawlFileTree.hpp"
-#include "FileReader.hpp"
+#include "EventLoop.hpp"
+#include "FrozenWordIndex.hpp"
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
 #include "HttpSocket.hpp"
 #include "HttpUtils.hpp"
+#include "IndexWatcher.hpp"
 #include "ServerSocket.hpp"
+#include "ServingIndex.hpp"
 #include "ThreadPool.hpp"
+#include "UringLoop.hpp"
 #include "WordIndex.hpp"
 
 using namespace searchserver;
@@ -22,46 +41,49 @@ using std::ostringstream;
 using std::string;
 using std::vector;
 
-/**
- * @brief Per-connection data for the threadpool.
- */
-struct TaskData {
-  HttpSocket client;
-  WordIndex* index;
-  string root;
-};
+// Number of results /query renders per page unless ?limit= says otherwise,
+// and the largest page a client may ask for.
+static constexpr size_t kDefaultLimit = 100;
+static constexpr size_t kMaxLimit = 10000;
 
 /**
- * @brief Worker function: handles all requests on one HttpSocket.
+ * @brief Handles one request; runs on a pool thread.
+ *
+ * The EventLoop owns the connection and has already parsed the header, this
+ * only turns the request into its response and says whether the connection
+ * should be closed after it.  /stats reports on pools, the workers of every
+ * listener.
  */
-static void handle_client(void* arg) {
-  auto* d = static_cast<TaskData*>(arg);
-  HttpSocket sock = std::move(d->client);
-  WordIndex* idx = d->index;
-  std::string root = std::move(d->root);
-  delete d;
-
+static EventLoop::Response handle_request(
+    const HttpRequest& request,
+    ServingIndex* idx,
+    const std::string& root,
+    const vector<std::unique_ptr<ThreadPool>>& pools) {
   // helper: redirect "/" to index.html
-  auto respond_root = []() {
-    return std::string(
-        "HTTP/1.1 302 Found\r\n"
-        "Location: /static/index.html\r\n\r\n");
+  auto respond_root = [](EventLoop::Response* out) {
+    out->add_constant(HttpResponse::kFound)
+        .add_constant("Location: /static/index.html\r\n\r\n");
   };
 
-  // helper: serve static file or 404
-  auto respond_static = [&](std::string_view uri) {
-    std::string rel = std::string(uri.substr(8));
-    auto blob = read_file(root + "/" + rel);
-    if (!blob) {
-      return std::string("HTTP/1.1 404 Not Found\r\nContent-length: 0\r\n\r\n");
-    }
-    auto& b = *blob;
-    std::ostringstream hdr;
-    hdr << "HTTP/1.1 200 OK\r\n"
-        << "Content-type: text/plain\r\n"
-        << "Content-length: " << b.size() << "\r\n\r\n"
-        << b;
-    return hdr.str();
+  // helper: serve static file or 404.  The file itself is left open for the
+  // loop to send after the header, see HttpResponse.
+  auto respond_static = [&](std::string_view uri, EventLoop::Response* out) {
+    std::string path = root + "/" + std::string(uri.substr(8));
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd != -1 && (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))) {
+      close(fd);
+      fd = -1;
+    }
+    if (fd == -1) {
+      out->add_constant(HttpResponse::kNotFound);
+      return;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    out->add_constant(HttpResponse::kOk)
+        .add_constant(HttpResponse::kTextPlain)
+        .add_content_length(size);
+    out->set_file(fd, size);
   };
 
   // helper: strip leading/trailing non-alnum
@@ -79,10 +101,32 @@ static void handle_client(void* arg) {
     s = s.substr(start, end - start);
   };
 
-  // helper: handle query
-  auto respond_query = [&](std::string_view uri) {
-    std::string terms(uri.substr(13));
-    auto toks = split(terms, "+");
+  // helper: parse a non-negative integer query argument, or use dflt
+  auto size_arg = [](const std::map<std::string, std::string>& args,
+                     const std::string& name, size_t dflt) {
+    auto it = args.find(name);
+    if (it == args.end())
+      return dflt;
+    size_t val = 0;
+    const char* first = it->second.data();
+    const char* last = first + it->second.size();
+    auto [ptr, ec] = std::from_chars(first, last, val);
+    if (ec != std::errc() || ptr != last)
+      return dflt;
+    return val;
+  };
+
+  // helper: handle query, rendering one page of results
+  //   /query?terms=a+b[&limit=N][&offset=M]
+  auto respond_query = [&](std::string_view uri, EventLoop::Response* out) {
+    URLParser parser;
+    parser.parse(std::string(uri));
+    auto args = parser.args();
+    size_t limit = std::min(size_arg(args, "limit", kDefaultLimit), kMaxLimit);
+    size_t offset = size_arg(args, "offset", 0);
+
+    // decode_URI() has already turned '+' into ' '
+    auto toks = split(args["terms"], " ");
     for (auto& w : toks) {
       std::transform(w.begin(), w.end(), w.begin(), ::tolower);
       strip_punct(w);
@@ -91,87 +135,567 @@ static void handle_client(void* arg) {
                               [](auto const& x) { return x.empty(); }),
                toks.end());
 
-    auto results = idx->lookup_query(toks);
+    // results hold copies of the document names, so the generation is only
+    // pinned for the lookup itself
+    auto results = idx->snapshot()->lookup_query(toks, limit, offset);
     std::ostringstream body;
     body << "<html><head><title>Results</title></head><body>\n<ul>\n";
     for (auto const& r : results) {
       body << "<li>" << r.doc_name << " [" << r.rank << "]</li>\n";
     }
-    body << "</ul>\n</body></html>\n";
+    body << "</ul>\n";
+    if (limit > 0 && results.size() == limit) {
+      // a full page: there may be more results after it, which the page
+      // says rather than leaving the cut silent.  Each term is URL-encoded
+      // on its own ('+' separates them), then the whole URL is escaped for
+      // the attribute.
+      std::string terms;
+      for (auto const& w : toks) {
+        terms += (terms.empty() ? "" : "+") + encode_URI(w);
+      }
+      std::string next = "/query?terms=" + terms +
+                         "&limit=" + std::to_string(limit) +
+                         "&offset=" + std::to_string(offset + limit);
+      body << "<p>Showing results " << offset + 1 << " to " << offset + limit
+           << "; there may be more. <a href=\"" << escape_html(next)
+           << "\">next</a></p>\n";
+    }
+    body << "</body></html>\n";
+
+    // the body is moved out of the stream, not copied behind the header
+    std::string b = std::move(body).str();
+    out->add_constant(HttpResponse::kOk)
+        .add_constant(HttpResponse::kTextHtml)
+        .add_content_length(b.size())
+        .add(std::move(b));
+  };
 
-    auto b = body.str();
-    std::ostringstream hdr;
-    hdr << "HTTP/1.1 200 OK\r\n"
-        << "Content-type: text/html\r\n"
-        << "Content-length: " << b.size() << "\r\n\r\n"
-        << b;
-    return hdr.str();
+  // helper: the stats of the pools, one JSON object per listener
+  auto respond_stats = [&](EventLoop::Response* out) {
+    std::string b = "{\"pools\": [";
+    for (size_t i = 0; i < pools.size(); i++) {
+      b += (i == 0 ? "" : ", ") + pools[i]->stats().to_json();
+    }
+    b += "]}\n";
+    out->add_constant(HttpResponse::kOk)
+        .add_constant(HttpResponse::kApplicationJson)
+        .add_content_length(b.size())
+        .add(std::move(b));
   };
 
-  while (true) {
-    auto req_opt = sock.next_request();
-    if (!req_opt)
-      break;
-    const auto raw = *req_opt;
-
-    std::istringstream reqs(raw);
-    std::string method;
-    std::string uri;
-    std::string version;
-    if (!(reqs >> method >> uri >> version))
-      break;
-
-    std::string response;
-    if (uri == "/") {
-      response = respond_root();
-    } else if (uri.rfind("/static/", 0) == 0) {
-      response = respond_static(uri);
-    } else if (uri.rfind("/query?terms=", 0) == 0) {
-      response = respond_query(uri);
+  std::string_view uri = request.target();
+  EventLoop::Response response;
+  if (uri == "/") {
+    respond_root(&response);
+  } else if (uri == "/stats") {
+    respond_stats(&response);
+  } else if (uri.rfind("/static/", 0) == 0) {
+    respond_static(uri, &response);
+  } else if (uri.rfind("/query?", 0) == 0) {
+    respond_query(uri, &response);
+  } else {
+    response.add_constant(HttpResponse::kNotFound);
+  }
+  response.set_close(request.wants_close());
+  return response;
+}
+
+/**
+ * @brief Command line options.
+ */
+struct Options {
+  // --build <file>: crawl root and write the index to file instead of serving
+  string build_file;
+  // --index <file>: serve the prebuilt index in file instead of crawling
+  string index_file;
+  // --full: with --build, recrawl everything even if a manifest of an
+  // earlier build exists
+  bool full = false;
+  // --no-watch: serve the index as it was at startup instead of following
+  // changes to the files under root
+  bool watch = true;
+  // --crawl-threads <n>: threads used to read and index files
+  size_t crawl_threads = std::max(1U, std::thread::hardware_concurrency());
+  // --max-file-size <bytes>, --include-ext <exts>, --exclude-ext <exts> and
+  // --index-binary: which files to index
+  FilePolicy policy;
+  // --memory-budget <MiB>: with --build, build the index out of core,
+  // holding at most this much of it in memory; 0 to build it in memory
+  size_t memory_budget_mib = 0;
+  // --crawl-stats <file>: write the stats of the startup crawl to file, as
+  // JSON
+  string stats_file;
+  // --io-uring: serve connections through io_uring where the kernel has it,
+  // instead of epoll
+  bool io_uring = false;
+  // --listeners <n>: listening sockets sharing the port, each with its own
+  // accept loop and workers
+  size_t listeners = 1;
+  // --backlog <n>, --tcp-nodelay and --defer-accept <s>: how each of them
+  // listens
+  ListenOptions listen;
+  // --queue-capacity <n>: requests of each priority that may wait for a
+  // worker before more are answered with 503
+  size_t queue_capacity = 1024;
+  // --deadline-ms <n>: answer requests that waited this long for a worker
+  // with 503; 0 for no deadline
+  size_t deadline_ms = 0;
+  // --workers <n>: threads each listener handles requests on
+  size_t workers = 4;
+  // --pin-workers: pin every worker to a CPU of its own, as far as there
+  // are CPUs to go round
+  bool pin_workers = false;
+  uint16_t port = 0;
+  string root;
+};
+
+static void usage(const char* prog) {
+  cerr << "Usage: " << prog << " [options] [--index <index_file>] <port> "
+       << "<root_dir>\n"
+       << "       " << prog << " [options] --build <index_file> <root_dir>\n"
+       << "Options:\n"
+       << "  --crawl-threads <n>  threads used to index files (default: "
+       << "one per core)\n"
+       << "  --full               with --build, ignore the manifest of an "
+       << "earlier build\n"
+       << "                       and recrawl every file\n"
+       << "  --no-watch           don't update the served index when files "
+       << "under\n"
+       << "                       root_dir change\n"
+       << "  --max-file-size <n>  skip files bigger than n bytes\n"
+       << "  --include-ext <exts> only index files with one of these "
+       << "comma separated\n"
+       << "                       extensions\n"
+       << "  --exclude-ext <exts> skip files with one of these extensions\n"
+       << "  --index-binary       index files that don't look like text, "
+       << "too\n"
+       << "  --memory-budget <n>  with --build, keep at most n MiB of the "
+       << "index in memory,\n"
+       << "                       spilling the rest to disk\n"
+       << "  --crawl-stats <file> write timings and counts of the crawl to "
+       << "file as JSON\n"
+       << "  --io-uring           serve connections through io_uring, if "
+       << "the kernel supports\n"
+       << "                       it\n"
+       << "  --listeners <n>      accept on n sockets sharing the port, each "
+       << "with its own\n"
+       << "                       loop thread and workers (default: 1)\n"
+       << "  --backlog <n>        queue up to n connections waiting to be "
+       << "accepted\n"
+       << "  --tcp-nodelay        disable Nagle's algorithm on connections\n"
+       << "  --defer-accept <s>   only accept a connection once its request "
+       << "arrives, or\n"
+       << "                       after s seconds\n"
+       << "  --queue-capacity <n> answer 503 once n queries, or n other "
+       << "requests, wait for\n"
+       << "                       a worker (default: 1024)\n"
+       << "  --deadline-ms <n>    answer 503 to requests that waited n ms "
+       << "for a worker\n"
+       << "  --workers <n>        threads each listener handles requests on "
+       << "(default: 4)\n"
+       << "  --pin-workers        pin each of those threads to a CPU\n";
+}
+
+/**
+ * @brief Parses a positive integer argument; returns false if it isn't one.
+ */
+static bool parse_count(const string& arg, size_t* out) {
+  auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), *out);
+  return ec == std::errc() && ptr == arg.data() + arg.size() && *out > 0;
+}
+
+/**
+ * @brief Splits a comma separated list of extensions.
+ */
+static vector<string> parse_extensions(const string& arg) {
+  return split(arg, ",");
+}
+
+/**
+ * @brief Parses argv into opts; returns false on bad usage.
+ */
+static bool parse_args(int argc, char* argv[], Options* opts) {
+  vector<string> positional;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--build" && i + 1 < argc) {
+      opts->build_file = argv[++i];
+    } else if (arg == "--index" && i + 1 < argc) {
+      opts->index_file = argv[++i];
+    } else if (arg == "--full") {
+      opts->full = true;
+    } else if (arg == "--no-watch") {
+      opts->watch = false;
+    } else if (arg == "--crawl-threads" && i + 1 < argc) {
+      if (!parse_count(argv[++i], &opts->crawl_threads))
+        return false;
+    } else if (arg == "--max-file-size" && i + 1 < argc) {
+      size_t max_size = 0;
+      if (!parse_count(argv[++i], &max_size))
+        return false;
+      opts->policy.max_size = max_size;
+    } else if (arg == "--include-ext" && i + 1 < argc) {
+      opts->policy.include_extensions = parse_extensions(argv[++i]);
+    } else if (arg == "--exclude-ext" && i + 1 < argc) {
+      opts->policy.exclude_extensions = parse_extensions(argv[++i]);
+    } else if (arg == "--io-uring") {
+      opts->io_uring = true;
+    } else if (arg == "--listeners" && i + 1 < argc) {
+      if (!parse_count(argv[++i], &opts->listeners))
+        return false;
+    } else if (arg == "--backlog" && i + 1 < argc) {
+      size_t backlog = 0;
+      if (!parse_count(argv[++i], &backlog) || backlog > INT32_MAX)
+        return false;
+      opts->listen.backlog = static_cast<int>(backlog);
+    } else if (arg == "--queue-capacity" && i + 1 < argc) {
+      if (!parse_count(argv[++i], &opts->queue_capacity))
+        return false;
+    } else if (arg == "--deadline-ms" && i + 1 < argc) {
+      if (!parse_count(argv[++i], &opts->deadline_ms))
+        return false;
+    } else if (arg == "--workers" && i + 1 < argc) {
+      if (!parse_count(argv[++i], &opts->workers))
+        return false;
+    } else if (arg == "--pin-workers") {
+      opts->pin_workers = true;
+    } else if (arg == "--tcp-nodelay") {
+      opts->listen.no_delay = true;
+    } else if (arg == "--defer-accept" && i + 1 < argc) {
+      size_t seconds = 0;
+      if (!parse_count(argv[++i], &seconds) || seconds > INT32_MAX)
+        return false;
+      opts->listen.defer_accept_s = static_cast<int>(seconds);
+    } else if (arg == "--index-binary") {
+      opts->policy.sniff = false;
+    } else if (arg == "--crawl-stats" && i + 1 < argc) {
+      opts->stats_file = argv[++i];
+    } else if (arg == "--memory-budget" && i + 1 < argc) {
+      if (!parse_count(argv[++i], &opts->memory_budget_mib))
+        return false;
+    } else if (arg.rfind("--", 0) == 0) {
+      return false;
     } else {
-      response = "HTTP/1.1 404 Not Found\r\nContent-length: 0\r\n\r\n";
+      positional.push_back(arg);
     }
+  }
+
+  if (!opts->build_file.empty()) {
+    if (positional.size() != 1 || !opts->index_file.empty())
+      return false;
+    opts->root = positional[0];
+    return true;
+  }
+  if (positional.size() != 2)
+    return false;
+  int port = 0;
+  auto [ptr, ec] = std::from_chars(
+      positional[0].data(), positional[0].data() + positional[0].size(), port);
+  if (ec != std::errc() || port <= 0 || port > UINT16_MAX)
+    return false;
+  opts->port = static_cast<uint16_t>(port);
+  opts->root = positional[1];
+  return true;
+}
 
-    if (!sock.write_response(response))
-      break;
-    if (raw.find("Connection: close") != std::string::npos ||
-        raw.find("connection: close") != std::string::npos) {
-      break;
+/**
+ * @brief Prints a progress line for a running crawl.
+ *
+ * Crawls that finish within the first progress interval print nothing.
+ */
+static void print_progress(const CrawlProgress& progress) {
+  static bool printed = false;
+  if (progress.elapsed_s < 1 && !printed)
+    return;
+  printed = true;
+  double mib = progress.bytes / static_cast<double>(1 << 20);
+  cout << "Crawled " << progress.files << " files, " << std::fixed
+       << std::setprecision(1) << mib << " MiB in " << progress.elapsed_s
+       << " s (" << progress.files / progress.elapsed_s << " files/s, "
+       << mib / progress.elapsed_s << " MiB/s), " << progress.new_words
+       << " new words" << std::defaultfloat << std::setprecision(6)
+       << endl;
+}
+
+/**
+ * @brief The CrawlOptions the command line asks for.
+ */
+static CrawlOptions crawl_options(const Options& opts) {
+  CrawlOptions crawl_opts;
+  crawl_opts.num_threads = opts.crawl_threads;
+  crawl_opts.policy = opts.policy;
+  crawl_opts.memory_budget = opts.memory_budget_mib << 20;
+  crawl_opts.on_progress = print_progress;
+  return crawl_opts;
+}
+
+/**
+ * @brief Reports the files a crawl skipped, and why.
+ */
+static void print_skipped(const CrawlStats& stats) {
+  cout << "Indexed " << stats.indexed << " files, skipped "
+       << stats.skipped_binary << " binary, " << stats.skipped_size
+       << " too large, " << stats.skipped_extension << " by extension, "
+       << stats.unreadable << " unreadable\n";
+}
+
+/**
+ * @brief Writes the stats of a crawl to --crawl-stats, if it was given.
+ */
+static void write_crawl_stats(const Options& opts, const CrawlStats& stats) {
+  if (opts.stats_file.empty())
+    return;
+  std::ofstream out(opts.stats_file, std::ios::trunc);
+  out << stats.to_json() << "\n";
+  if (!out.flush()) {
+    cerr << "Warning: cannot write crawl stats to " << opts.stats_file << "\n";
+  }
+}
+
+/**
+ * @brief Crawls root and freezes the result; nullopt if root can't be read.
+ *
+ * The stamps of the crawled files are stored in manifest.
+ */
+static std::optional<FrozenWordIndex> build_index(const Options& opts,
+                                                  Manifest* manifest) {
+  CrawlStats stats;
+  CrawlOptions crawl_opts = crawl_options(opts);
+  crawl_opts.manifest = manifest;
+  crawl_opts.stats = &stats;
+
+  // the crawl-time WordIndex is released as soon as it has been frozen
+  auto idx_opt = crawl_filetree(opts.root, crawl_opts);
+  if (!idx_opt) {
+    cerr << "Error: cannot crawl directory " << opts.root << "\n";
+    return std::nullopt;
+  }
+  print_skipped(stats);
+  write_crawl_stats(opts, stats);
+  return idx_opt->freeze();
+}
+
+/**
+ * @brief Implements --build: writes the index file and its manifest.
+ *
+ * If the index file and the manifest from an earlier build of the same root
+ * exist, only files that changed since are read again.
+ */
+static bool build_index_file(const Options& opts) {
+  CrawlStats stats;
+  CrawlOptions crawl_opts = crawl_options(opts);
+  crawl_opts.stats = &stats;
+  string manifest_file = opts.build_file + ".manifest";
+
+  std::optional<Manifest> manifest;
+  std::optional<FrozenWordIndex> previous;
+  if (!opts.full) {
+    manifest = read_manifest(manifest_file, opts.root, opts.policy);
+    if (manifest)
+      previous = FrozenWordIndex::open(opts.build_file);
+  }
+
+  // an out-of-core build writes the index file itself
+  std::optional<FrozenWordIndex> index;
+  bool written = false;
+  if (previous) {
+    WordIndex updated = previous->thaw();
+    previous.reset();
+    auto changes = update_filetree(opts.root, &updated, &*manifest, crawl_opts);
+    if (!changes) {
+      cerr << "Error: cannot crawl directory " << opts.root << "\n";
+      return false;
+    }
+    cout << "Updated: " << changes->added << " added, " << changes->modified
+         << " modified, " << changes->removed << " removed, "
+         << changes->unchanged << " unchanged\n";
+    index = updated.freeze();
+  } else if (opts.memory_budget_mib != 0) {
+    manifest.emplace();
+    crawl_opts.manifest = &*manifest;
+    if (!crawl_to_file(opts.root, opts.build_file, crawl_opts)) {
+      cerr << "Error: cannot build index file " << opts.build_file
+           << " from " << opts.root << "\n";
+      return false;
     }
+    written = true;
+    index = FrozenWordIndex::open(opts.build_file);
+    if (!index) {
+      cerr << "Error: cannot open index file " << opts.build_file << "\n";
+      return false;
+    }
+  } else {
+    manifest.emplace();
+    crawl_opts.manifest = &*manifest;
+    auto crawled = crawl_filetree(opts.root, crawl_opts);
+    if (!crawled) {
+      cerr << "Error: cannot crawl directory " << opts.root << "\n";
+      return false;
+    }
+    index = crawled->freeze();
   }
+  print_skipped(stats);
+  write_crawl_stats(opts, stats);
+
+  // the manifest goes last: if it is missing or stale, the next build reads
+  // more files than needed, but never fewer
+  if (!written && !index->write(opts.build_file)) {
+    cerr << "Error: cannot write index file " << opts.build_file << "\n";
+    return false;
+  }
+  if (!write_manifest(manifest_file, opts.root, opts.policy, *manifest)) {
+    cerr << "Warning: cannot write manifest " << manifest_file << "\n";
+  }
+  cout << "Wrote " << index->num_words() << " words in " << index->num_docs()
+       << " documents to " << opts.build_file << "\n";
+
+  // compare against a plain 4 byte DocId + 4 byte count per posting
+  size_t plain = index->num_postings() * (sizeof(DocId) + sizeof(uint32_t));
+  size_t packed = index->posting_bytes();
+  cout << "Postings: " << index->num_postings() << ", compressed to "
+       << packed << " bytes from " << plain << " (ratio "
+       << (packed == 0 ? 0.0 : static_cast<double>(plain) / packed) << ")\n";
+  return true;
+}
+
+/**
+ * @brief Raises the open file limit as far as allowed, since every idle
+ * keep-alive connection holds a descriptor.
+ */
+static void raise_fd_limit() {
+  struct rlimit limit {};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+/**
+ * @brief Picks the lane of the pool a request waits in: anything but a query
+ * is cheap, and shouldn't wait behind a backlog of queries.
+ */
+static ThreadPool::Priority request_priority(const HttpRequest& request) {
+  return request.target().rfind("/query?", 0) == 0
+             ? ThreadPool::Priority::kNormal
+             : ThreadPool::Priority::kHigh;
+}
+
+/**
+ * @brief Serves the clients of one listening socket, with a pool of workers
+ * of its own; only returns if the loop fails.
+ *
+ * The pool only ever runs requests: connections, idle or not, are all watched
+ * by the event loop on this thread.
+ */
+static void serve(ServerSocket* server,
+                  ThreadPool* pool,
+                  const EventLoop::Handler& handler,
+                  const Options& opts) {
+  Admission admission;
+  admission.priority = request_priority;
+  admission.deadline = std::chrono::milliseconds(opts.deadline_ms);
+  if (opts.io_uring) {
+    // UringLoop only returns if io_uring is missing or breaks; either way
+    // the epoll loop takes over
+    UringLoop uring(server, pool, handler, admission);
+    uring.run();
+    if (!uring.started()) {
+      cerr << "Warning: io_uring is unavailable, serving with epoll\n";
+    } else {
+      cerr << "Warning: io_uring failed while serving, closing "
+           << uring.connections() << " connections and serving with epoll\n";
+    }
+  }
+  EventLoop loop(server, pool, handler, admission);
+  loop.run();
+  cerr << "Error: event loop failed: " << strerror(errno) << "\n";
 }
 
 int main(int argc, char* argv[]) {
-  if (argc != 3) {
-    cerr << "Usage: " << argv[0] << " <port> <root_dir>\n";
+  Options opts;
+  if (!parse_args(argc, argv, &opts)) {
+    usage(argv[0]);
     return EXIT_FAILURE;
   }
-  uint16_t port = static_cast<uint16_t>(std::stoi(argv[1]));
-  string root = argv[2];
 
-  // Build the index
-  auto idx_opt = crawl_filetree(root);
-  if (!idx_opt) {
-    cerr << "Error: cannot crawl directory " << root << "\n";
-    return EXIT_FAILURE;
+  // Build mode: crawl once and write the index file for later --index runs
+  if (!opts.build_file.empty()) {
+    return build_index_file(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
   }
-  WordIndex index = std::move(*idx_opt);
 
-  // Listen on localhost
-  ServerSocket server(AF_INET, "127.0.0.1", port);
-  cout << "Listening on 127.0.0.1:" << port << " …\n";
+  // Either map a prebuilt index (nothing is read until queries touch it),
+  // or build one now; either way, serve from the frozen form
+  std::optional<FrozenWordIndex> idx_opt;
+  Manifest manifest;
+  if (!opts.index_file.empty()) {
+    idx_opt = FrozenWordIndex::open(opts.index_file);
+    if (!idx_opt) {
+      cerr << "Error: cannot open index file " << opts.index_file << "\n";
+      return EXIT_FAILURE;
+    }
+    // without the manifest of the build, the watcher re-reads every file
+    auto built =
+        read_manifest(opts.index_file + ".manifest", opts.root, opts.policy);
+    if (built)
+      manifest = std::move(*built);
+  } else {
+    idx_opt = build_index(opts, &manifest);
+    if (!idx_opt)
+      return EXIT_FAILURE;
+  }
+  ServingIndex index(std::move(*idx_opt));
+  string root = opts.root;
+  uint16_t port = opts.port;
+
+  // Follow changes to the files under root in the background, publishing a
+  // new index as they happen
+  IndexWatcher watcher(root, &index, std::move(manifest), crawl_options(opts));
+  if (opts.watch && !watcher.start()) {
+    cerr << "Warning: cannot watch " << root << " for changes, serving the "
+         << "index as it is now\n";
+  }
 
-  // Thread pool with 4 workers
-  ThreadPool pool(4);
+  // Listen on localhost.  With more than one listener, the sockets share
+  // the port and the kernel spreads new connections across them, so no one
+  // thread accepts every client.
+  ListenOptions listen = opts.listen;
+  listen.reuse_port = opts.listeners > 1;
+  vector<std::unique_ptr<ServerSocket>> servers;
+  for (size_t i = 0; i < opts.listeners; i++) {
+    servers.push_back(
+        std::make_unique<ServerSocket>(AF_INET, "127.0.0.1", port, listen));
+  }
+  cout << "Listening on 127.0.0.1:" << port << " …\n";
 
-  // Accept loop
-  while (true) {
-    auto client_opt = server.accept_client();
-    if (!client_opt)
-      continue;
-    auto* data = new TaskData{std::move(*client_opt), &index, root};
-    pool.dispatch({handle_client, data});
+  // The workers of every listener, made up front so that /stats can report
+  // on all of them.  Past the queue capacity, requests are turned away
+  // rather than queued.  Pinned pools start on different CPUs, so that
+  // listeners don't share cores while there are others free.
+  vector<std::unique_ptr<ThreadPool>> pools;
+  for (size_t i = 0; i < opts.listeners; i++) {
+    pools.push_back(
+        std::make_unique<ThreadPool>(opts.workers, opts.queue_capacity));
+    if (opts.pin_workers && !pools.back()->pin_workers(i * opts.workers)) {
+      cerr << "Warning: cannot pin the workers of listener " << i
+           << " to CPUs\n";
+    }
   }
 
-  return EXIT_SUCCESS;
+  raise_fd_limit();
+  auto handler = [&index, &root, &pools](const HttpRequest& request) {
+    return handle_request(request, &index, root, pools);
+  };
+  // Every listener but the first gets a thread of its own.  A loop that
+  // fails takes the server down with it: its socket would otherwise keep
+  // being handed connections nobody accepts.
+  for (size_t i = 1; i < servers.size(); i++) {
+    std::thread([server = servers[i].get(), pool = pools[i].get(), &handler,
+                 &opts] {
+      serve(server, pool, handler, opts);
+      std::exit(EXIT_FAILURE);
+    }).detach();
+  }
+  serve(servers[0].get(), pools[0].get(), handler, opts);
+  return EXIT_FAILURE;
 }
@@ -0,0 +1,252 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "./CrawlFileTree.hpp"
+#include "./catch.hpp"
+
+using searchserver::CrawlChanges;
+using searchserver::CrawlOptions;
+using searchserver::crawl_filetree;
+using searchserver::FilePolicy;
+using searchserver::FileStamp;
+using searchserver::Manifest;
+using searchserver::read_manifest;
+using searchserver::update_filetree;
+using searchserver::WordIndex;
+using searchserver::write_manifest;
+
+// A directory for a test to crawl, removed with everything in it when it goes
+// out of scope
+struct TempDir {
+  std::string path = "/tmp/test_crawlfiletree_XXXXXX";
+
+  TempDir() { REQUIRE(mkdtemp(path.data()) != nullptr); }
+  ~TempDir() {
+    std::string command = "rm -rf '" + path + "'";
+    REQUIRE(std::system(command.c_str()) == 0);
+  }
+
+  // writes contents to the file at name under the directory
+  std::string write(const std::string& name, const std::string& contents) {
+    std::string file = path + "/" + name;
+    std::ofstream(file, std::ios::binary) << contents;
+    return file;
+  }
+};
+
+// How often each word of text should be recorded when it's read through a
+// buffer of chunk_size bytes: words that fill the buffer are skipped
+static std::map<std::string, size_t> expected_words(const std::string& text,
+                                                    size_t chunk_size) {
+  // a file smaller than the buffer gets a buffer a byte bigger than itself
+  size_t capacity = std::min(chunk_size, text.size() + 1);
+  std::map<std::string, size_t> words;
+  size_t start = 0;
+  for (size_t i = 0; i <= text.size(); i++) {
+    if (i < text.size() && text[i] != ' ' && text[i] != '\n')
+      continue;
+    if (i > start && i - start < capacity)
+      words[text.substr(start, i - start)]++;
+    start = i + 1;
+  }
+  return words;
+}
+
+// Crawls a directory holding just text, read through a buffer of chunk_size
+// bytes, and checks that exactly the expected words were recorded, as often
+// as they occur
+static void check_chunked(const std::string& text, size_t chunk_size) {
+  TempDir dir;
+  std::string file = dir.write("text.txt", text);
+  CrawlOptions opts;
+  opts.policy.read_chunk_size = chunk_size;
+  std::optional<WordIndex> index = crawl_filetree(dir.path, opts);
+  REQUIRE(index);
+
+  std::map<std::string, size_t> expected = expected_words(text, chunk_size);
+  INFO("chunk size " << chunk_size << " text \"" << text << "\"");
+  REQUIRE(index->num_words() == expected.size());
+  for (auto& [word, count] : expected) {
+    INFO("word " << word);
+    auto results = index->lookup_word(word);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].doc_name == file);
+    REQUIRE(results[0].rank == count);
+  }
+}
+
+TEST_CASE("Crawling carries words across chunks", "[CrawlFileTree]") {
+  // a word that ends exactly where the first chunk does, followed by a
+  // delimiter that starts the next one
+  check_chunked("abc defgh ijk", 9);
+  // and one that is cut off there, ending in the next chunk
+  check_chunked("abc defghijk lmn", 9);
+  check_chunked("abcdefgh ijklmnopq rstu", 9);
+  // no delimiter at the end of the file, on a chunk boundary or not
+  check_chunked("abc defgh", 9);
+  check_chunked("abc defghij klm", 9);
+  check_chunked("abcdefgh abcdefgh", 9);
+  // a file smaller than the buffer
+  check_chunked("one two three", 1 << 20);
+}
+
+TEST_CASE("Crawling skips words longer than a chunk", "[CrawlFileTree]") {
+  // words that fill the buffer or run past it are dropped, and the words
+  // after them are found again
+  check_chunked(std::string(30, 'x') + " after", 8);
+  check_chunked("before " + std::string(30, 'x') + " after", 8);
+  // a word exactly as long as the buffer, ending where the chunk does
+  check_chunked(std::string(8, 'x') + " after", 8);
+  check_chunked(std::string(16, 'x') + "\n" + std::string(16, 'y'), 8);
+  // words that are carried over first, and only then fill the buffer
+  check_chunked("before " + std::string(9, 'x') + " after", 8);
+  check_chunked("bb " + std::string(13, 'x') + " after", 8);
+  // a long word at the end of the file
+  check_chunked("before " + std::string(30, 'x'), 8);
+  // a word one byte short of the buffer still fits
+  check_chunked("a " + std::string(7, 'x') + " b", 8);
+
+  // and random texts, words of up to twice the buffer in buffers of every
+  // size up to that
+  std::mt19937 rng(1248);
+  std::uniform_int_distribution<size_t> length(1, 40);
+  std::uniform_int_distribution<int> letter('a', 'e');
+  for (int round = 0; round < 200; round++) {
+    std::string text;
+    while (text.size() < 400) {
+      if (!text.empty())
+        text += round % 2 == 0 ? " " : "\n";
+      // short words often repeat, so counts are checked too
+      size_t n = length(rng);
+      text += std::string(n, static_cast<char>(letter(rng)));
+      if (n > 3)
+        text += static_cast<char>(letter(rng));
+    }
+    check_chunked(text, 1 + round % 40);
+  }
+}
+
+TEST_CASE("write_manifest and read_manifest round trip", "[CrawlFileTree]") {
+  TempDir dir;
+  std::string path = dir.path + "/crawl.manifest";
+  FilePolicy policy;
+  policy.max_size = 1000;
+  policy.include_extensions = {"txt", "MD"};
+
+  Manifest manifest = {
+      {"/root/a.txt", FileStamp{12, 1700000000123456789, 42}},
+      {"/root/with space.md", FileStamp{0, -5, 7}},
+      {"/root/deep/b.txt", FileStamp{UINT64_MAX, INT64_MAX, UINT64_MAX}},
+  };
+  REQUIRE(write_manifest(path, "/root", policy, manifest));
+  REQUIRE(read_manifest(path, "/root", policy) == manifest);
+  REQUIRE(read_manifest(path, "/root", policy)->size() == 3);
+
+  // the policy is compared normalized, so the same policy spelled
+  // differently still matches
+  FilePolicy same = policy;
+  same.include_extensions = {".md", "txt"};
+  REQUIRE(read_manifest(path, "/root", same) == manifest);
+
+  // but not a manifest of another root or of another policy
+  REQUIRE_FALSE(read_manifest(path, "/other", policy));
+  FilePolicy other = policy;
+  other.sniff = false;
+  REQUIRE_FALSE(read_manifest(path, "/root", other));
+  REQUIRE_FALSE(read_manifest(path + ".missing", "/root", policy));
+
+  // a path with a newline can't be written, and is left out
+  manifest["/root/new\nline"] = FileStamp{1, 2, 3};
+  REQUIRE(write_manifest(path, "/root", policy, manifest));
+  manifest.erase("/root/new\nline");
+  REQUIRE(read_manifest(path, "/root", policy) == manifest);
+
+  // an empty manifest is still a manifest
+  REQUIRE(write_manifest(path, "/root", policy, {}));
+  REQUIRE(read_manifest(path, "/root", policy) == Manifest{});
+
+  // and a damaged one isn't
+  std::ofstream(path, std::ios::app) << "12 x 4 /root/bad\n";
+  REQUIRE_FALSE(read_manifest(path, "/root", policy));
+}
+
+TEST_CASE("update_filetree counts the files that changed", "[CrawlFileTree]") {
+  for (size_t threads : {1, 3}) {
+    INFO("threads " << threads);
+    TempDir dir;
+    REQUIRE(mkdir((dir.path + "/sub").c_str(), 0755) == 0);
+    std::string touched = dir.write("touched.txt", "alpha shared");
+    std::string edited = dir.write("edited.txt", "bravo shared");
+    std::string kept = dir.write("sub/kept.txt", "charlie shared");
+    std::string deleted = dir.write("sub/deleted.txt", "delta shared");
+
+    CrawlOptions opts;
+    opts.num_threads = threads;
+    Manifest manifest;
+    opts.manifest = &manifest;
+    std::optional<WordIndex> index = crawl_filetree(dir.path, opts);
+    REQUIRE(index);
+    REQUIRE(manifest.size() == 4);
+    opts.manifest = nullptr;
+
+    // the manifest a crawl fills in round trips too
+    std::string manifest_path = dir.path + ".manifest";
+    REQUIRE(write_manifest(manifest_path, dir.path, opts.policy, manifest));
+    REQUIRE(read_manifest(manifest_path, dir.path, opts.policy) == manifest);
+    std::remove(manifest_path.c_str());
+
+    // touched without changing its contents, edited, added and deleted
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1000000000, 0}};
+    REQUIRE(utimensat(AT_FDCWD, touched.c_str(), times, 0) == 0);
+    dir.write("edited.txt", "echo shared shared");
+    std::string added = dir.write("sub/added.txt", "foxtrot");
+    REQUIRE(unlink(deleted.c_str()) == 0);
+
+    std::optional<CrawlChanges> changes =
+        update_filetree(dir.path, &*index, &manifest, opts);
+    REQUIRE(changes);
+    REQUIRE(changes->added == 1);
+    REQUIRE(changes->modified == 2);
+    REQUIRE(changes->removed == 1);
+    REQUIRE(changes->unchanged == 1);
+
+    // the index and manifest are what a fresh crawl would give
+    Manifest fresh;
+    opts.manifest = &fresh;
+    REQUIRE(crawl_filetree(dir.path, opts));
+    opts.manifest = nullptr;
+    REQUIRE(manifest == fresh);
+    REQUIRE(index->num_docs() == 4);
+    REQUIRE(index->lookup_word("bravo").empty());
+    REQUIRE(index->lookup_word("delta").empty());
+    REQUIRE(index->lookup_word("echo").size() == 1);
+    REQUIRE(index->lookup_word("echo")[0].doc_name == edited);
+    REQUIRE(index->lookup_word("foxtrot")[0].doc_name == added);
+    REQUIRE(index->lookup_word("alpha")[0].doc_name == touched);
+    REQUIRE(index->lookup_word("shared").size() == 3);
+
+    // and nothing changed since
+    changes = update_filetree(dir.path, &*index, &manifest, opts);
+    REQUIRE(changes);
+    REQUIRE(changes->added == 0);
+    REQUIRE(changes->modified == 0);
+    REQUIRE(changes->removed == 0);
+    REQUIRE(changes->unchanged == 4);
+
+    REQUIRE_FALSE(update_filetree(dir.path + "/missing", &*index, &manifest,
+                                  opts));
+    REQUIRE(manifest == fresh);
+  }
+}
@@ -0,0 +1,96 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "./FileReader.hpp"
+#include "./catch.hpp"
+
+using searchserver::ChunkedFileReader;
+
+// A file with the given contents, removed again when it goes out of scope
+struct TempFile {
+  std::string path = "/tmp/test_filereader_XXXXXX";
+
+  explicit TempFile(const std::string& contents) {
+    int fd = mkstemp(path.data());
+    REQUIRE(fd != -1);
+    REQUIRE(write(fd, contents.data(), contents.size()) ==
+            static_cast<ssize_t>(contents.size()));
+    close(fd);
+  }
+  ~TempFile() { unlink(path.c_str()); }
+};
+
+static std::string chunk(ChunkedFileReader* file) {
+  return std::string(file->data(), file->size());
+}
+
+TEST_CASE("ChunkedFileReader reads a file in chunks", "[FileReader]") {
+  TempFile temp("0123456789abcdefghij");
+  ChunkedFileReader file(8);
+  REQUIRE(file.open(temp.path));
+  REQUIRE(file.file_size() == 20);
+  REQUIRE(file.capacity() == 8);
+
+  REQUIRE(file.next());
+  REQUIRE(chunk(&file) == "01234567");
+  REQUIRE(file.next());
+  REQUIRE(chunk(&file) == "89abcdef");
+  REQUIRE(file.next());
+  REQUIRE(chunk(&file) == "ghij");
+  REQUIRE_FALSE(file.at_eof());
+  // the read that finds the end of the file
+  REQUIRE_FALSE(file.next());
+  REQUIRE(file.at_eof());
+  REQUIRE_FALSE(file.error());
+  REQUIRE_FALSE(file.next());
+}
+
+TEST_CASE("ChunkedFileReader carries the end of a chunk over",
+          "[FileReader]") {
+  TempFile temp("0123456789abcdefghij");
+  ChunkedFileReader file(8);
+  REQUIRE(file.open(temp.path));
+  REQUIRE(file.next());
+
+  // kept bytes move to the front, and the rest of the buffer is read after
+  // them
+  REQUIRE(file.next(3));
+  REQUIRE(chunk(&file) == "56789abc");
+
+  // keeping the whole buffer leaves no room to read into, so it is dropped
+  REQUIRE(file.next(8));
+  REQUIRE(chunk(&file) == "defghij");
+
+  // what is kept at the end of the file comes back once more, as the last
+  // chunk
+  REQUIRE(file.next(4));
+  REQUIRE(chunk(&file) == "ghij");
+  REQUIRE(file.at_eof());
+  REQUIRE_FALSE(file.next());
+}
+
+TEST_CASE("ChunkedFileReader sizes the buffer to small files",
+          "[FileReader]") {
+  TempFile temp("abc");
+  ChunkedFileReader file;
+  REQUIRE(file.open(temp.path));
+  REQUIRE(file.capacity() == 4);
+  REQUIRE(file.next());
+  REQUIRE(chunk(&file) == "abc");
+  REQUIRE_FALSE(file.at_eof());
+  REQUIRE_FALSE(file.next());
+  REQUIRE(file.at_eof());
+
+  TempFile empty("");
+  ChunkedFileReader nothing;
+  REQUIRE(nothing.open(empty.path));
+  REQUIRE(nothing.capacity() == 1);
+  REQUIRE_FALSE(nothing.next());
+  REQUIRE_FALSE(nothing.error());
+
+  ChunkedFileReader missing;
+  REQUIRE_FALSE(missing.open(temp.path + ".missing"));
+  REQUIRE_FALSE(missing.next());
+}
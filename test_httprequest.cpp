@@ -0,0 +1,226 @@
+#include <string>
+#include <string_view>
+
+#include "./HttpRequest.hpp"
+#include "./catch.hpp"
+
+using searchserver::HttpRequest;
+using searchserver::HttpRequestParser;
+using Status = HttpRequestParser::Status;
+
+// Parses all of *buffer at once, and takes the request out of it if it is
+// complete
+static Status parse_all(std::string* buffer, HttpRequest* request) {
+  HttpRequestParser parser;
+  Status status = parser.parse(*buffer);
+  if (status == Status::kComplete) {
+    parser.take(buffer, request);
+  }
+  return status;
+}
+
+// Returns a request for / with the header lines in headers
+static std::string request_with(const std::string& headers) {
+  return "GET / HTTP/1.1\r\n" + headers + "\r\n";
+}
+
+TEST_CASE("HttpRequestParser: one byte at a time", "[HttpRequest]") {
+  const std::string sent =
+      "GET /query?terms=a+b HTTP/1.1\r\n"
+      "Host: localhost:5950\r\n"
+      "Accept:text/html\n"
+      "X-Empty:\r\n"
+      "\r\n";
+  HttpRequestParser parser;
+  for (size_t i = 1; i < sent.size(); i++) {
+    // what has arrived so far, in a new copy each time, since the bytes may
+    // move between calls
+    std::string arrived = sent.substr(0, i);
+    REQUIRE(parser.parse(arrived) == Status::kIncomplete);
+  }
+  std::string buffer = sent;
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+  // it stays complete until taken
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+
+  HttpRequest request;
+  parser.take(&buffer, &request);
+  REQUIRE(buffer.empty());
+  REQUIRE(request.method() == "GET");
+  REQUIRE(request.target() == "/query?terms=a+b");
+  REQUIRE(request.version() == "HTTP/1.1");
+  REQUIRE(request.num_headers() == 3);
+  REQUIRE(request.header_name(0) == "Host");
+  REQUIRE(request.header_value(0) == "localhost:5950");
+  REQUIRE(request.header_name(1) == "Accept");
+  REQUIRE(request.header_value(1) == "text/html");
+  REQUIRE(request.header_name(2) == "X-Empty");
+  REQUIRE(request.header_value(2).empty());
+  REQUIRE(request.raw() == sent);
+}
+
+TEST_CASE("HttpRequestParser: pipelined requests", "[HttpRequest]") {
+  std::string buffer =
+      "GET /a HTTP/1.1\r\n\r\n"
+      "GET /b HTTP/1.1\r\nConnection: close\r\n\r\n"
+      "GET /c HTT";
+  HttpRequestParser parser;
+  HttpRequest request;
+
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+  parser.take(&buffer, &request);
+  REQUIRE(request.target() == "/a");
+  REQUIRE_FALSE(request.wants_close());
+
+  // the rest stays in the buffer, for the next call
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+  parser.take(&buffer, &request);
+  REQUIRE(request.target() == "/b");
+  REQUIRE(request.wants_close());
+  REQUIRE(buffer == "GET /c HTT");
+
+  REQUIRE(parser.parse(buffer) == Status::kIncomplete);
+  buffer += "P/1.0\r\n\r\n";
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+  parser.take(&buffer, &request);
+  REQUIRE(request.target() == "/c");
+  REQUIRE(request.version() == "HTTP/1.0");
+  REQUIRE(buffer.empty());
+}
+
+TEST_CASE("HttpRequestParser: empty lines before a request", "[HttpRequest]") {
+  std::string buffer = "\r\n\n\r\nPOST /x HTTP/1.1\r\nA: b\r\n\r\n";
+  HttpRequest request;
+  REQUIRE(parse_all(&buffer, &request) == Status::kComplete);
+  REQUIRE(request.method() == "POST");
+  REQUIRE(request.target() == "/x");
+  REQUIRE(request.header("A") == "b");
+
+  // only empty lines so far
+  std::string blank = "\r\n\r\n";
+  REQUIRE(parse_all(&blank, &request) == Status::kIncomplete);
+}
+
+TEST_CASE("HttpRequestParser: size limit", "[HttpRequest]") {
+  // a header of exactly kMaxSize bytes is accepted
+  std::string head = "GET / HTTP/1.1\r\nX-Fill: ";
+  std::string tail = "\r\n\r\n";
+  std::string fill(HttpRequest::kMaxSize - head.size() - tail.size(), 'f');
+  std::string buffer = head + fill + tail;
+  REQUIRE(buffer.size() == HttpRequest::kMaxSize);
+  HttpRequest request;
+  REQUIRE(parse_all(&buffer, &request) == Status::kComplete);
+  REQUIRE(request.header("x-fill")->size() == fill.size());
+
+  // one more byte is not
+  buffer = head + fill + "f" + tail;
+  REQUIRE(parse_all(&buffer, &request) == Status::kError);
+
+  // nor is kMaxSize bytes without the end of the header, however it arrives
+  std::string endless(HttpRequest::kMaxSize, 'a');
+  REQUIRE(parse_all(&endless, &request) == Status::kError);
+  HttpRequestParser parser;
+  std::string growing = head;
+  while (growing.size() + 1000 < HttpRequest::kMaxSize) {
+    growing.append(1000, 'g');
+    REQUIRE(parser.parse(growing) == Status::kIncomplete);
+  }
+  growing.resize(HttpRequest::kMaxSize - 1, 'g');
+  REQUIRE(parser.parse(growing) == Status::kIncomplete);
+  growing += 'g';
+  REQUIRE(parser.parse(growing) == Status::kError);
+}
+
+TEST_CASE("HttpRequestParser: header count limit", "[HttpRequest]") {
+  std::string headers;
+  for (size_t i = 0; i < HttpRequest::kMaxHeaders; i++) {
+    headers += "H" + std::to_string(i) + ": v\r\n";
+  }
+  std::string buffer = request_with(headers);
+  HttpRequest request;
+  REQUIRE(parse_all(&buffer, &request) == Status::kComplete);
+  REQUIRE(request.num_headers() == HttpRequest::kMaxHeaders);
+  REQUIRE(request.header("H63") == "v");
+
+  buffer = request_with(headers + "One-Too-Many: v\r\n");
+  REQUIRE(parse_all(&buffer, &request) == Status::kError);
+}
+
+TEST_CASE("HttpRequestParser: malformed requests", "[HttpRequest]") {
+  HttpRequest request;
+  for (std::string buffer : {
+           "GET /\r\n\r\n",
+           "GET  / HTTP/1.1\r\n\r\n",
+           " GET / HTTP/1.1\r\n\r\n",
+           "GET / HTTP/1.1 extra\r\n\r\n",
+           "GET / \r\n\r\n",
+           "GET / HTTP/1.1\r\nNo colon\r\n\r\n",
+           "GET / HTTP/1.1\r\n: no name\r\n\r\n",
+           "GET / HTTP/1.1\r\nName : space before colon\r\n\r\n",
+       }) {
+    INFO(buffer);
+    REQUIRE(parse_all(&buffer, &request) == Status::kError);
+  }
+
+  // an error stays an error until reset()
+  HttpRequestParser parser;
+  std::string bad = "GET /\r\n";
+  REQUIRE(parser.parse(bad) == Status::kError);
+  bad += "\r\n";
+  REQUIRE(parser.parse(bad) == Status::kError);
+  parser.reset();
+  std::string good = "GET / HTTP/1.1\r\n\r\n";
+  REQUIRE(parser.parse(good) == Status::kComplete);
+}
+
+TEST_CASE("HttpRequest::header ignores case", "[HttpRequest]") {
+  std::string buffer = request_with(
+      "content-LENGTH:   12 \r\n"
+      "X-Twice: first\r\n"
+      "x-twice: second\r\n");
+  HttpRequest request;
+  REQUIRE(parse_all(&buffer, &request) == Status::kComplete);
+  REQUIRE(request.header("Content-Length") == "12");
+  REQUIRE(request.header("CONTENT-length") == "12");
+  // the first of several
+  REQUIRE(request.header("X-TWICE") == "first");
+  REQUIRE_FALSE(request.header("Content-Type").has_value());
+  REQUIRE_FALSE(request.header("Content-Lengt").has_value());
+}
+
+TEST_CASE("HttpRequest::wants_close reads a token list", "[HttpRequest]") {
+  auto wants_close = [](const std::string& headers) {
+    std::string buffer = request_with(headers);
+    HttpRequest request;
+    REQUIRE(parse_all(&buffer, &request) == Status::kComplete);
+    return request.wants_close();
+  };
+  REQUIRE(wants_close("Connection: close\r\n"));
+  REQUIRE(wants_close("connection: CLOSE\r\n"));
+  REQUIRE(wants_close("Connection: keep-alive, close\r\n"));
+  REQUIRE(wants_close("Connection: upgrade ,\tClose ,te\r\n"));
+  REQUIRE_FALSE(wants_close(""));
+  REQUIRE_FALSE(wants_close("Connection: keep-alive\r\n"));
+  REQUIRE_FALSE(wants_close("Connection: closed, keep-alive\r\n"));
+  REQUIRE_FALSE(wants_close("Connection:\r\n"));
+  REQUIRE_FALSE(wants_close("X-Connection: close\r\n"));
+}
+
+TEST_CASE("HttpRequestParser::take trades buffers", "[HttpRequest]") {
+  std::string buffer = "GET /1 HTTP/1.1\r\n\r\nGET /2 HTTP/1.1\r\n\r\n";
+  HttpRequestParser parser;
+  HttpRequest request;
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+  parser.take(&buffer, &request);
+  REQUIRE(request.target() == "/1");
+  REQUIRE(buffer == "GET /2 HTTP/1.1\r\n\r\n");
+
+  // the second request reuses the first one's buffer, and the first request's
+  // views are replaced, not left pointing at freed bytes
+  const char* old_request_bytes = request.raw().data();
+  REQUIRE(parser.parse(buffer) == Status::kComplete);
+  parser.take(&buffer, &request);
+  REQUIRE(request.target() == "/2");
+  REQUIRE(buffer.data() == old_request_bytes);
+  REQUIRE(buffer.empty());
+}
@@ -0,0 +1,233 @@
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "./HttpResponse.hpp"
+#include "./catch.hpp"
+
+using searchserver::HttpResponse;
+
+// Returns the bytes of response that have not been written yet, as
+// iovecs() hands them out
+static std::string unwritten(const HttpResponse& response) {
+  std::array<struct iovec, HttpResponse::kMaxPieces> iov{};
+  size_t n = response.iovecs(iov.data(), iov.size());
+  std::string out;
+  for (size_t i = 0; i < n; i++) {
+    out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+  }
+  return out;
+}
+
+// Returns a response in several pieces, constant and owned, and what it
+// says in full
+static HttpResponse sample(std::string* expected) {
+  HttpResponse response;
+  std::string body = "<html>hello</html>";
+  response.add_constant(HttpResponse::kOk)
+      .add_constant(HttpResponse::kTextHtml)
+      .add_content_length(body.size())
+      .add_constant("")
+      .add(body);
+  *expected = std::string(HttpResponse::kOk) +
+              std::string(HttpResponse::kTextHtml) +
+              "Content-length: 18\r\n\r\n" + body;
+  return response;
+}
+
+// Reads everything from fd until end of file
+static std::string read_all(int fd) {
+  std::string out;
+  std::array<char, 4096> buf{};
+  while (true) {
+    ssize_t n = read(fd, buf.data(), buf.size());
+    if (n <= 0)
+      return out;
+    out.append(buf.data(), n);
+  }
+}
+
+TEST_CASE("HttpResponse keeps its pieces in order", "[HttpResponse]") {
+  std::string expected;
+  HttpResponse response = sample(&expected);
+  REQUIRE_FALSE(response.done());
+  REQUIRE(response.remaining() == expected.size());
+  REQUIRE(unwritten(response) == expected);
+
+  // an empty piece is dropped, and an empty response is done from the start
+  HttpResponse empty;
+  empty.add_constant("").add("");
+  REQUIRE(empty.done());
+  REQUIRE(empty.remaining() == 0);
+}
+
+TEST_CASE("HttpResponse joins pieces past kMaxPieces", "[HttpResponse]") {
+  HttpResponse response;
+  std::string expected;
+  for (size_t i = 0; i < HttpResponse::kMaxPieces + 5; i++) {
+    std::string piece = "<" + std::to_string(i) + ">";
+    if (i % 2 == 0) {
+      response.add(piece);
+    } else {
+      // constants must outlive the response
+      static const std::string kConstant = "[c]";
+      response.add_constant(kConstant);
+      piece = kConstant;
+    }
+    expected += piece;
+  }
+  std::array<struct iovec, HttpResponse::kMaxPieces + 8> iov{};
+  REQUIRE(response.iovecs(iov.data(), iov.size()) == HttpResponse::kMaxPieces);
+  REQUIRE(unwritten(response) == expected);
+}
+
+TEST_CASE("HttpResponse::advance resumes mid-piece", "[HttpResponse]") {
+  std::string expected;
+  HttpResponse response = sample(&expected);
+  // a byte at a time, as a writev() that only ever takes one would
+  for (size_t written = 0; written < expected.size(); written++) {
+    REQUIRE(response.remaining() == expected.size() - written);
+    REQUIRE(unwritten(response) == expected.substr(written));
+    REQUIRE_FALSE(response.done());
+    response.advance(1);
+  }
+  REQUIRE(response.done());
+  REQUIRE(response.remaining() == 0);
+  REQUIRE(unwritten(response).empty());
+  // past the end is a no-op
+  response.advance(10);
+  REQUIRE(response.done());
+
+  // and in steps that cross piece boundaries
+  for (size_t step : {2, 7, 16, 17, 40}) {
+    HttpResponse stepped = sample(&expected);
+    size_t written = 0;
+    while (!stepped.done()) {
+      REQUIRE(unwritten(stepped) == expected.substr(written));
+      stepped.advance(step);
+      written = std::min(written + step, expected.size());
+    }
+    REQUIRE(written == expected.size());
+  }
+
+  // iovecs() can be asked for fewer than there are
+  HttpResponse partial = sample(&expected);
+  partial.advance(3);
+  std::array<struct iovec, 1> one{};
+  REQUIRE(partial.iovecs(one.data(), one.size()) == 1);
+  REQUIRE(std::string(static_cast<const char*>(one[0].iov_base),
+                      one[0].iov_len) ==
+          std::string(HttpResponse::kOk).substr(3));
+}
+
+TEST_CASE("HttpResponse::write_to picks up after partial writes",
+          "[HttpResponse]") {
+  std::array<int, 2> fds{};
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()) == 0);
+  int small = 4096;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+  setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+  REQUIRE(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+
+  // far more than the socket buffers hold, in pieces of odd sizes
+  HttpResponse response;
+  std::string expected;
+  for (int i = 0; i < 12; i++) {
+    std::string piece(10000 + i * 777, static_cast<char>('a' + i));
+    expected += piece;
+    response.add(std::move(piece));
+  }
+
+  std::string received;
+  std::array<char, 3000> buf{};
+  int partial_writes = 0;
+  while (true) {
+    REQUIRE(response.write_to(fds[0]));
+    if (response.done())
+      break;
+    // the socket is full: the rest waits, intact
+    partial_writes++;
+    REQUIRE(expected.substr(expected.size() - response.remaining()) ==
+            unwritten(response));
+    ssize_t n = read(fds[1], buf.data(), buf.size());
+    REQUIRE(n > 0);
+    received.append(buf.data(), n);
+  }
+  REQUIRE(partial_writes > 0);
+  close(fds[0]);
+  received += read_all(fds[1]);
+  close(fds[1]);
+  REQUIRE(received == expected);
+}
+
+TEST_CASE("HttpResponse::write_to blocks until done on a blocking fd",
+          "[HttpResponse]") {
+  std::array<int, 2> fds{};
+  REQUIRE(pipe(fds.data()) == 0);
+  std::string expected(200000, 'x');
+  HttpResponse response;
+  response.add_constant(HttpResponse::kOk).add(expected);
+  expected.insert(0, HttpResponse::kOk);
+
+  std::string received;
+  std::thread reader([&] { received = read_all(fds[0]); });
+  bool ok = response.write_to(fds[1]);
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  REQUIRE(ok);
+  REQUIRE(response.done());
+  REQUIRE(received == expected);
+}
+
+TEST_CASE("HttpResponse::inline_file reads the file in", "[HttpResponse]") {
+  std::array<char, 32> path{"/tmp/test_httpresponse.XXXXXX"};
+  int fd = mkstemp(path.data());
+  REQUIRE(fd != -1);
+  unlink(path.data());
+  std::string contents = "static file contents";
+  REQUIRE(write(fd, contents.data(), contents.size()) ==
+          static_cast<ssize_t>(contents.size()));
+
+  HttpResponse response;
+  response.add_constant(HttpResponse::kOk).add_content_length(contents.size());
+  response.set_file(fd, contents.size());
+  REQUIRE(response.file() == fd);
+  REQUIRE(response.file_size() == contents.size());
+  response.inline_file();
+  REQUIRE(response.file() == -1);
+  REQUIRE_FALSE(response.close());
+  REQUIRE(unwritten(response) == std::string(HttpResponse::kOk) +
+                                     "Content-length: 20\r\n\r\n" + contents);
+
+  // a file that shrank can't be sent in full: the connection closes after
+  std::array<char, 32> path2{"/tmp/test_httpresponse.XXXXXX"};
+  int shrunk = mkstemp(path2.data());
+  REQUIRE(shrunk != -1);
+  unlink(path2.data());
+  REQUIRE(write(shrunk, "abc", 3) == 3);
+  HttpResponse short_response;
+  short_response.set_file(shrunk, 100);
+  short_response.inline_file();
+  REQUIRE(short_response.close());
+  REQUIRE(short_response.file() == -1);
+}
+
+TEST_CASE("HttpResponse moves with its progress", "[HttpResponse]") {
+  std::string expected;
+  HttpResponse response = sample(&expected);
+  response.advance(20);
+  HttpResponse moved(std::move(response));
+  REQUIRE(unwritten(moved) == expected.substr(20));
+  HttpResponse assigned;
+  assigned = std::move(moved);
+  REQUIRE(unwritten(assigned) == expected.substr(20));
+  REQUIRE(assigned.remaining() == expected.size() - 20);
+}
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "./PostingCodec.hpp"
+#include "./catch.hpp"
+
+using searchserver::CompressedPostingView;
+using searchserver::decode_block;
+using searchserver::DocId;
+using searchserver::encode_block;
+using searchserver::encode_list;
+using searchserver::Hit;
+using searchserver::intersect_compressed;
+using searchserver::intersect_postings;
+using searchserver::kBlockPadding;
+using searchserver::kBlockSize;
+using searchserver::kGallopRatio;
+using searchserver::PostingList;
+using searchserver::PostingView;
+using searchserver::view_list;
+
+// A posting list encoded by encode_list(), followed by padding, the way
+// FrozenWordIndex stores one
+struct EncodedList {
+  vector<uint8_t> data;
+  size_t size = 0;
+
+  CompressedPostingView view() const {
+    return *view_list(data.data(), data.size() - kBlockPadding, size);
+  }
+
+  // overwrites entry i of the skip table
+  void set_entry(size_t i, uint32_t value) {
+    std::memcpy(&data[i * sizeof(value)], &value, sizeof(value));
+  }
+};
+
+static EncodedList encode(const vector<DocId>& docs,
+                          const vector<uint32_t>& counts) {
+  EncodedList list;
+  list.size = docs.size();
+  encode_list(docs.data(), counts.data(), docs.size(), &list.data);
+  list.data.resize(list.data.size() + kBlockPadding, 0);
+  return list;
+}
+
+// Returns an encoded list of n distinct DocIds below limit, each with a count
+// of 1 to 20, and adds the same postings to plain
+static EncodedList random_list(std::mt19937* rng,
+                               size_t n,
+                               DocId limit,
+                               PostingList* plain) {
+  std::uniform_int_distribution<DocId> pick(0, limit - 1);
+  std::uniform_int_distribution<uint32_t> count(1, 20);
+  vector<DocId> docs;
+  while (docs.size() < n) {
+    docs.push_back(pick(*rng));
+    if (docs.size() == n) {
+      std::sort(docs.begin(), docs.end());
+      docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+    }
+  }
+  vector<uint32_t> counts(n);
+  for (size_t i = 0; i < n; i++) {
+    counts[i] = count(*rng);
+    plain->add(docs[i], counts[i]);
+  }
+  return encode(docs, counts);
+}
+
+TEST_CASE("encode_block round trips every bit width", "[PostingCodec]") {
+  for (unsigned bits = 0; bits <= 32; bits++) {
+    for (size_t n : vector<size_t>{1, 3, 8, 77, kBlockSize}) {
+      for (DocId base : {0u, 1000u}) {
+        // the largest delta and the largest count need exactly bits bits
+        uint32_t top = bits == 0 ? 0 : uint32_t{1} << (bits - 1);
+        uint32_t step = bits == 0 ? 0 : 1;
+        vector<DocId> docs(n);
+        vector<uint32_t> counts(n);
+        DocId prev = base;
+        for (size_t i = 0; i < n; i++) {
+          prev += i == n / 2 ? top : step;
+          docs[i] = prev;
+          counts[i] = 1 + (i == n / 2 ? top : step * (i % 2));
+        }
+
+        vector<uint8_t> out = {0xee};  // appended to, not overwritten
+        encode_block(docs.data(), counts.data(), n, base, &out);
+        INFO("bits " << bits << " n " << n << " base " << base);
+        REQUIRE(out[0] == 0xee);
+        REQUIRE(out[1] == bits);
+        REQUIRE(out[2] == bits);
+        REQUIRE(out.size() == 3 + 2 * ((n * bits + 7) / 8));
+
+        out.resize(out.size() + kBlockPadding, 0);
+        vector<DocId> got_docs(n);
+        vector<uint32_t> got_counts(n);
+        decode_block(out.data() + 1, n, base, got_docs.data(),
+                     got_counts.data());
+        REQUIRE(got_docs == docs);
+        REQUIRE(got_counts == counts);
+      }
+    }
+  }
+}
+
+TEST_CASE("CompressedPostingView::decode splits lists into blocks",
+          "[PostingCodec]") {
+  std::mt19937 rng(6);
+  for (size_t n :
+       vector<size_t>{0, 1, kBlockSize - 1, kBlockSize, kBlockSize + 1, 1000}) {
+    PostingList plain;
+    EncodedList list = random_list(&rng, n, 100000, &plain);
+    CompressedPostingView view = list.view();
+    INFO("n " << n);
+    REQUIRE(view.num_blocks == (n + kBlockSize - 1) / kBlockSize);
+    for (size_t b = 0; b < view.num_blocks; b++) {
+      REQUIRE(view.block_size(b) ==
+              std::min(kBlockSize, n - b * kBlockSize));
+      REQUIRE(view.block_fits(b));
+      if (view.num_blocks > 1) {
+        PostingView plain_view = plain.view();
+        REQUIRE(view.last_doc(b) ==
+                plain_view.docs[b * kBlockSize + view.block_size(b) - 1]);
+      }
+    }
+    // a list of one block is just the block; a longer one starts with a
+    // table of 8 bytes per block
+    if (view.num_blocks == 1) {
+      REQUIRE(view.block_offset(0) == 0);
+    } else if (view.num_blocks > 1) {
+      REQUIRE(view.block_offset(0) == 8 * view.num_blocks);
+    }
+
+    vector<DocId> docs = {42};
+    vector<uint32_t> counts;
+    REQUIRE(view.decode(&docs, &counts));
+    PostingView expected = plain.view();
+    REQUIRE(docs == vector<DocId>(expected.docs, expected.docs + n));
+    REQUIRE(counts == vector<uint32_t>(expected.counts, expected.counts + n));
+  }
+}
+
+TEST_CASE("CompressedPostingView::block_fits rejects corrupt blocks",
+          "[PostingCodec]") {
+  std::mt19937 rng(7);
+  PostingList plain;
+  EncodedList list = random_list(&rng, 3 * kBlockSize + 10, 1000000, &plain);
+  CompressedPostingView view = list.view();
+  size_t last = view.num_blocks - 1;
+  vector<DocId> docs;
+  vector<uint32_t> counts;
+
+  // truncated anywhere inside the last block
+  for (uint64_t size = view.block_offset(last); size < view.data_size;
+       size++) {
+    CompressedPostingView truncated = view;
+    truncated.data_size = size;
+    REQUIRE_FALSE(truncated.block_fits(last));
+    REQUIRE(truncated.block_fits(0));
+    REQUIRE_FALSE(truncated.decode(&docs, &counts));
+    REQUIRE(docs.empty());
+    REQUIRE(counts.empty());
+  }
+
+  // an offset past the end
+  EncodedList bad_offset = list;
+  bad_offset.set_entry(view.num_blocks + 1, view.data_size - 1);
+  REQUIRE_FALSE(bad_offset.view().block_fits(1));
+  bad_offset.set_entry(view.num_blocks + 1, UINT32_MAX);
+  REQUIRE_FALSE(bad_offset.view().block_fits(1));
+  REQUIRE_FALSE(bad_offset.view().decode(&docs, &counts));
+
+  // a skip table that doesn't fit
+  REQUIRE_FALSE(view_list(view.data, 8 * view.num_blocks - 1, view.size));
+  REQUIRE(view_list(view.data, 8 * view.num_blocks, view.size));
+  // a single block has none, but doesn't fit in nothing either
+  auto empty = view_list(view.data, 0, kBlockSize);
+  REQUIRE(empty);
+  REQUIRE_FALSE(empty->block_fits(0));
+
+  // a width that is too wide, for the deltas or the counts
+  for (size_t header : {0, 1}) {
+    EncodedList wide = list;
+    wide.data[view.block_offset(2) + header] = 33;
+    REQUIRE_FALSE(wide.view().block_fits(2));
+    REQUIRE(wide.view().block_fits(1));
+    REQUIRE_FALSE(wide.view().decode(&docs, &counts));
+  }
+}
+
+TEST_CASE("intersect_compressed matches intersect_postings",
+          "[PostingCodec]") {
+  std::mt19937 rng(8);
+  // lengths far enough apart to probe the skip table, and close enough to
+  // merge
+  for (auto sizes : vector<vector<size_t>>{{40, 5000, 300},
+                                           {5, 5 * kGallopRatio},
+                                           {700, 900, 1100},
+                                           {1, 3000},
+                                           {1, 100},
+                                           {3, kBlockSize},
+                                           {0, 50},
+                                           {129}}) {
+    vector<PostingList> plain(sizes.size());
+    vector<EncodedList> lists;
+    for (size_t l = 0; l < sizes.size(); l++) {
+      lists.push_back(random_list(&rng, sizes[l], 6000, &plain[l]));
+    }
+    vector<PostingView> plain_views;
+    vector<CompressedPostingView> views;
+    for (size_t l = 0; l < sizes.size(); l++) {
+      plain_views.push_back(plain[l].view());
+      views.push_back(lists[l].view());
+    }
+
+    vector<Hit> expected = intersect_postings(plain_views);
+    vector<Hit> hits = intersect_compressed(views);
+    REQUIRE(hits.size() == expected.size());
+    for (size_t i = 0; i < hits.size(); i++) {
+      REQUIRE(hits[i].doc == expected[i].doc);
+      REQUIRE(hits[i].rank == expected[i].rank);
+    }
+  }
+  REQUIRE(intersect_compressed({}).empty());
+}
+
+TEST_CASE("intersect_compressed matches nothing in a corrupt list",
+          "[PostingCodec]") {
+  // every document in both lists, so every block is needed
+  vector<DocId> docs(5000);
+  for (DocId d = 0; d < docs.size(); d++)
+    docs[d] = d;
+  vector<uint32_t> counts(docs.size(), 1);
+  EncodedList all = encode(docs, counts);
+  EncodedList few = encode(vector<DocId>(docs.begin(), docs.begin() + 150),
+                           vector<uint32_t>(150, 1));
+  REQUIRE(intersect_compressed({all.view(), few.view()}).size() == 150);
+
+  // a corrupt block in the rarest list, in a list that is merged, and in a
+  // list probed through its skip table
+  EncodedList corrupt_few = few;
+  corrupt_few.data[few.view().block_offset(1)] = 40;
+  REQUIRE(intersect_compressed({all.view(), corrupt_few.view()}).empty());
+
+  EncodedList corrupt_all = all;
+  corrupt_all.data[all.view().block_offset(1) + 1] = 40;
+  REQUIRE(intersect_compressed({corrupt_all.view(), few.view()}).empty());
+
+  EncodedList one = encode({130}, {1});
+  REQUIRE(all.view().size / one.view().size >= kGallopRatio);
+  REQUIRE(intersect_compressed({all.view(), one.view()}).size() == 1);
+  REQUIRE(intersect_compressed({corrupt_all.view(), one.view()}).empty());
+
+  // and in a list of one block, which is probed without a skip table
+  EncodedList block = encode(vector<DocId>(docs.begin(), docs.begin() + 100),
+                             vector<uint32_t>(100, 1));
+  REQUIRE(intersect_compressed({block.view(), one.view()}).empty());
+  EncodedList two = encode({50}, {1});
+  REQUIRE(intersect_compressed({block.view(), two.view()}).size() == 1);
+  block.data[1] = 40;
+  REQUIRE(intersect_compressed({block.view(), two.view()}).empty());
+}
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "./PostingList.hpp"
+#include "./catch.hpp"
+
+using searchserver::DocId;
+using searchserver::Hit;
+using searchserver::intersect_blocks;
+using searchserver::intersect_galloping;
+using searchserver::intersect_postings;
+using searchserver::kGallopRatio;
+using searchserver::kNoDoc;
+using searchserver::PostingList;
+using searchserver::PostingView;
+using searchserver::select_window;
+
+// Returns n distinct DocIds below limit, sorted
+static vector<DocId> random_docs(std::mt19937* rng, size_t n, DocId limit) {
+  std::uniform_int_distribution<DocId> pick(0, limit - 1);
+  vector<DocId> docs;
+  while (docs.size() < n) {
+    docs.push_back(pick(*rng));
+    if (docs.size() == n) {
+      std::sort(docs.begin(), docs.end());
+      docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+    }
+  }
+  return docs;
+}
+
+// Checks what an intersection kernel found in a and b against
+// std::set_intersection
+template <typename Kernel>
+static void check_kernel(Kernel kernel,
+                         const vector<DocId>& a,
+                         const vector<DocId>& b) {
+  vector<uint32_t> a_pos(std::min(a.size(), b.size()));
+  vector<uint32_t> b_pos(a_pos.size());
+  size_t n = kernel(a.data(), a.size(), b.data(), b.size(), a_pos.data(),
+                    b_pos.data());
+
+  vector<DocId> expected;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::back_inserter(expected));
+  REQUIRE(n == expected.size());
+  for (size_t k = 0; k < n; k++) {
+    REQUIRE(a[a_pos[k]] == expected[k]);
+    REQUIRE(b[b_pos[k]] == expected[k]);
+  }
+}
+
+TEST_CASE("intersect kernels match std::set_intersection", "[PostingList]") {
+  std::mt19937 rng(5950);
+  // sizes around the 4-wide SIMD blocks, and density from sparse to every
+  // document
+  for (size_t na : {0, 1, 3, 4, 5, 8, 17, 100, 1000}) {
+    for (size_t nb : {0, 1, 4, 7, 64, 1000, 5000}) {
+      for (DocId limit : {10000u, 2000u}) {
+        if (na > limit || nb > limit)
+          continue;
+        auto a = random_docs(&rng, na, limit);
+        auto b = random_docs(&rng, nb, limit);
+        INFO("na " << na << " nb " << nb << " limit " << limit);
+        check_kernel(intersect_blocks, a, b);
+        check_kernel(intersect_blocks, b, a);
+        check_kernel(intersect_galloping, a, b);
+        check_kernel(intersect_galloping, b, a);
+      }
+    }
+  }
+
+  // identical, disjoint, and interleaved lists, and ids at the top of the
+  // range
+  vector<DocId> evens;
+  vector<DocId> odds;
+  for (DocId d = 0; d < 200; d++) {
+    (d % 2 == 0 ? evens : odds).push_back(d);
+  }
+  vector<DocId> high = {kNoDoc - 9, kNoDoc - 5, kNoDoc - 2, kNoDoc - 1};
+  vector<DocId> high2 = {1, kNoDoc - 5, kNoDoc - 1};
+  for (auto kernel : {intersect_blocks, intersect_galloping}) {
+    check_kernel(kernel, evens, evens);
+    check_kernel(kernel, evens, odds);
+    check_kernel(kernel, high, high2);
+  }
+}
+
+TEST_CASE("intersect_postings sums the counts of the matches",
+          "[PostingList]") {
+  std::mt19937 rng(17);
+  std::uniform_int_distribution<uint32_t> count(1, 9);
+  // lengths far enough apart to gallop, and close enough to merge
+  for (auto sizes : vector<vector<size_t>>{{50, 3000, 400},
+                                           {10, 10 * kGallopRatio + 1},
+                                           {500, 600, 700, 800},
+                                           {0, 100},
+                                           {7}}) {
+    vector<PostingList> lists(sizes.size());
+    std::map<DocId, std::pair<size_t, size_t>> seen;  // doc: (lists, rank)
+    for (size_t l = 0; l < sizes.size(); l++) {
+      for (DocId doc : random_docs(&rng, sizes[l], 4000)) {
+        uint32_t c = count(rng);
+        lists[l].add(doc, c);
+        seen[doc].first++;
+        seen[doc].second += c;
+      }
+    }
+    vector<Hit> expected;
+    for (auto& [doc, found] : seen) {
+      if (found.first == sizes.size())
+        expected.push_back({doc, found.second});
+    }
+
+    vector<PostingView> views;
+    for (auto& list : lists)
+      views.push_back(list.view());
+    vector<Hit> hits = intersect_postings(views);
+    REQUIRE(hits.size() == expected.size());
+    for (size_t i = 0; i < hits.size(); i++) {
+      REQUIRE(hits[i].doc == expected[i].doc);
+      REQUIRE(hits[i].rank == expected[i].rank);
+    }
+  }
+  REQUIRE(intersect_postings({}).empty());
+}
+
+TEST_CASE("PostingList keeps documents sorted", "[PostingList]") {
+  PostingList list;
+  list.add(5);
+  list.add(9, 2);
+  list.add(2, 3);
+  list.add(9);
+  list.add(7);
+  PostingView view = list.view();
+  REQUIRE(view.size == 4);
+  REQUIRE(vector<DocId>(view.docs, view.docs + 4) ==
+          vector<DocId>{2, 5, 7, 9});
+  REQUIRE(vector<uint32_t>(view.counts, view.counts + 4) ==
+          vector<uint32_t>{3, 1, 1, 3});
+
+  // renumbering drops removed documents and keeps the rest in order
+  vector<DocId> new_id = {0, 0, 0, 0, 0, 1, 0, kNoDoc, 0, 2};
+  list.renumber(new_id);
+  view = list.view();
+  REQUIRE(view.size == 3);
+  REQUIRE(vector<DocId>(view.docs, view.docs + 3) == vector<DocId>{0, 1, 2});
+  REQUIRE(vector<uint32_t>(view.counts, view.counts + 3) ==
+          vector<uint32_t>{3, 1, 3});
+}
+
+TEST_CASE("PostingList::renumber drops and moves documents down",
+          "[PostingList]") {
+  PostingList list;
+  for (DocId d = 0; d < 10; d++)
+    list.add(d, d + 1);
+
+  // every other document removed, the rest packed down densely, the way
+  // WordIndex::remove_documents() compacts its table
+  vector<DocId> new_id(10, kNoDoc);
+  for (DocId d = 1; d < 10; d += 2)
+    new_id[d] = d / 2;
+  list.renumber(new_id);
+  PostingView view = list.view();
+  REQUIRE(vector<DocId>(view.docs, view.docs + view.size) ==
+          vector<DocId>{0, 1, 2, 3, 4});
+  REQUIRE(vector<uint32_t>(view.counts, view.counts + view.size) ==
+          vector<uint32_t>{2, 4, 6, 8, 10});
+
+  // documents past the end of new_id keep their ids
+  list.add(7, 5);
+  list.renumber({kNoDoc, 0, 1});
+  view = list.view();
+  REQUIRE(vector<DocId>(view.docs, view.docs + view.size) ==
+          vector<DocId>{0, 1, 3, 4, 7});
+
+  // and removing every document leaves an empty list
+  list.renumber(vector<DocId>(8, kNoDoc));
+  REQUIRE(list.size() == 0);
+}
+
+TEST_CASE("select_window keeps one sorted page", "[PostingList]") {
+  vector<Hit> all;
+  for (DocId d = 0; d < 50; d++) {
+    all.push_back({d, (d * 37) % 50});
+  }
+  auto better = [](const Hit& a, const Hit& b) { return a.rank > b.rank; };
+  vector<Hit> sorted = all;
+  std::sort(sorted.begin(), sorted.end(), better);
+
+  for (auto [offset, k] : vector<std::pair<size_t, size_t>>{
+           {0, 10}, {10, 10}, {45, 10}, {0, 50}, {0, 100}, {49, 1}}) {
+    vector<Hit> hits = all;
+    select_window(&hits, offset, k, better);
+    size_t expected = std::min(k, all.size() - offset);
+    REQUIRE(hits.size() == expected);
+    for (size_t i = 0; i < expected; i++) {
+      REQUIRE(hits[i].rank == sorted[offset + i].rank);
+    }
+  }
+  vector<Hit> hits = all;
+  select_window(&hits, 50, 10, better);
+  REQUIRE(hits.empty());
+}
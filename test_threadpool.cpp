@@ -0,0 +1,364 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./ThreadPool.hpp"
+#include "./catch.hpp"
+
+using searchserver::ThreadPool;
+using searchserver::WaitGroup;
+
+// Spins (yielding) until done() holds, for up to five seconds.  Returns
+// whether it does.
+template <typename F>
+static bool eventually(F done) {
+  auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > give_up)
+      return false;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+// Sums what every worker counted
+static uint64_t total_tasks(const ThreadPool::Stats& stats) {
+  uint64_t total = 0;
+  for (auto& worker : stats.workers)
+    total += worker.tasks;
+  return total;
+}
+
+static uint64_t total_steals(const ThreadPool::Stats& stats) {
+  uint64_t total = 0;
+  for (auto& worker : stats.workers)
+    total += worker.steals;
+  return total;
+}
+
+// Returns the stats once n tasks have been counted.  A task is counted just
+// after it returns, so the last ones can lag behind a WaitGroup.
+static ThreadPool::Stats settled_stats(const ThreadPool& pool, uint64_t n) {
+  REQUIRE(eventually([&] { return total_tasks(pool.stats()) >= n; }));
+  return pool.stats();
+}
+
+// A task that holds its worker until opened, or until the gate goes away, so
+// that a failed check doesn't leave the pool's destructor waiting for it.
+// (Catch2 can't check from a worker thread, so tasks only record what the
+// test thread checks.)
+struct Gate {
+  ~Gate() { open = true; }
+
+  std::atomic<bool> entered{false};
+  std::atomic<bool> open{false};
+
+  void hold() {
+    entered = true;
+    while (!open)
+      std::this_thread::yield();
+  }
+};
+
+TEST_CASE("ThreadPool deque: thieves take every task once", "[ThreadPool]") {
+  // The root task pushes onto its own deque and then only watches, so every
+  // task has to be stolen, with three thieves racing for the top.  More
+  // tasks than the deque starts with make it grow under them.
+  constexpr size_t kTasks = 5000;
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> runs(kTasks);
+  std::atomic<size_t> finished{0};
+  WaitGroup root;
+  root.add();
+  pool.dispatch([&] {
+    for (size_t i = 0; i < kTasks; i++) {
+      pool.dispatch([&runs, &finished, i] {
+        runs[i]++;
+        finished++;
+      });
+    }
+    while (finished < kTasks)
+      std::this_thread::yield();
+    root.done();
+  });
+  root.wait();
+
+  for (size_t i = 0; i < kTasks; i++) {
+    REQUIRE(runs[i].load() == 1);
+  }
+  auto stats = settled_stats(pool, kTasks + 1);
+  REQUIRE(total_steals(stats) == kTasks);
+}
+
+TEST_CASE("ThreadPool deque: owner pops while others steal", "[ThreadPool]") {
+  // The root task waits with ThreadPool::wait(), popping its own deque from
+  // the bottom while the other workers steal from the top; the last task is
+  // fought over from both ends
+  constexpr size_t kTasks = 2000;
+  ThreadPool pool(4);
+  for (int round = 0; round < 20; round++) {
+    std::vector<std::atomic<int>> runs(kTasks);
+    WaitGroup root;
+    root.add();
+    pool.dispatch([&] {
+      WaitGroup group;
+      group.add(kTasks);
+      for (size_t i = 0; i < kTasks; i++) {
+        pool.dispatch([&runs, &group, i] {
+          runs[i]++;
+          group.done();
+        });
+      }
+      pool.wait(&group);
+      root.done();
+    });
+    root.wait();
+    for (size_t i = 0; i < kTasks; i++) {
+      REQUIRE(runs[i].load() == 1);
+    }
+  }
+}
+
+TEST_CASE("ThreadPool runs every task before it is destroyed",
+          "[ThreadPool]") {
+  // the only worker is held until after the destructor has begun, with
+  // every task still queued
+  std::atomic<size_t> ran{0};
+  Gate gate;
+  std::thread opener;
+  {
+    ThreadPool pool(1);
+    pool.dispatch([&] { gate.hold(); });
+    for (int i = 0; i < 1000; i++) {
+      // a task dispatched from a task goes on its worker's deque, and still
+      // runs after shutdown has begun
+      pool.dispatch([&] {
+        ran++;
+        pool.dispatch([&] { ran++; });
+      });
+    }
+    opener = std::thread([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      gate.open = true;
+    });
+  }
+  opener.join();
+  REQUIRE(ran.load() == 2000);
+
+  // parked workers are woken to drain too
+  ran = 0;
+  {
+    ThreadPool pool(4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int i = 0; i < 100; i++) {
+      pool.dispatch([&] { ran++; });
+    }
+  }
+  REQUIRE(ran.load() == 100);
+}
+
+TEST_CASE("ThreadPool::try_dispatch bounds each lane", "[ThreadPool]") {
+  ThreadPool pool(1, 2);
+  Gate gate;
+  pool.dispatch([&] { gate.hold(); });
+  REQUIRE(eventually([&] { return gate.entered.load(); }));
+
+  // with the only worker held, two tasks fit in each lane and no more
+  std::vector<std::string> order;
+  std::mutex order_lock;
+  auto record = [&](const char* name) {
+    return [&order, &order_lock, name] {
+      std::lock_guard<std::mutex> guard(order_lock);
+      order.emplace_back(name);
+    };
+  };
+  using Priority = ThreadPool::Priority;
+  REQUIRE(pool.try_dispatch(record("n1")));
+  REQUIRE(pool.try_dispatch(record("n2"), Priority::kNormal));
+  REQUIRE_FALSE(pool.try_dispatch(record("n3")));
+  REQUIRE(pool.try_dispatch(record("h1"), Priority::kHigh));
+  REQUIRE(pool.try_dispatch(record("h2"), Priority::kHigh));
+  REQUIRE_FALSE(pool.try_dispatch(record("h3"), Priority::kHigh));
+  // dispatch() isn't bounded
+  pool.dispatch(record("d1"));
+  REQUIRE(pool.stats().queued == 5);
+  REQUIRE(pool.stats().refused == 2);
+
+  // the high lane runs first, and each lane in order
+  gate.open = true;
+  auto stats = settled_stats(pool, 6);
+  {
+    std::lock_guard<std::mutex> guard(order_lock);
+    REQUIRE(order == std::vector<std::string>{"h1", "h2", "n1", "n2", "d1"});
+  }
+  REQUIRE(stats.queued == 0);
+  REQUIRE(stats.refused == 2);
+
+  // room again once the tasks have started
+  WaitGroup group;
+  group.add(2);
+  REQUIRE(pool.try_dispatch([&] { group.done(); }));
+  REQUIRE(pool.try_dispatch([&] { group.done(); }));
+  group.wait();
+}
+
+TEST_CASE("WaitGroup waits for every task", "[ThreadPool]") {
+  ThreadPool pool(3);
+  std::atomic<int> ran{0};
+  WaitGroup group;
+  REQUIRE(group.finished());
+  group.add(100);
+  REQUIRE_FALSE(group.finished());
+  for (int i = 0; i < 100; i++) {
+    pool.dispatch([&] {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      ran++;
+      group.done();
+    });
+  }
+  pool.wait(&group);
+  REQUIRE(group.finished());
+  REQUIRE(ran.load() == 100);
+
+  // from a worker, wait() runs the tasks it waits for: with one worker,
+  // blocking instead would never return
+  ThreadPool one(1);
+  WaitGroup outer;
+  outer.add();
+  std::atomic<int> inner_ran{0};
+  one.dispatch([&] {
+    WaitGroup inner;
+    inner.add(10);
+    for (int i = 0; i < 10; i++) {
+      one.dispatch([&] {
+        inner_ran++;
+        inner.done();
+      });
+    }
+    one.wait(&inner);
+    outer.done();
+  });
+  outer.wait();
+  REQUIRE(inner_ran.load() == 10);
+}
+
+TEST_CASE("ThreadPool::parallel_for visits every index once", "[ThreadPool]") {
+  ThreadPool pool(4);
+  constexpr size_t kEnd = 10007;
+  for (size_t grain : {0, 1, 7, 1000, 20000}) {
+    std::vector<std::atomic<int>> visits(kEnd);
+    pool.parallel_for(3, kEnd, grain, [&](size_t i) { visits[i]++; });
+    for (size_t i = 0; i < kEnd; i++) {
+      REQUIRE(visits[i].load() == (i < 3 ? 0 : 1));
+    }
+  }
+
+  bool called = false;
+  pool.parallel_for(5, 5, 1, [&](size_t) { called = true; });
+  pool.parallel_for(6, 5, 1, [&](size_t) { called = true; });
+  REQUIRE_FALSE(called);
+
+  // nested in a task of a one-worker pool
+  ThreadPool one(1);
+  std::atomic<size_t> sum{0};
+  auto done = one.submit([&] {
+    one.parallel_for(0, 100, 3, [&](size_t i) { sum += i; });
+  });
+  done.get();
+  REQUIRE(sum.load() == 4950);
+}
+
+TEST_CASE("ThreadPool::parallel_for waits for its chunks before throwing",
+          "[ThreadPool]") {
+  // index 0 is the caller's, and throws while the worker is still held in
+  // the chunk of index 1, which uses body's captures
+  ThreadPool pool(1);
+  Gate gate;
+  std::atomic<bool> finished{false};
+  std::thread opener([&] {
+    eventually([&] { return gate.entered.load(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.open = true;
+  });
+  bool threw = false;
+  try {
+    pool.parallel_for(0, 2, 1, [&](size_t i) {
+      if (i == 0) {
+        while (!gate.entered)
+          std::this_thread::yield();
+        throw std::runtime_error("first chunk");
+      }
+      gate.hold();
+      finished = true;
+    });
+  } catch (const std::runtime_error& e) {
+    threw = true;
+    REQUIRE(finished.load());
+    REQUIRE(std::string(e.what()) == "first chunk");
+  }
+  opener.join();
+  REQUIRE(threw);
+}
+
+TEST_CASE("ThreadPool::stats counts what the workers did", "[ThreadPool]") {
+  ThreadPool pool(3);
+  auto fresh = pool.stats();
+  REQUIRE(fresh.workers.size() == 3);
+  REQUIRE(total_tasks(fresh) == 0);
+  REQUIRE(fresh.wait.total() == 0);
+  REQUIRE(fresh.queued == 0);
+
+  WaitGroup group;
+  group.add(500);
+  for (int i = 0; i < 500; i++) {
+    pool.dispatch([&] { group.done(); });
+  }
+  group.wait();
+  auto stats = settled_stats(pool, 500);
+  REQUIRE(total_tasks(stats) == 500);
+  REQUIRE(stats.wait.total() == 500);
+  REQUIRE(stats.run.total() == 500);
+  REQUIRE(stats.queued == 0);
+  REQUIRE(stats.refused == 0);
+  REQUIRE(stats.uptime_ns > 0);
+  for (auto& worker : stats.workers) {
+    REQUIRE(worker.busy_ratio >= 0);
+    REQUIRE(worker.busy_ratio <= 1);
+  }
+
+  // /stats serves to_json(); its totals are the workers' sums
+  std::string json = stats.to_json();
+  REQUIRE(json.find("\"threads\": 3") != std::string::npos);
+  REQUIRE(json.find("\"tasks\": 500") != std::string::npos);
+  REQUIRE(json.find("\"steals\": " + std::to_string(total_steals(stats))) !=
+          std::string::npos);
+  REQUIRE(json.find("\"refused\": 0") != std::string::npos);
+  REQUIRE(json.find("\"wait_us\": {\"count\": 500") != std::string::npos);
+  REQUIRE(json.find("\"run_us\": {\"count\": 500") != std::string::npos);
+}
+
+TEST_CASE("ThreadPool::Histogram buckets by power of two", "[ThreadPool]") {
+  using Histogram = ThreadPool::Histogram;
+  REQUIRE(Histogram::bucket(0) == 0);
+  REQUIRE(Histogram::bucket(999) == 0);
+  REQUIRE(Histogram::bucket(1000) == 1);
+  REQUIRE(Histogram::bucket(3999) == 2);
+  REQUIRE(Histogram::bucket(4000) == 3);
+  REQUIRE(Histogram::bucket(UINT64_MAX) == Histogram::kBuckets - 1);
+
+  Histogram h;
+  REQUIRE(h.quantile_us(0.5) == 0);
+  h.counts[0] = 90;
+  h.counts[4] = 9;
+  h.counts[10] = 1;
+  REQUIRE(h.total() == 100);
+  REQUIRE(h.quantile_us(0.5) == 1);
+  REQUIRE(h.quantile_us(0.9) == 1);
+  REQUIRE(h.quantile_us(0.99) == 16);
+  REQUIRE(h.quantile_us(1) == 1024);
+}
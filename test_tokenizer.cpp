@@ -0,0 +1,138 @@
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "./Tokenizer.hpp"
+#include "./catch.hpp"
+
+using searchserver::Tokenizer;
+
+// a word as (offset into the text, lowercased word)
+using Word = std::pair<size_t, std::string>;
+
+static const std::string kDelimiters = " \r\t\v\n,.:;?!";
+
+// The words of text, a byte at a time
+static std::vector<Word> reference_words(const std::string& text) {
+  std::vector<Word> words;
+  size_t start = 0;
+  for (size_t i = 0; i <= text.size(); i++) {
+    if (i < text.size() && kDelimiters.find(text[i]) == std::string::npos) {
+      continue;
+    }
+    if (i > start) {
+      std::string word = text.substr(start, i - start);
+      for (char& c : word) {
+        if (c >= 'A' && c <= 'Z')
+          c = static_cast<char>(c - 'A' + 'a');
+      }
+      words.emplace_back(start, word);
+    }
+    start = i + 1;
+  }
+  return words;
+}
+
+// Checks what Tokenizer finds in text against reference_words(), and that
+// it lowercases exactly the letters A-Z in place
+static void check_tokens(const std::string& text) {
+  std::string buffer = text;
+  Tokenizer tokens(buffer.data(), buffer.size());
+  std::vector<Word> words;
+  std::string_view word;
+  while (tokens.next(&word)) {
+    words.emplace_back(word.data() - buffer.data(), std::string(word));
+  }
+  // it stays done
+  REQUIRE_FALSE(tokens.next(&word));
+
+  REQUIRE(words == reference_words(text));
+  std::string lowered = text;
+  for (char& c : lowered) {
+    if (c >= 'A' && c <= 'Z')
+      c = static_cast<char>(c - 'A' + 'a');
+  }
+  REQUIRE(buffer == lowered);
+}
+
+TEST_CASE("Tokenizer matches a byte at a time split on random bytes",
+          "[Tokenizer]") {
+  std::mt19937 rng(5950);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<size_t> pick_delimiter(0,
+                                                       kDelimiters.size() - 1);
+  std::uniform_int_distribution<size_t> length(0, 300);
+  for (int round = 0; round < 20000; round++) {
+    // every byte value, with delimiters common enough to make short words
+    // and letters common enough to lowercase
+    std::string text(length(rng), '\0');
+    for (char& c : text) {
+      int roll = byte(rng);
+      if (roll < 48) {
+        c = kDelimiters[pick_delimiter(rng)];
+      } else if (roll < 96) {
+        c = static_cast<char>('A' + roll % 26);
+      } else {
+        c = static_cast<char>(byte(rng));
+      }
+    }
+    INFO("round " << round);
+    check_tokens(text);
+  }
+}
+
+TEST_CASE("Tokenizer handles delimiters at vector and chunk edges",
+          "[Tokenizer]") {
+  // a delimiter at each position around the 16 byte vectors and the 64 byte
+  // chunks, alone and in pairs, in text of every length around them
+  for (size_t size : {15, 16, 17, 63, 64, 65, 127, 128, 129, 200}) {
+    for (size_t at : {0, 1, 14, 15, 16, 17, 31, 32, 47, 48, 62, 63, 64, 65,
+                      127, 128, 191, 192}) {
+      if (at >= size)
+        continue;
+      std::string text(size, 'W');
+      text[at] = ' ';
+      INFO("size " << size << " delimiter at " << at);
+      check_tokens(text);
+      if (at + 1 < size) {
+        text[at + 1] = '.';
+        check_tokens(text);
+      }
+    }
+  }
+
+  // words that end exactly where a chunk does, and words that span chunks
+  std::string text(64, 'a');
+  text += " ";
+  text += std::string(63, 'B') + "," + std::string(300, 'c') + "\n";
+  check_tokens(text);
+}
+
+TEST_CASE("Tokenizer on text of only delimiters or only letters",
+          "[Tokenizer]") {
+  for (size_t size = 0; size <= 130; size++) {
+    INFO("size " << size);
+    std::string delimiters;
+    for (size_t i = 0; i < size; i++)
+      delimiters += kDelimiters[i % kDelimiters.size()];
+    check_tokens(delimiters);
+
+    // one word, whatever its length
+    std::string letters(size, 'Q');
+    std::string buffer = letters;
+    Tokenizer tokens(buffer.data(), buffer.size());
+    std::string_view word;
+    if (size == 0) {
+      REQUIRE_FALSE(tokens.next(&word));
+      continue;
+    }
+    REQUIRE(tokens.next(&word));
+    REQUIRE(word == std::string(size, 'q'));
+    REQUIRE_FALSE(tokens.next(&word));
+  }
+
+  // bytes >= 0x80 belong to words and are left alone
+  check_tokens("\xc3\x84PFEL \xff\x80\xfe x\xe2\x80\x99S");
+}
@@ -0,0 +1,144 @@
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "./WordIndex.hpp"
+#include "./catch.hpp"
+
+using searchserver::DocId;
+using searchserver::WordIndex;
+
+static string doc_name(size_t d) {
+  return "doc" + std::to_string(d);
+}
+
+// Document d of make_index() has d + 1 occurances of "common", one of
+// "own<d>", and, for even d, two of "even"
+static WordIndex make_index(size_t num_docs) {
+  WordIndex index;
+  for (size_t d = 0; d < num_docs; d++) {
+    DocId doc = index.add_document(doc_name(d));
+    REQUIRE(doc == d);
+    for (size_t i = 0; i <= d; i++)
+      index.record("common", doc);
+    index.record("own" + std::to_string(d), doc);
+    if (d % 2 == 0) {
+      index.record("even", doc);
+      index.record("even", doc);
+    }
+  }
+  return index;
+}
+
+// Returns the documents word was found in, with its count in each
+static std::map<string, size_t> lookup(WordIndex* index, const string& word) {
+  std::map<string, size_t> found;
+  for (auto& result : index->lookup_word(word)) {
+    REQUIRE(found.count(result.doc_name) == 0);
+    found[result.doc_name] = result.rank;
+  }
+  return found;
+}
+
+// Checks that index holds exactly the postings make_index(num_docs) recorded,
+// less those of the removed documents
+static void check_postings(WordIndex* index,
+                           size_t num_docs,
+                           const std::set<size_t>& removed) {
+  std::map<string, size_t> common;
+  std::map<string, size_t> even;
+  for (size_t d = 0; d < num_docs; d++) {
+    string own = "own" + std::to_string(d);
+    INFO("document " << d);
+    if (removed.count(d) != 0) {
+      REQUIRE(index->lookup_word(own).empty());
+      continue;
+    }
+    REQUIRE(lookup(index, own) == std::map<string, size_t>{{doc_name(d), 1}});
+    common[doc_name(d)] = d + 1;
+    if (d % 2 == 0)
+      even[doc_name(d)] = 2;
+  }
+  REQUIRE(lookup(index, "common") == common);
+  REQUIRE(lookup(index, "even") == even);
+  REQUIRE(index->num_docs() == common.size());
+  // words left without documents are gone too
+  REQUIRE(index->num_words() ==
+          common.size() + (common.empty() ? 0 : 1) + (even.empty() ? 0 : 1));
+}
+
+TEST_CASE("WordIndex::remove_documents drops their postings", "[WordIndex]") {
+  WordIndex index = make_index(20);
+  check_postings(&index, 20, {});
+
+  // few enough that the table isn't compacted: the others keep their ids
+  REQUIRE(index.remove_documents({doc_name(3), doc_name(8), "missing"}) == 2);
+  check_postings(&index, 20, {3, 8});
+  REQUIRE_FALSE(index.document(3).live);
+  REQUIRE_FALSE(index.document(8).live);
+  for (size_t d : {0, 4, 9, 19}) {
+    REQUIRE(index.document(d).live);
+    REQUIRE(index.document(d).name == doc_name(d));
+    REQUIRE(index.add_document(doc_name(d)) == d);
+  }
+
+  // removing them again does nothing
+  REQUIRE(index.remove_documents({doc_name(3)}) == 0);
+  check_postings(&index, 20, {3, 8});
+
+  // a removed document can be added back, as a new one
+  DocId again = index.add_document(doc_name(8));
+  REQUIRE(again == 20);
+  index.record("own8", again);
+  REQUIRE(lookup(&index, "own8") ==
+          std::map<string, size_t>{{doc_name(8), 1}});
+  REQUIRE(index.remove_documents({doc_name(8)}) == 1);
+  REQUIRE(index.lookup_word("own8").empty());
+}
+
+TEST_CASE("WordIndex::remove_documents renumbers documents densely",
+          "[WordIndex]") {
+  WordIndex index = make_index(20);
+  std::set<size_t> removed = {0, 2, 5, 6, 11, 19};
+  vector<string> names;
+  for (size_t d : removed)
+    names.push_back(doc_name(d));
+  REQUIRE(index.remove_documents(names) == removed.size());
+  check_postings(&index, 20, removed);
+
+  // more than 1/kCompactRatio of the table was removed, so the documents
+  // left are numbered 0 to num_docs() - 1, in the order they were added
+  REQUIRE(removed.size() * WordIndex::kCompactRatio > 20);
+  REQUIRE(index.num_docs() == 20 - removed.size());
+  DocId next = 0;
+  for (size_t d = 0; d < 20; d++) {
+    if (removed.count(d) != 0)
+      continue;
+    INFO("document " << d);
+    REQUIRE(index.document(next).live);
+    REQUIRE(index.document(next).name == doc_name(d));
+    REQUIRE(index.document(next).num_words == d + 2 + (d % 2 == 0 ? 2 : 0));
+    REQUIRE(index.add_document(doc_name(d)) == next);
+    next++;
+  }
+  REQUIRE_THROWS_AS(index.document(next), std::out_of_range);
+
+  // new documents and postings go after them
+  DocId added = index.add_document("new");
+  REQUIRE(added == next);
+  index.record("common", added);
+  index.record("common", index.add_document(doc_name(1)));
+  REQUIRE(lookup(&index, "common")["new"] == 1);
+  REQUIRE(lookup(&index, "common")[doc_name(1)] == 3);
+
+  // removing every document empties the index
+  names.clear();
+  for (DocId d = 0; d < index.num_docs(); d++)
+    names.push_back(index.document(d).name);
+  REQUIRE(index.remove_documents(names) == names.size());
+  REQUIRE(index.num_docs() == 0);
+  REQUIRE(index.num_words() == 0);
+  REQUIRE(index.lookup_word("common").empty());
+}